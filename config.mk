@@ -1,20 +1,36 @@
-# config.mk
-
-CXX      = g++
-CXXFLAGS = -Wall -Wextra -std=c++17 -O2
-LDFLAGS  =
-INCLUDES = -Isrc
-
-SRC_DIR  = src/frontend
-OBJ_DIR  = build
-
-# Function to recursively find C++ source files
-define find_cpp_sources
-$(wildcard $(1)/*.cpp) $(wildcard $(1)/*.cc) $(wildcard $(1)/*.cxx) \
-$(foreach d,$(wildcard $(1)/*),$(call find_cpp_sources,$(d)))
-endef
-
-SRC_FILES := $(call find_cpp_sources,$(SRC_DIR))
-OBJ_FILES := $(patsubst $(SRC_DIR)/%.cpp,$(OBJ_DIR)/%.o,\
-               $(patsubst $(SRC_DIR)/%.cc,$(OBJ_DIR)/%.o,\
-                 $(patsubst $(SRC_DIR)/%.cxx,$(OBJ_DIR)/%.o,$(SRC_FILES))))
\ No newline at end of file
+# config.mk
+
+CXX      = g++
+CXXFLAGS = -Wall -Wextra -std=c++17 -O2 -pthread
+LDFLAGS  = -pthread
+INCLUDES = -Isrc
+
+SRC_DIR  = src/frontend
+VM_DIR   = src/vm
+CLIENT_DIR = src/client
+LIB_DIR  = src/lib
+OBJ_DIR  = build
+
+# Function to recursively find C++ source files
+define find_cpp_sources
+$(wildcard $(1)/*.cpp) $(wildcard $(1)/*.cc) $(wildcard $(1)/*.cxx) \
+$(foreach d,$(wildcard $(1)/*),$(call find_cpp_sources,$(d)))
+endef
+
+SRC_FILES := $(call find_cpp_sources,$(SRC_DIR))
+OBJ_FILES := $(patsubst $(SRC_DIR)/%.cpp,$(OBJ_DIR)/%.o,\
+               $(patsubst $(SRC_DIR)/%.cc,$(OBJ_DIR)/%.o,\
+                 $(patsubst $(SRC_DIR)/%.cxx,$(OBJ_DIR)/%.o,$(SRC_FILES))))
+
+# The VM is linked into the frontend, its own main.cpp is left out
+VM_SRC_FILES := $(filter-out $(VM_DIR)/main.cpp,$(wildcard $(VM_DIR)/*.cpp))
+VM_OBJ_FILES := $(patsubst $(VM_DIR)/%.cpp,$(OBJ_DIR)/vm/%.o,$(VM_SRC_FILES))
+
+# The client only needs the message framing it shares with the server
+CLIENT_SRC_FILES := $(wildcard $(CLIENT_DIR)/*.cpp)
+CLIENT_OBJ_FILES := $(patsubst $(CLIENT_DIR)/%.cpp,$(OBJ_DIR)/client/%.o,$(CLIENT_SRC_FILES)) $(OBJ_DIR)/server/protocol.o
+
+# The library is everything but the frontend's main, the shared one is built from position-independent copies
+LIB_SRC_FILES := $(wildcard $(LIB_DIR)/*.cpp)
+LIB_OBJ_FILES := $(patsubst $(LIB_DIR)/%.cpp,$(OBJ_DIR)/lib/%.o,$(LIB_SRC_FILES)) $(filter-out $(OBJ_DIR)/main.o,$(OBJ_FILES)) $(VM_OBJ_FILES)
+PIC_OBJ_FILES := $(patsubst $(OBJ_DIR)/%,$(OBJ_DIR)/pic/%,$(LIB_OBJ_FILES))
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "../frontend/server/protocol.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Talks to a frontend started with --serve:
+//
+//     client path.sock run Sheet1 program.elg     (- reads the program from stdin)
+//     client path.sock edit Sheet1 3 "A3 = 5"
+//     client path.sock get Sheet1 A1,B2
+//     client path.sock dump|stats|drop Sheet1
+//     client path.sock shutdown
+//
+// --repeat N sends the request N times over one connection and reports the request rate on stderr.
+static void usage() {
+    std::cerr << "usage: client [--repeat N] <socket> run|edit|get|dump|stats|drop|shutdown [arguments]\n";
+}
+
+static int connect_to(const std::string& path) {
+#ifndef _WIN32
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path " << path << " is too long\n";
+        return -1;
+    }
+
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        std::cerr << "Could not connect to " << path << ": " << std::strerror(errno) << "\n";
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    return fd;
+#else
+    std::cerr << "Unix domain sockets are not supported on this platform\n";
+    return -1;
+#endif
+}
+
+int main(int argc, char** argv) {
+    long long repeat = 1;
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1LL, std::stoll(argv[++i]));
+        } else {
+            arguments.push_back(argument);
+        }
+    }
+
+    if (arguments.size() < 2) {
+        usage();
+        return 1;
+    }
+
+    // Commands map to the request of the same name, the last argument of run and edit is the payload
+    std::string command = arguments[1];
+    std::vector<std::string> words = {command};
+    std::transform(words[0].begin(), words[0].end(), words[0].begin(), [](unsigned char c) { return std::toupper(c); });
+    std::string payload = "";
+    if (command == "run" && arguments.size() == 4) {
+        words.push_back(arguments[2]);
+        std::stringstream ss;
+        if (arguments[3] == "-") {
+            ss << std::cin.rdbuf();
+        } else {
+            std::ifstream file(arguments[3]);
+            if (!file) {
+                std::cerr << "Could not open " << arguments[3] << "\n";
+                return 1;
+            }
+
+            ss << file.rdbuf();
+        }
+
+        payload = ss.str();
+    } else if (command == "edit" && arguments.size() == 5) {
+        words.push_back(arguments[2]);
+        words.push_back(arguments[3]);
+        payload = arguments[4];
+    } else if (command == "get" && arguments.size() == 4) {
+        words.push_back(arguments[2]);
+        payload = arguments[3];
+    } else if ((command == "dump" || command == "stats" || command == "drop") && arguments.size() == 3) {
+        words.push_back(arguments[2]);
+    } else if (command != "shutdown" || arguments.size() != 2) {
+        usage();
+        return 1;
+    }
+
+    int fd = connect_to(arguments[0]);
+    if (fd < 0) {
+        return 1;
+    }
+
+    Connection* connection = create_connection(fd);
+    Message reply;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        for (long long i = 0; i < repeat; i++) {
+            connection->write_message(words, payload);
+            if (!connection->read_message(reply)) {
+                std::cerr << "The server closed the connection\n";
+                delete connection;
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        delete connection;
+        return 1;
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    delete connection;
+
+    if (repeat > 1) {
+        std::cerr << repeat << " requests in " << elapsed << "s, " << repeat / elapsed << " requests/s\n";
+    }
+
+    if (reply.words[0] != "OK") {
+        std::cerr << reply.payload << "\n";
+        return 1;
+    }
+
+    std::cout << reply.payload;
+    return 0;
+}
\ No newline at end of file
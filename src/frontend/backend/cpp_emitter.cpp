@@ -0,0 +1,396 @@
+#include "cpp_emitter.hpp"
+#include "../interpolation/interpolation.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Emitted in front of every program: builtins take their arguments as a slice of the operand stack
+static const char* CPP_RUNTIME = R"(#include <cmath>
+#include <cstdio>
+
+static inline double elg_sum(const double* arguments, long long amount) {
+    double result = 0;
+    for (long long i = 0; i < amount; i++) {
+        result += arguments[i];
+    }
+
+    return result;
+}
+
+// Every argument is a number, a range argument is gathered to the cells of it that were written
+static inline double elg_count(const double*, long long amount) {
+    return amount;
+}
+
+static inline double elg_average(const double* arguments, long long amount) {
+    return amount == 0 ? 0 : elg_sum(arguments, amount) / amount;
+}
+
+static inline double elg_min(const double* arguments, long long amount) {
+    double result = amount == 0 ? 0 : arguments[0];
+    for (long long i = 1; i < amount; i++) {
+        result = arguments[i] < result ? arguments[i] : result;
+    }
+
+    return result;
+}
+
+static inline double elg_max(const double* arguments, long long amount) {
+    double result = amount == 0 ? 0 : arguments[0];
+    for (long long i = 1; i < amount; i++) {
+        result = arguments[i] > result ? arguments[i] : result;
+    }
+
+    return result;
+}
+
+static inline double elg_abs(const double* arguments, long long amount) {
+    return amount == 0 ? 0 : std::fabs(arguments[0]);
+}
+)";
+
+// Builtins that aggregate every number inside a range argument, like the VM's
+static const std::set<std::string> CPP_AGGREGATES = {"SUM", "AVERAGE", "COUNT", "MIN", "MAX"};
+
+static const std::map<std::string, std::string> CPP_BUILTINS = {
+    {"SUM", "elg_sum"},
+    {"AVERAGE", "elg_average"},
+    {"COUNT", "elg_count"},
+    {"MIN", "elg_min"},
+    {"MAX", "elg_max"},
+    {"ABS", "elg_abs"},
+};
+
+static std::string to_upper(std::string value) {
+    for (char& character : value) {
+        character = std::toupper(character);
+    }
+
+    return value;
+}
+
+CppEmitter::CppEmitter(const std::vector<Instruction>& instructions) : instructions(instructions) {}
+
+std::string CppEmitter::emit() {
+    this->collect_slots();
+    this->ranges.clear();
+
+    std::stringstream body;
+    body << std::setprecision(std::numeric_limits<double>::max_digits10);
+
+    long long depth = 0;
+    long long max_depth = 0;
+    long long blocks = 0;
+    long long instruction_amount = this->instructions.size();
+    for (long long i = 0; i < instruction_amount; i++) {
+        if (i % CPP_EMITTER_BLOCK_SIZE == 0) {
+            if (i != 0) {
+                body << "}\n\n";
+            }
+
+            body << "static void block_" << blocks << "() {\n";
+            blocks++;
+        }
+
+        this->emit_instruction(body, this->instructions[i], depth, max_depth);
+    }
+
+    if (blocks != 0) {
+        body << "}\n";
+    }
+
+    std::stringstream out;
+    out << "// Generated by excellang --emit-cpp\n";
+    out << CPP_RUNTIME << "\n";
+    out << "static const long long CELL_COUNT = " << this->slots.size() << ";\n";
+    out << "static double cells[" << std::max<size_t>(this->slots.size(), 1) << "];\n";
+    out << "static bool written[" << std::max<size_t>(this->slots.size(), 1) << "];\n";
+    out << "static double stack[" << max_depth + 1 << "];\n";
+    out << "static const char* cell_names[" << std::max<size_t>(this->slots.size(), 1) << "] = {";
+    for (auto it = this->slots.begin(); it != this->slots.end(); it++) {
+        out << (it == this->slots.begin() ? "" : ", ") << "\"" << ord_to_column(it->first.first) << it->first.second << "\"";
+    }
+
+    out << "};\n\n";
+    out << body.str() << "\n";
+    out << "int main() {\n";
+    for (long long i = 0; i < blocks; i++) {
+        out << "    block_" << i << "();\n";
+    }
+
+    out << "    for (long long i = 0; i < CELL_COUNT; i++) {\n";
+    out << "        if (written[i]) {\n";
+    out << "            std::printf(\"%s = %.15g\\n\", cell_names[i], cells[i]);\n";
+    out << "        }\n";
+    out << "    }\n\n";
+    out << "    return 0;\n";
+    out << "}\n";
+    return out.str();
+}
+
+void CppEmitter::collect_slots() {
+    this->slots.clear();
+    std::vector<std::pair<std::pair<long long, long long>, std::pair<long long, long long>>> stored;
+    std::vector<std::pair<std::pair<long long, long long>, std::pair<long long, long long>>> loaded;
+    for (const Instruction& instruction : this->instructions) {
+        InstructionType type = generic_type(instruction.instruction_type);
+        if (type == InstructionType::STOC || type == InstructionType::LODC || type == InstructionType::LODR) {
+            long long column = column_to_ord(static_cast<String*>(instruction.arguments[0])->value);
+            long long row = static_cast<Number*>(instruction.arguments[1])->value;
+            this->slots.emplace(std::make_pair(column, row), 0);
+        }
+
+        if (type == InstructionType::STOR || type == InstructionType::LODR) {
+            long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[0])->value);
+            long long row1 = static_cast<Number*>(instruction.arguments[1])->value;
+            long long column2 = column_to_ord(static_cast<String*>(instruction.arguments[2])->value);
+            long long row2 = static_cast<Number*>(instruction.arguments[3])->value;
+            auto rectangle = std::make_pair(std::make_pair(std::min(column1, column2), std::min(row1, row2)), std::make_pair(std::max(column1, column2), std::max(row1, row2)));
+            (type == InstructionType::STOR ? stored : loaded).push_back(rectangle);
+        }
+    }
+
+    // A range read sees the cells range stores write into it, cells written one by one already have
+    // slots and every other cell of the range stays empty
+    for (const auto& load : loaded) {
+        for (const auto& store : stored) {
+            for (long long column = std::max(load.first.first, store.first.first); column <= std::min(load.second.first, store.second.first); column++) {
+                for (long long row = std::max(load.first.second, store.first.second); row <= std::min(load.second.second, store.second.second); row++) {
+                    this->slots.emplace(std::make_pair(column, row), 0);
+                }
+            }
+        }
+    }
+
+    // Slots are numbered in column-major order so the printed cells come out sorted
+    long long index = 0;
+    for (auto& slot : this->slots) {
+        slot.second = index;
+        index++;
+    }
+}
+
+long long CppEmitter::slot(const Instruction& instruction, const long long argument) {
+    long long column = column_to_ord(static_cast<String*>(instruction.arguments[argument])->value);
+    long long row = static_cast<Number*>(instruction.arguments[argument + 1])->value;
+    return this->slots.at(std::make_pair(column, row));
+}
+
+// Slots of the cells of the range starting at argument, in the column by column order the VM visits them
+std::vector<long long> CppEmitter::range_slots(const Instruction& instruction, const long long argument) {
+    long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[argument])->value);
+    long long row1 = static_cast<Number*>(instruction.arguments[argument + 1])->value;
+    long long column2 = column_to_ord(static_cast<String*>(instruction.arguments[argument + 2])->value);
+    long long row2 = static_cast<Number*>(instruction.arguments[argument + 3])->value;
+
+    std::vector<long long> slots;
+    auto it = this->slots.lower_bound(std::make_pair(std::min(column1, column2), std::min(row1, row2)));
+    for (; it != this->slots.end() && it->first.first <= std::max(column1, column2); it++) {
+        if (it->first.second >= std::min(row1, row2) && it->first.second <= std::max(row1, row2)) {
+            slots.push_back(it->second);
+        }
+    }
+
+    return slots;
+}
+
+void CppEmitter::emit_instruction(std::ostream& out, const Instruction& instruction, long long& depth, long long& max_depth) {
+    InstructionType type = generic_type(instruction.instruction_type);
+    switch (type) {
+    case InstructionType::NOP:
+        return;
+    case InstructionType::PUSH:
+        if (instruction.arguments[0]->data_type != DataType::NUMBER) {
+            this->throw_value_not_supported(instruction, instruction.arguments[0]);
+        }
+
+        out << "    stack[" << depth << "] = " << static_cast<Number*>(instruction.arguments[0])->value << ";\n";
+        depth++;
+        break;
+    case InstructionType::POP:
+        if (depth < 1) {
+            this->throw_stack_underflow(instruction);
+        }
+
+        depth--;
+        break;
+    case InstructionType::ADD:
+    case InstructionType::SUB:
+    case InstructionType::MUL:
+    case InstructionType::DIV: {
+        if (depth < 2) {
+            this->throw_stack_underflow(instruction);
+        }
+
+        const char* op = type == InstructionType::ADD ? "+" : type == InstructionType::SUB ? "-" : type == InstructionType::MUL ? "*" : "/";
+        out << "    stack[" << depth - 2 << "] = stack[" << depth - 2 << "] " << op << " stack[" << depth - 1 << "];\n";
+        depth--;
+        break;
+    }
+    case InstructionType::UPLUS:
+        if (depth < 1) {
+            this->throw_stack_underflow(instruction);
+        }
+
+        break;
+    case InstructionType::UMINUS:
+        if (depth < 1) {
+            this->throw_stack_underflow(instruction);
+        }
+
+        out << "    stack[" << depth - 1 << "] = -stack[" << depth - 1 << "];\n";
+        break;
+    case InstructionType::STOC: {
+        if (depth < 1) {
+            this->throw_stack_underflow(instruction);
+        }
+
+        long long slot = this->slot(instruction, 0);
+        out << "    cells[" << slot << "] = stack[" << depth - 1 << "];\n";
+        out << "    written[" << slot << "] = true;\n";
+        depth--;
+        break;
+    }
+    case InstructionType::STOR:
+        if (depth < 1) {
+            this->throw_stack_underflow(instruction);
+        }
+
+        this->emit_range_store(out, instruction, depth - 1);
+        depth--;
+        break;
+    case InstructionType::LODC:
+        out << "    stack[" << depth << "] = cells[" << this->slot(instruction, 0) << "];\n";
+        depth++;
+        break;
+    case InstructionType::LODR:
+        // Everything but an aggregate only sees the top-left corner, like in the VM
+        out << "    stack[" << depth << "] = cells[" << this->slot(instruction, 0) << "];\n";
+        depth++;
+        break;
+    case InstructionType::CALL: {
+        auto builtin = CPP_BUILTINS.find(to_upper(static_cast<String*>(instruction.arguments[0])->value));
+        if (builtin == CPP_BUILTINS.end()) {
+            this->throw_function_not_supported(instruction);
+        }
+
+        long long argument_amount = static_cast<Number*>(instruction.arguments[1])->value;
+        if (depth < argument_amount) {
+            this->throw_stack_underflow(instruction);
+        }
+
+        depth -= argument_amount;
+        this->emit_call(out, instruction, builtin->second, depth, argument_amount);
+        depth++;
+        break;
+    }
+    default:
+        this->throw_instruction_not_supported(instruction);
+    }
+
+    // Whatever an instruction pushes is a plain value, except for the range a LODR pushes
+    bool pushed = type != InstructionType::NOP && type != InstructionType::POP && type != InstructionType::STOC && type != InstructionType::STOR;
+    this->ranges.resize(depth, nullptr);
+    if (pushed) {
+        this->ranges[depth - 1] = type == InstructionType::LODR ? &instruction : nullptr;
+    }
+
+    max_depth = std::max(max_depth, depth);
+}
+
+// Builtins take their arguments as a slice of the operand stack. When an aggregate gets a range, the
+// arguments are gathered into a separate array instead: the other arguments and every written cell of
+// the range, so empty cells are skipped like in the VM.
+void CppEmitter::emit_call(std::ostream& out, const Instruction& instruction, const std::string& function, const long long depth, const long long argument_amount) {
+    bool aggregate = CPP_AGGREGATES.count(to_upper(static_cast<String*>(instruction.arguments[0])->value)) != 0;
+    std::vector<std::vector<long long>> ranges(argument_amount);
+    long long capacity = argument_amount;
+    bool gathered = false;
+    for (long long i = 0; aggregate && i < argument_amount; i++) {
+        if (this->ranges[depth + i] != nullptr) {
+            ranges[i] = this->range_slots(*this->ranges[depth + i], 0);
+            capacity += ranges[i].size();
+            gathered = true;
+        }
+    }
+
+    if (!gathered) {
+        out << "    stack[" << depth << "] = " << function << "(stack + " << depth << ", " << argument_amount << ");\n";
+        return;
+    }
+
+    out << "    {\n";
+    out << "        static double arguments[" << std::max(capacity, 1LL) << "];\n";
+    out << "        long long amount = 0;\n";
+    for (long long i = 0; i < argument_amount; i++) {
+        if (this->ranges[depth + i] == nullptr) {
+            out << "        arguments[amount++] = stack[" << depth + i << "];\n";
+            continue;
+        }
+
+        if (ranges[i].empty()) {
+            continue;
+        }
+
+        out << "        static const long long range_" << i << "[] = {";
+        for (long long j = 0; j < static_cast<long long>(ranges[i].size()); j++) {
+            out << (j == 0 ? "" : ", ") << ranges[i][j];
+        }
+
+        out << "};\n";
+        out << "        for (long long slot : range_" << i << ") {\n";
+        out << "            if (written[slot]) {\n";
+        out << "                arguments[amount++] = cells[slot];\n";
+        out << "            }\n";
+        out << "        }\n";
+    }
+
+    out << "        stack[" << depth << "] = " << function << "(arguments, amount);\n";
+    out << "    }\n";
+}
+
+void CppEmitter::emit_range_store(std::ostream& out, const Instruction& instruction, const long long value) {
+    // Only cells the program reads or writes elsewhere have slots, every other cell of the range is
+    // unobservable and does not need to be stored
+    for (long long slot : this->range_slots(instruction, 0)) {
+        out << "    cells[" << slot << "] = stack[" << value << "];\n";
+        out << "    written[" << slot << "] = true;\n";
+    }
+}
+
+// Errors
+void CppEmitter::throw_value_not_supported(const Instruction& instruction, const RuntimeValue* value) {
+    std::stringstream ss;
+    ss << "Value at " << value->start_column << ":" << value->start_line << " in instruction at " << instruction.start_column << ":" << instruction.start_row << " is not a number, the C++ backend only supports numbers.";
+    throw std::runtime_error(ss.str());
+}
+
+void CppEmitter::throw_function_not_supported(const Instruction& instruction) {
+    std::stringstream ss;
+    ss << "Function '" << static_cast<String*>(instruction.arguments[0])->value << "' at " << instruction.start_column << ":" << instruction.start_row << " is not supported by the C++ backend.";
+    throw std::runtime_error(ss.str());
+}
+
+void CppEmitter::throw_instruction_not_supported(const Instruction& instruction) {
+    std::stringstream ss;
+    ss << "Instruction type " << static_cast<int>(instruction.instruction_type) << " at " << instruction.start_column << ":" << instruction.start_row << " is not supported by the C++ backend.";
+    throw std::runtime_error(ss.str());
+}
+
+void CppEmitter::throw_stack_underflow(const Instruction& instruction) {
+    std::stringstream ss;
+    ss << "Instruction at " << instruction.start_column << ":" << instruction.start_row << " pops more values than the stack holds.";
+    throw std::runtime_error(ss.str());
+}
+
+CppEmitter* create_cpp_emitter(const std::vector<Instruction>& instructions) {
+    return new CppEmitter(instructions);
+}
\ No newline at end of file
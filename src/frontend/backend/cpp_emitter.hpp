@@ -0,0 +1,41 @@
+#include "../interpolation/interpolation.hpp"
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#pragma once
+
+// Instructions per generated function, keeps the emitted functions small enough for the C++ compiler
+const long long CPP_EMITTER_BLOCK_SIZE = 1024;
+
+// Translates an instruction stream into a self-contained C++ translation unit. Every cell the program
+// mentions gets a fixed slot in a double array, the operand stack becomes a fixed array indexed by
+// depths known at emit time, and arithmetic is emitted as plain double operations. Builtins come from a
+// small runtime that is emitted along with the program. Running the result prints every written cell.
+// A range keeps its top-left value on the stack, aggregates read the slots of its cells instead.
+class CppEmitter {
+public:
+    explicit CppEmitter(const std::vector<Instruction>& instructions);
+    std::string emit();
+private:
+    const std::vector<Instruction>& instructions;
+    std::map<std::pair<long long, long long>, long long> slots; // (column, row) -> slot
+    std::vector<const Instruction*> ranges; // The LODR that pushed each stack entry, nullptr for plain values
+
+    void collect_slots();
+    long long slot(const Instruction& instruction, const long long argument);
+    std::vector<long long> range_slots(const Instruction& instruction, const long long argument);
+    void emit_instruction(std::ostream& out, const Instruction& instruction, long long& depth, long long& max_depth);
+    void emit_call(std::ostream& out, const Instruction& instruction, const std::string& function, const long long depth, const long long argument_amount);
+    void emit_range_store(std::ostream& out, const Instruction& instruction, const long long value);
+
+    // Errors
+    void throw_value_not_supported(const Instruction& instruction, const RuntimeValue* value);
+    void throw_function_not_supported(const Instruction& instruction);
+    void throw_instruction_not_supported(const Instruction& instruction);
+    void throw_stack_underflow(const Instruction& instruction);
+};
+
+CppEmitter* create_cpp_emitter(const std::vector<Instruction>& instructions);
\ No newline at end of file
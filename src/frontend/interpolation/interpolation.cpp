@@ -1,193 +1,419 @@
-#include "interpolation.hpp"
-#include <iostream>
-#include <string>
-#include <sstream>
-#include <stdexcept>
-#include "../parser/node_types.hpp"
-#include "../parser/statements.hpp"
-#include "../parser/expressions.hpp"
-
-Number::Number(const long long start_column, const long long start_line, const double value) {
-    this->data_type = DataType::NUMBER;
-    this->value = value;
-
-    this->start_column = start_column;
-    this->start_line = start_line;
-}
-
-String::String(const long long start_column, const long long start_line, const std::string value) {
-    this->data_type = DataType::STRING;
-    this->value = value;
-
-    this->start_column = start_column;
-    this->start_line = start_line;
-}
-
-Interpolator::Interpolator(BlockStatement* ast) {
-    this->ast = ast;
-    this->instructions.clear();
-}
-
-void Interpolator::interpolate() {
-    this->interpolate_block_statement(this->ast);
-}
-
-// Statements
-void Interpolator::interpolate_statement(Statement* statement) {
-    switch (statement->node_type) {
-    case NodeType::BLOCK_STATEMENT:
-        this->interpolate_block_statement(static_cast<BlockStatement*>(statement));
-        break;
-    case NodeType::CELL_ASSIGNMENT_STATEMENT:
-        this->interpolate_cell_assignment_statement(static_cast<CellAssignmentStatement*>(statement));
-        break;
-    case NodeType::RANGE_ASSIGNMENT_STATEMENT:
-        this->interpolate_range_assignment_statement(static_cast<RangeAssignmentStatement*>(statement));
-        break;
-    case NodeType::EXPRESSION_STATEMENT:
-        this->interpolate_expression_statement(static_cast<ExpressionStatement*>(statement));
-        break;
-    default:
-        this->throw_statement_node_type_not_supported(statement);
-    }
-}
-
-void Interpolator::interpolate_block_statement(BlockStatement* block) {
-    for (long long i = 0; i < block->block.size(); i++) {
-        this->interpolate_statement(block->block[i]);
-    }
-}
-
-void Interpolator::interpolate_cell_assignment_statement(CellAssignmentStatement* cell_assignment) {
-    this->interpolate_expression(cell_assignment->value);
-    this->instructions.push_back(Instruction{InstructionType::STOC, cell_assignment->start_column, cell_assignment->start_line, {new String(cell_assignment->assignee->column.column, cell_assignment->assignee->column.line, cell_assignment->assignee->column.value), new Number(cell_assignment->assignee->row.column, cell_assignment->assignee->row.line, std::stoll(cell_assignment->assignee->row.value))}});
-}
-
-void Interpolator::interpolate_range_assignment_statement(RangeAssignmentStatement* range_assignment) {
-    this->interpolate_expression(range_assignment->value);
-    this->instructions.push_back(Instruction{InstructionType::STOR, range_assignment->start_column, range_assignment->start_line, {new String(range_assignment->assignee->lhs->column.column, range_assignment->assignee->lhs->column.line, range_assignment->assignee->lhs->column.value), new Number(range_assignment->assignee->lhs->row.column, range_assignment->assignee->lhs->row.line, std::stoll(range_assignment->assignee->lhs->row.value)), new String(range_assignment->assignee->rhs->column.column, range_assignment->assignee->rhs->column.line, range_assignment->assignee->rhs->column.value), new Number(range_assignment->assignee->rhs->row.column, range_assignment->assignee->rhs->row.line, std::stoll(range_assignment->assignee->rhs->row.value))}});
-}
-
-void Interpolator::interpolate_expression_statement(ExpressionStatement* expression) {
-    this->interpolate_expression(expression->expression);
-}
-
-// Expressions
-void Interpolator::interpolate_expression(Expression* expression) {
-    switch (expression->node_type) {
-    case NodeType::BINARY_EXPRESSION:
-        this->interpolate_binary_expression(static_cast<BinaryExpression*>(expression));
-        break;
-    case NodeType::UNARY_EXPRESSION:
-        this->interpolate_unary_expression(static_cast<UnaryExpression*>(expression));
-        break;
-    case NodeType::CALL_EXPRESSION:
-        this->interpolate_call_expression(static_cast<CallExpression*>(expression));
-        break;
-    case NodeType::NUMBER_EXPRESSION:
-        this->interpolate_number_expression(static_cast<NumberExpression*>(expression));
-        break;
-    case NodeType::NULL_EXPRESSION:
-        this->interpolate_null_expression(static_cast<NullExpression*>(expression));
-        break;
-    case NodeType::CELL_EXPRESSION:
-        this->interpolate_cell_expression(static_cast<CellExpression*>(expression));
-        break;
-    case NodeType::RANGED_EXPRESSION:
-        this->interpolate_ranged_expression(static_cast<RangedExpression*>(expression));
-        break;
-    default:
-        this->throw_expression_node_type_not_supported(expression);
-    }
-}
-
-void Interpolator::interpolate_binary_expression(BinaryExpression* binary) {
-    this->interpolate_expression(binary->lhs);
-    this->interpolate_expression(binary->rhs);
-
-    switch (binary->op.token_type) {
-    case TokenType::PLUS:
-        this->instructions.push_back(Instruction{InstructionType::ADD, binary->start_column, binary->start_line, {}});
-        break;
-    case TokenType::MINUS:
-        this->instructions.push_back(Instruction{InstructionType::SUB, binary->start_column, binary->start_line, {}});
-        break;
-    case TokenType::MULTIPLY:
-        this->instructions.push_back(Instruction{InstructionType::MUL, binary->start_column, binary->start_line, {}});
-        break;
-    case TokenType::DIVIDE:
-        this->instructions.push_back(Instruction{InstructionType::DIV, binary->start_column, binary->start_line, {}});
-        break;
-    default:
-        this->throw_binary_expression_sign_not_supported(binary);
-    }
-}
-
-void Interpolator::interpolate_unary_expression(UnaryExpression* unary) {
-    this->interpolate_expression(unary->value);
-
-    switch (unary->sign.token_type) {
-    case TokenType::PLUS:
-        this->instructions.push_back(Instruction{InstructionType::UPLUS, unary->start_column, unary->start_line, {}});
-        break;
-    case TokenType::MINUS:
-        this->instructions.push_back(Instruction{InstructionType::UMINUS, unary->start_column, unary->start_line, {}});
-        break;
-    default:
-        this->throw_unary_expression_sign_not_supported(unary);
-    }
-}
-
-void Interpolator::interpolate_call_expression(CallExpression* call) {
-    long long argument_amount = call->arguments.size();
-    for (long long i = 0; i < argument_amount; i++) {
-        this->interpolate_expression(call->arguments[i]);
-    }
-
-    this->instructions.push_back(Instruction{InstructionType::CALL, call->start_column, call->start_line, {new String(call->function_name.column, call->function_name.line, call->function_name.value), new Number(0, 0, argument_amount)}});
-}
-
-void Interpolator::interpolate_number_expression(NumberExpression* number) {
-    this->instructions.push_back(Instruction{InstructionType::PUSH, number->start_column, number->start_line, {new Number(number->start_column, number->start_line, number->value)}});
-}
-
-void Interpolator::interpolate_null_expression(NullExpression* null) {
-    this->instructions.push_back(Instruction{InstructionType::PUSH, null->start_column, null->start_line, {new Number(null->start_column, null->start_line, 0)}});
-}
-
-void Interpolator::interpolate_cell_expression(CellExpression* cell) {
-    this->instructions.push_back(Instruction{InstructionType::LODC, cell->start_column, cell->start_line, {new String(cell->column.column, cell->column.line, cell->column.value), new Number(cell->row.column, cell->row.line, std::stoll(cell->row.value))}});
-}
-
-void Interpolator::interpolate_ranged_expression(RangedExpression* ranged) {
-    this->instructions.push_back(Instruction{InstructionType::LODR, ranged->start_column, ranged->start_line, {new String(ranged->lhs->column.column, ranged->lhs->column.line, ranged->lhs->column.value), new Number(ranged->lhs->row.column, ranged->lhs->row.line, std::stoll(ranged->lhs->row.value)), new String(ranged->rhs->column.column, ranged->rhs->column.line, ranged->rhs->column.value), new Number(ranged->rhs->row.column, ranged->rhs->row.line, std::stoll(ranged->rhs->row.value))}});
-}
-
-// Errors
-void Interpolator::throw_statement_node_type_not_supported(Statement* statement) {
-    std::stringstream ss;
-    ss << "Node type " << static_cast<int>(statement->node_type) << " at " << statement->start_column << ":" << statement->start_line << " not supported for statements or it is an expression node.";
-    throw std::runtime_error(ss.str());
-}
-
-void Interpolator::throw_expression_node_type_not_supported(Expression* expression) {
-    std::stringstream ss;
-    ss << "Node type " << static_cast<int>(expression->node_type) << " at " << expression->start_column << ":" << expression->start_line << " not supported for expressions or it is an statement node.";
-    throw std::runtime_error(ss.str());
-}
-
-void Interpolator::throw_binary_expression_sign_not_supported(BinaryExpression* binary) {
-    std::stringstream ss;
-    ss << "Sign '" << binary->op.value << "' at " << binary->op.column << ":" << binary->op.line << " not supported for binary expression.";
-    throw std::runtime_error(ss.str());
-}
-
-void Interpolator::throw_unary_expression_sign_not_supported(UnaryExpression* unary) {
-    std::stringstream ss;
-    ss << "Sign '" << unary->sign.value << "' at " << unary->sign.column << ":" << unary->sign.line << " not supported for unary expression.";
-    throw std::runtime_error(ss.str());
-}
-
-Interpolator* create_interpolator(BlockStatement* ast) {
-    return new Interpolator(ast);
+#include "interpolation.hpp"
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <cctype>
+#include <cstdlib>
+#include "../parser/node_types.hpp"
+#include "../parser/statements.hpp"
+#include "../parser/expressions.hpp"
+
+Number::Number(const long long start_column, const long long start_line, const double value) {
+    this->data_type = DataType::NUMBER;
+    this->value = value;
+
+    this->start_column = start_column;
+    this->start_line = start_line;
+}
+
+String::String(const long long start_column, const long long start_line, const std::string value) {
+    this->data_type = DataType::STRING;
+    this->value = value;
+
+    this->start_column = start_column;
+    this->start_line = start_line;
+}
+
+RuntimeValue* copy_value(const RuntimeValue* value) {
+    if (value->data_type == DataType::NUMBER) {
+        return new Number(value->start_column, value->start_line, static_cast<const Number*>(value)->value);
+    }
+
+    return new String(value->start_column, value->start_line, static_cast<const String*>(value)->value);
+}
+
+Interpolator::Interpolator(BlockStatement* ast) {
+    this->ast = ast;
+    this->instructions.clear();
+}
+
+void Interpolator::interpolate() {
+    this->interpolate_block_statement(this->ast);
+}
+
+void Interpolator::interpolate(Statement* statement) {
+    this->interpolate_statement(statement);
+}
+
+// Statements
+void Interpolator::interpolate_statement(Statement* statement) {
+    switch (statement->node_type) {
+    case NodeType::BLOCK_STATEMENT:
+        this->interpolate_block_statement(static_cast<BlockStatement*>(statement));
+        break;
+    case NodeType::CELL_ASSIGNMENT_STATEMENT:
+        this->interpolate_cell_assignment_statement(static_cast<CellAssignmentStatement*>(statement));
+        break;
+    case NodeType::RANGE_ASSIGNMENT_STATEMENT:
+        this->interpolate_range_assignment_statement(static_cast<RangeAssignmentStatement*>(statement));
+        break;
+    case NodeType::EXPRESSION_STATEMENT:
+        this->interpolate_expression_statement(static_cast<ExpressionStatement*>(statement));
+        break;
+    case NodeType::FLAG_ASSIGNMENT_STATEMENT:
+        this->interpolate_flag_assignment_statement(static_cast<FlagAssignmentStatement*>(statement));
+        break;
+    default:
+        this->throw_statement_node_type_not_supported(statement);
+    }
+}
+
+void Interpolator::interpolate_block_statement(BlockStatement* block) {
+    for (long long i = 0; i < block->block.size(); i++) {
+        this->interpolate_statement(block->block[i]);
+    }
+}
+
+void Interpolator::interpolate_cell_assignment_statement(CellAssignmentStatement* cell_assignment) {
+    this->interpolate_expression(cell_assignment->value);
+    this->instructions.push_back(this->cell_instruction(InstructionType::STOC, InstructionType::STOCS, cell_assignment->start_column, cell_assignment->start_line, cell_assignment->assignee));
+}
+
+void Interpolator::interpolate_range_assignment_statement(RangeAssignmentStatement* range_assignment) {
+    if (this->is_array_expression(range_assignment->value, range_assignment->assignee)) {
+        Instruction store = this->range_instruction(InstructionType::STOA, InstructionType::STOAS, range_assignment->start_column, range_assignment->start_line, range_assignment->assignee);
+        Number* amount = new Number(range_assignment->start_column, range_assignment->start_line, 0);
+        store.arguments.push_back(amount);
+
+        long long operand_amount = 0;
+        this->interpolate_array_expression(range_assignment->value, store, operand_amount);
+        amount->value = operand_amount;
+        this->instructions.push_back(store);
+        return;
+    }
+
+    this->interpolate_expression(range_assignment->value);
+    this->instructions.push_back(this->range_instruction(InstructionType::STOR, InstructionType::STORS, range_assignment->start_column, range_assignment->start_line, range_assignment->assignee));
+}
+
+void Interpolator::interpolate_expression_statement(ExpressionStatement* expression) {
+    this->interpolate_expression(expression->expression);
+}
+
+void Interpolator::interpolate_flag_assignment_statement(FlagAssignmentStatement* flag_assignment) {
+    Instruction instruction = this->flag_instruction(InstructionType::STOF, InstructionType::STFR, flag_assignment->assignee);
+    instruction.arguments.push_back(new Number(flag_assignment->start_column, flag_assignment->start_line, flag_assignment->value ? 1 : 0));
+    this->instructions.push_back(instruction);
+}
+
+// Expressions
+void Interpolator::interpolate_expression(Expression* expression) {
+    switch (expression->node_type) {
+    case NodeType::BINARY_EXPRESSION:
+        this->interpolate_binary_expression(static_cast<BinaryExpression*>(expression));
+        break;
+    case NodeType::UNARY_EXPRESSION:
+        this->interpolate_unary_expression(static_cast<UnaryExpression*>(expression));
+        break;
+    case NodeType::CALL_EXPRESSION:
+        this->interpolate_call_expression(static_cast<CallExpression*>(expression));
+        break;
+    case NodeType::NUMBER_EXPRESSION:
+        this->interpolate_number_expression(static_cast<NumberExpression*>(expression));
+        break;
+    case NodeType::NULL_EXPRESSION:
+        this->interpolate_null_expression(static_cast<NullExpression*>(expression));
+        break;
+    case NodeType::CELL_EXPRESSION:
+        this->interpolate_cell_expression(static_cast<CellExpression*>(expression));
+        break;
+    case NodeType::RANGED_EXPRESSION:
+        this->interpolate_ranged_expression(static_cast<RangedExpression*>(expression));
+        break;
+    case NodeType::FLAG_EXPRESSION:
+        this->interpolate_flag_expression(static_cast<FlagExpression*>(expression));
+        break;
+    default:
+        this->throw_expression_node_type_not_supported(expression);
+    }
+}
+
+void Interpolator::interpolate_binary_expression(BinaryExpression* binary) {
+    this->interpolate_expression(binary->lhs);
+    this->interpolate_expression(binary->rhs);
+
+    switch (binary->op.token_type) {
+    case TokenType::PLUS:
+        this->instructions.push_back(Instruction{InstructionType::ADD, binary->start_column, binary->start_line, {}});
+        break;
+    case TokenType::MINUS:
+        this->instructions.push_back(Instruction{InstructionType::SUB, binary->start_column, binary->start_line, {}});
+        break;
+    case TokenType::MULTIPLY:
+        this->instructions.push_back(Instruction{InstructionType::MUL, binary->start_column, binary->start_line, {}});
+        break;
+    case TokenType::DIVIDE:
+        this->instructions.push_back(Instruction{InstructionType::DIV, binary->start_column, binary->start_line, {}});
+        break;
+    default:
+        this->throw_binary_expression_sign_not_supported(binary);
+    }
+}
+
+void Interpolator::interpolate_unary_expression(UnaryExpression* unary) {
+    this->interpolate_expression(unary->value);
+
+    switch (unary->sign.token_type) {
+    case TokenType::PLUS:
+        this->instructions.push_back(Instruction{InstructionType::UPLUS, unary->start_column, unary->start_line, {}});
+        break;
+    case TokenType::MINUS:
+        this->instructions.push_back(Instruction{InstructionType::UMINUS, unary->start_column, unary->start_line, {}});
+        break;
+    default:
+        this->throw_unary_expression_sign_not_supported(unary);
+    }
+}
+
+void Interpolator::interpolate_call_expression(CallExpression* call) {
+    long long argument_amount = call->arguments.size();
+    for (long long i = 0; i < argument_amount; i++) {
+        this->interpolate_expression(call->arguments[i]);
+    }
+
+    this->instructions.push_back(Instruction{InstructionType::CALL, call->start_column, call->start_line, {new String(call->function_name.column, call->function_name.line, call->function_name.value), new Number(0, 0, argument_amount)}});
+}
+
+void Interpolator::interpolate_number_expression(NumberExpression* number) {
+    this->instructions.push_back(Instruction{InstructionType::PUSH, number->start_column, number->start_line, {new Number(number->start_column, number->start_line, number->value)}});
+}
+
+void Interpolator::interpolate_null_expression(NullExpression* null) {
+    this->instructions.push_back(Instruction{InstructionType::PUSH, null->start_column, null->start_line, {new Number(null->start_column, null->start_line, 0)}});
+}
+
+void Interpolator::interpolate_cell_expression(CellExpression* cell) {
+    this->instructions.push_back(this->cell_instruction(InstructionType::LODC, InstructionType::LODCS, cell->start_column, cell->start_line, cell));
+}
+
+void Interpolator::interpolate_ranged_expression(RangedExpression* ranged) {
+    this->instructions.push_back(this->range_instruction(InstructionType::LODR, InstructionType::LODRS, ranged->start_column, ranged->start_line, ranged));
+}
+
+void Interpolator::interpolate_flag_expression(FlagExpression* flag) {
+    this->instructions.push_back(this->flag_instruction(InstructionType::LODF, InstructionType::CNTF, flag));
+}
+
+static long long range_columns(RangedExpression* ranged) {
+    return std::abs(column_to_ord(ranged->lhs->column.value) - column_to_ord(ranged->rhs->column.value)) + 1;
+}
+
+static long long range_rows(RangedExpression* ranged) {
+    return std::abs(std::stoll(ranged->lhs->row.value) - std::stoll(ranged->rhs->row.value)) + 1;
+}
+
+// Calls take their ranges as a whole, so only ranges reached through arithmetic count
+bool Interpolator::is_array_expression(Expression* expression, RangedExpression* target) {
+    switch (expression->node_type) {
+    case NodeType::BINARY_EXPRESSION: {
+        BinaryExpression* binary = static_cast<BinaryExpression*>(expression);
+        bool lhs = this->is_array_expression(binary->lhs, target);
+        bool rhs = this->is_array_expression(binary->rhs, target);
+        return lhs || rhs;
+    }
+    case NodeType::UNARY_EXPRESSION:
+        return this->is_array_expression(static_cast<UnaryExpression*>(expression)->value, target);
+    case NodeType::RANGED_EXPRESSION: {
+        // A single cell is broadcast like any other scalar
+        RangedExpression* ranged = static_cast<RangedExpression*>(expression);
+        long long columns = range_columns(ranged);
+        long long rows = range_rows(ranged);
+        if (target != nullptr && (columns != 1 || rows != 1) && (columns != range_columns(target) || rows != range_rows(target))) {
+            this->throw_array_shape_mismatch(ranged, target);
+        }
+
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Operands are computed the usual way and left on the stack for the STOA, the arithmetic between them
+// becomes its steps
+void Interpolator::interpolate_array_expression(Expression* expression, Instruction& store, long long& operand_amount) {
+    ArrayStep step = ArrayStep::OPERAND;
+    if (expression->node_type == NodeType::BINARY_EXPRESSION && this->is_array_expression(expression, nullptr)) {
+        BinaryExpression* binary = static_cast<BinaryExpression*>(expression);
+        this->interpolate_array_expression(binary->lhs, store, operand_amount);
+        this->interpolate_array_expression(binary->rhs, store, operand_amount);
+        switch (binary->op.token_type) {
+        case TokenType::PLUS:
+            step = ArrayStep::ADD;
+            break;
+        case TokenType::MINUS:
+            step = ArrayStep::SUB;
+            break;
+        case TokenType::MULTIPLY:
+            step = ArrayStep::MUL;
+            break;
+        case TokenType::DIVIDE:
+            step = ArrayStep::DIV;
+            break;
+        default:
+            this->throw_binary_expression_sign_not_supported(binary);
+        }
+    } else if (expression->node_type == NodeType::UNARY_EXPRESSION && this->is_array_expression(expression, nullptr)) {
+        UnaryExpression* unary = static_cast<UnaryExpression*>(expression);
+        this->interpolate_array_expression(unary->value, store, operand_amount);
+        switch (unary->sign.token_type) {
+        case TokenType::PLUS:
+            step = ArrayStep::UPLUS;
+            break;
+        case TokenType::MINUS:
+            step = ArrayStep::UMINUS;
+            break;
+        default:
+            this->throw_unary_expression_sign_not_supported(unary);
+        }
+    } else {
+        this->interpolate_expression(expression);
+        operand_amount++;
+    }
+
+    store.arguments.push_back(new Number(expression->start_column, expression->start_line, static_cast<long long>(step)));
+}
+
+// Cells and ranges of another sheet use the *S variant of the instruction with the sheet name in front
+Instruction Interpolator::cell_instruction(const InstructionType local, const InstructionType qualified, const long long start_column, const long long start_line, CellExpression* cell) {
+    std::vector<RuntimeValue*> arguments = {new String(cell->column.column, cell->column.line, cell->column.value), new Number(cell->row.column, cell->row.line, std::stoll(cell->row.value))};
+    if (cell->sheet.empty()) {
+        return Instruction{local, start_column, start_line, arguments};
+    }
+
+    arguments.insert(arguments.begin(), new String(cell->start_column, cell->start_line, cell->sheet));
+    return Instruction{qualified, start_column, start_line, arguments};
+}
+
+Instruction Interpolator::range_instruction(const InstructionType local, const InstructionType qualified, const long long start_column, const long long start_line, RangedExpression* ranged) {
+    std::vector<RuntimeValue*> arguments = {new String(ranged->lhs->column.column, ranged->lhs->column.line, ranged->lhs->column.value), new Number(ranged->lhs->row.column, ranged->lhs->row.line, std::stoll(ranged->lhs->row.value)), new String(ranged->rhs->column.column, ranged->rhs->column.line, ranged->rhs->column.value), new Number(ranged->rhs->row.column, ranged->rhs->row.line, std::stoll(ranged->rhs->row.value))};
+    if (ranged->sheet.empty()) {
+        return Instruction{local, start_column, start_line, arguments};
+    }
+
+    arguments.insert(arguments.begin(), new String(ranged->start_column, ranged->start_line, ranged->sheet));
+    return Instruction{qualified, start_column, start_line, arguments};
+}
+
+// Flag instructions start with the flag number followed by the cell or the corners of the range
+Instruction Interpolator::flag_instruction(const InstructionType cell, const InstructionType range, FlagExpression* flag) {
+    Instruction instruction;
+    if (flag->target->node_type == NodeType::CELL_EXPRESSION) {
+        CellExpression* target = static_cast<CellExpression*>(flag->target);
+        if (!target->sheet.empty()) {
+            this->throw_flag_of_other_sheet(flag);
+        }
+
+        instruction = this->cell_instruction(cell, cell, flag->start_column, flag->start_line, target);
+    } else {
+        RangedExpression* target = static_cast<RangedExpression*>(flag->target);
+        if (!target->sheet.empty()) {
+            this->throw_flag_of_other_sheet(flag);
+        }
+
+        instruction = this->range_instruction(range, range, flag->start_column, flag->start_line, target);
+    }
+
+    instruction.arguments.insert(instruction.arguments.begin(), new Number(flag->name.column, flag->name.line, flag->flag));
+    return instruction;
+}
+
+// Errors
+void Interpolator::throw_statement_node_type_not_supported(Statement* statement) {
+    std::stringstream ss;
+    ss << "Node type " << static_cast<int>(statement->node_type) << " at " << statement->start_column << ":" << statement->start_line << " not supported for statements or it is an expression node.";
+    throw std::runtime_error(ss.str());
+}
+
+void Interpolator::throw_expression_node_type_not_supported(Expression* expression) {
+    std::stringstream ss;
+    ss << "Node type " << static_cast<int>(expression->node_type) << " at " << expression->start_column << ":" << expression->start_line << " not supported for expressions or it is an statement node.";
+    throw std::runtime_error(ss.str());
+}
+
+void Interpolator::throw_binary_expression_sign_not_supported(BinaryExpression* binary) {
+    std::stringstream ss;
+    ss << "Sign '" << binary->op.value << "' at " << binary->op.column << ":" << binary->op.line << " not supported for binary expression.";
+    throw std::runtime_error(ss.str());
+}
+
+void Interpolator::throw_unary_expression_sign_not_supported(UnaryExpression* unary) {
+    std::stringstream ss;
+    ss << "Sign '" << unary->sign.value << "' at " << unary->sign.column << ":" << unary->sign.line << " not supported for unary expression.";
+    throw std::runtime_error(ss.str());
+}
+
+void Interpolator::throw_flag_of_other_sheet(FlagExpression* flag) {
+    std::stringstream ss;
+    ss << "Flag '" << flag->name.value << "' at " << flag->start_column << ":" << flag->start_line << " can only be used on cells of the sheet the program runs on.";
+    throw std::runtime_error(ss.str());
+}
+
+void Interpolator::throw_array_shape_mismatch(RangedExpression* operand, RangedExpression* target) {
+    std::stringstream ss;
+    ss << "Range at " << operand->start_column << ":" << operand->start_line << " is " << range_columns(operand) << "x" << range_rows(operand) << " cells but the range at " << target->start_column << ":" << target->start_line << " it is assigned to is " << range_columns(target) << "x" << range_rows(target) << ", array formulas need ranges of the same shape or single cells.";
+    throw std::runtime_error(ss.str());
+}
+
+Interpolator* create_interpolator(BlockStatement* ast) {
+    return new Interpolator(ast);
+}
+
+long long column_to_ord(const std::string& column) {
+    long long ord = 0;
+    for (char character : column) {
+        ord *= 26;
+        ord += std::tolower(character) - 'a' + 1;
+    }
+
+    return ord;
+}
+
+std::string ord_to_column(long long ord) {
+    std::string column = "";
+    while (ord > 0) {
+        ord--;
+        column.insert(column.begin(), static_cast<char>('A' + ord % 26));
+        ord /= 26;
+    }
+
+    return column;
+}
+
+InstructionType generic_type(const InstructionType type) {
+    switch (type) {
+    case InstructionType::ADD_NN:
+        return InstructionType::ADD;
+    case InstructionType::SUB_NN:
+        return InstructionType::SUB;
+    case InstructionType::MUL_NN:
+        return InstructionType::MUL;
+    case InstructionType::DIV_NN:
+        return InstructionType::DIV;
+    case InstructionType::LODC_N:
+        return InstructionType::LODC;
+    default:
+        return type;
+    }
+}
+
+void free_instructions(std::vector<Instruction>& instructions) {
+    for (Instruction& instruction : instructions) {
+        for (RuntimeValue* argument : instruction.arguments) {
+            delete argument;
+        }
+    }
+
+    instructions.clear();
 }
\ No newline at end of file
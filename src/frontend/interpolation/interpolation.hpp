@@ -1,88 +1,142 @@
-#include <vector>
-#include <string>
-#include "../parser/statements.hpp"
-
-#pragma once
-
-enum class DataType {
-    NUMBER,
-    STRING
-};
-
-class RuntimeValue {
-public:
-    DataType data_type;
-    long long start_column;
-    long long start_line;
-};
-
-class Number : public RuntimeValue {
-public:
-    Number(const long long start_column, const long long start_line, const double value);
-    double value;
-};
-
-class String : public RuntimeValue {
-public:
-    String(const long long start_column, const long long start_line, std::string value);
-    std::string value;
-};
-
-enum class InstructionType {
-    NOP, // Format: NOP. This is a placeholder
-    PUSH, // Format: PUSH value (value = expr). Pushes the value to the stack.
-    POP, // Format: POP. Pops the value from the stack.
-    ADD, // Format: ADD. Pops the 2 top values from the stack and pushes the added result.
-    SUB, // Format: SUB. Pops the 2 top values from the stack and pushes the subtracted result.
-    MUL, // Format: MUL. Pops the 2 top values from the stack and pushes the multiplied result.
-    DIV, // Format: DIV. Pops the 2 top values from the stack and pushes the divided result.
-    UPLUS, // Format: UPLUS. Pops the top value and pushes the unary plus result on the popped value.
-    UMINUS, // Format: UMINUS. Pops the top value and pushes the unary minus result on the popped value.
-    STOC, // Format: STOC column row (column = string, row = number). Pops the top value and store it to the f"{column}{row}" cell.
-    LODC, // Format: LODC column row (column = string, row = number). Pushes the value of cell f"{column}{row}" to the stack.
-    STOR, // Format: STOR column1 row1 column2 row2 (column1, column2 = string, row1, row2 = number). Pops the top value and store it to the f"{column1}{row1}:{column2}{row2}" range.
-    LODR, // Format: LODR column1 row1 column2 row2 (column1, column2 = string, row1, row2 = number). Returns the top-left corner value and pushes it to the stack.
-    CALL // Format: CALL function argument_amount (function = string, argument_amount = number). Pops the corresponding argument_amount arguments and pass them correspondingly to function(). This also pushes the returned value to the stack.
-};
-
-struct Instruction {
-    InstructionType instruction_type;
-    long long start_column;
-    long long start_row;
-    std::vector<RuntimeValue*> arguments;
-};
-
-class Interpolator {
-public:
-    Interpolator(BlockStatement* ast);
-    void interpolate();
-    std::vector<Instruction> instructions;
-private:
-    BlockStatement* ast;
-
-    void interpolate_statement(Statement* statement);
-    void interpolate_expression(Expression* expression);
-
-    // Statements
-    void interpolate_block_statement(BlockStatement* block);
-    void interpolate_cell_assignment_statement(CellAssignmentStatement* cell_assignment);
-    void interpolate_range_assignment_statement(RangeAssignmentStatement* range_assignment);
-    void interpolate_expression_statement(ExpressionStatement* expression);
-
-    // Expressions
-    void interpolate_binary_expression(BinaryExpression* binary);
-    void interpolate_unary_expression(UnaryExpression* unary);
-    void interpolate_call_expression(CallExpression* call);
-    void interpolate_number_expression(NumberExpression* number);
-    void interpolate_null_expression(NullExpression* null);
-    void interpolate_cell_expression(CellExpression* cell);
-    void interpolate_ranged_expression(RangedExpression* range);
-
-    // Errors
-    void throw_statement_node_type_not_supported(Statement* statement);
-    void throw_expression_node_type_not_supported(Expression* expression);
-    void throw_binary_expression_sign_not_supported(BinaryExpression* binary);
-    void throw_unary_expression_sign_not_supported(UnaryExpression* unary);
-};
-
-Interpolator* create_interpolator(BlockStatement* ast);
\ No newline at end of file
+#include <vector>
+#include <string>
+#include "../parser/statements.hpp"
+
+#pragma once
+
+enum class DataType {
+    NUMBER,
+    STRING,
+    RANGE // Only ever on the VM stack, see Range
+};
+
+class RuntimeValue {
+public:
+    virtual ~RuntimeValue() = default;
+    DataType data_type;
+    long long start_column;
+    long long start_line;
+};
+
+class Number : public RuntimeValue {
+public:
+    Number(const long long start_column, const long long start_line, const double value);
+    double value;
+};
+
+class String : public RuntimeValue {
+public:
+    String(const long long start_column, const long long start_line, std::string value);
+    std::string value;
+};
+
+RuntimeValue* copy_value(const RuntimeValue* value); // Numbers and strings only
+
+enum class InstructionType {
+    NOP, // Format: NOP. This is a placeholder
+    PUSH, // Format: PUSH value (value = expr). Pushes the value to the stack.
+    POP, // Format: POP. Pops the value from the stack.
+    ADD, // Format: ADD. Pops the 2 top values from the stack and pushes the added result.
+    SUB, // Format: SUB. Pops the 2 top values from the stack and pushes the subtracted result.
+    MUL, // Format: MUL. Pops the 2 top values from the stack and pushes the multiplied result.
+    DIV, // Format: DIV. Pops the 2 top values from the stack and pushes the divided result.
+    UPLUS, // Format: UPLUS. Pops the top value and pushes the unary plus result on the popped value.
+    UMINUS, // Format: UMINUS. Pops the top value and pushes the unary minus result on the popped value.
+    STOC, // Format: STOC column row (column = string, row = number). Pops the top value and store it to the f"{column}{row}" cell.
+    LODC, // Format: LODC column row (column = string, row = number). Pushes the value of cell f"{column}{row}" to the stack.
+    STOR, // Format: STOR column1 row1 column2 row2 (column1, column2 = string, row1, row2 = number). Pops the top value and store it to the f"{column1}{row1}:{column2}{row2}" range.
+    LODR, // Format: LODR column1 row1 column2 row2 (column1, column2 = string, row1, row2 = number). Pushes a reference to the range. Builtins read every cell of it, anything else only gets the top-left corner.
+    CALL, // Format: CALL function argument_amount (function = string, argument_amount = number). Pops the corresponding argument_amount arguments and pass them correspondingly to function(). This also pushes the returned value to the stack.
+    STOCS, // Format: STOCS sheet column row (sheet, column = string, row = number). Same as STOC but on the cell of another sheet of the workbook.
+    LODCS, // Format: LODCS sheet column row (sheet, column = string, row = number). Same as LODC but on the cell of another sheet of the workbook.
+    STORS, // Format: STORS sheet column1 row1 column2 row2 (sheet, column1, column2 = string, row1, row2 = number). Same as STOR but on a range of another sheet of the workbook.
+    LODRS, // Format: LODRS sheet column1 row1 column2 row2 (sheet, column1, column2 = string, row1, row2 = number). Same as LODR but on a range of another sheet of the workbook.
+    STOF, // Format: STOF flag column row value (column = string, flag, row, value = number). Sets (value = 1) or clears (value = 0) the flag of cell f"{column}{row}", see flag_index for flag numbers.
+    STFR, // Format: STFR flag column1 row1 column2 row2 value (column1, column2 = string, flag, row1, row2, value = number). Same as STOF but on every cell of the f"{column1}{row1}:{column2}{row2}" range.
+    LODF, // Format: LODF flag column row (column = string, flag, row = number). Pushes 1 if cell f"{column}{row}" has the flag set, otherwise 0.
+    CNTF, // Format: CNTF flag column1 row1 column2 row2 (column1, column2 = string, flag, row1, row2 = number). Pushes the number of cells of the f"{column1}{row1}:{column2}{row2}" range that have the flag set.
+    ADD_NN, // Format: ADD_NN. Same as ADD where both operands are known to be numbers, see specialize_numbers.
+    SUB_NN, // Format: SUB_NN. Same as SUB where both operands are known to be numbers.
+    MUL_NN, // Format: MUL_NN. Same as MUL where both operands are known to be numbers.
+    DIV_NN, // Format: DIV_NN. Same as DIV where both operands are known to be numbers.
+    LODC_N, // Format: LODC_N column row (column = string, row = number). Same as LODC on a cell the program only writes numbers to. If the cell holds something else anyway, the rest of the statement runs unspecialized.
+    STOA, // Format: STOA column1 row1 column2 row2 operand_amount step... (column1, column2 = string, row1, row2, operand_amount, step = number). Array formula: pops operand_amount values (ranges shaped like the f"{column1}{row1}:{column2}{row2}" range, or scalars that are broadcast) and stores the element-wise result of the steps (postfix, see ArrayStep) to the range.
+    STOAS // Format: STOAS sheet column1 row1 column2 row2 operand_amount step... (sheet, column1, column2 = string, row1, row2, operand_amount, step = number). Same as STOA but on a range of another sheet of the workbook.
+};
+
+// The element-wise program of a STOA. OPERAND stands for the next of the popped values, bottom-most first
+enum class ArrayStep {
+    OPERAND,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    UPLUS,
+    UMINUS
+};
+
+struct Instruction {
+    InstructionType instruction_type;
+    long long start_column;
+    long long start_row;
+    std::vector<RuntimeValue*> arguments;
+};
+
+class Interpolator {
+public:
+    Interpolator(BlockStatement* ast);
+    void interpolate();
+    void interpolate(Statement* statement); // Appends the instructions of a single (top-level) statement
+    std::vector<Instruction> instructions;
+private:
+    BlockStatement* ast;
+
+    void interpolate_statement(Statement* statement);
+    void interpolate_expression(Expression* expression);
+
+    // Statements
+    void interpolate_block_statement(BlockStatement* block);
+    void interpolate_cell_assignment_statement(CellAssignmentStatement* cell_assignment);
+    void interpolate_range_assignment_statement(RangeAssignmentStatement* range_assignment);
+    void interpolate_expression_statement(ExpressionStatement* expression);
+    void interpolate_flag_assignment_statement(FlagAssignmentStatement* flag_assignment);
+
+    // Expressions
+    void interpolate_binary_expression(BinaryExpression* binary);
+    void interpolate_unary_expression(UnaryExpression* unary);
+    void interpolate_call_expression(CallExpression* call);
+    void interpolate_number_expression(NumberExpression* number);
+    void interpolate_null_expression(NullExpression* null);
+    void interpolate_cell_expression(CellExpression* cell);
+    void interpolate_ranged_expression(RangedExpression* range);
+    void interpolate_flag_expression(FlagExpression* flag);
+
+    // Array formulas: a range assignment whose value computes with ranges stores element-wise, see STOA
+    bool is_array_expression(Expression* expression, RangedExpression* target); // Also checks the shape of every range against the target, if there is one
+    void interpolate_array_expression(Expression* expression, Instruction& store, long long& operand_amount);
+
+    // Helpers
+    Instruction cell_instruction(const InstructionType local, const InstructionType qualified, const long long start_column, const long long start_line, CellExpression* cell);
+    Instruction range_instruction(const InstructionType local, const InstructionType qualified, const long long start_column, const long long start_line, RangedExpression* ranged);
+    Instruction flag_instruction(const InstructionType cell, const InstructionType range, FlagExpression* flag);
+
+    // Errors
+    void throw_statement_node_type_not_supported(Statement* statement);
+    void throw_expression_node_type_not_supported(Expression* expression);
+    void throw_binary_expression_sign_not_supported(BinaryExpression* binary);
+    void throw_unary_expression_sign_not_supported(UnaryExpression* unary);
+    void throw_flag_of_other_sheet(FlagExpression* flag);
+    void throw_array_shape_mismatch(RangedExpression* operand, RangedExpression* target);
+};
+
+Interpolator* create_interpolator(BlockStatement* ast);
+
+// Column names are case-insensitive and numbered like spreadsheet columns: A = 1, Z = 26, AA = 27
+long long column_to_ord(const std::string& column);
+std::string ord_to_column(long long ord);
+
+// The instruction a specialized one (ADD_NN, LODC_N, ...) stands for, other types are returned as they are
+InstructionType generic_type(const InstructionType type);
+
+// Deletes the arguments owned by the instructions and empties the list
+void free_instructions(std::vector<Instruction>& instructions);
\ No newline at end of file
@@ -1,54 +1,67 @@
-#include <string>
-#include <vector>
-#include <unordered_map>
-
-#pragma once
-
-enum class TokenType {
-  END_OF_FILE,
-  NEWLINE,
-  SEMICOLON,
-  PLUS,
-  MINUS,
-  MULTIPLY,
-  DIVIDE,
-  LEFT_PARENTHESES,
-  RIGHT_PARENTHESES,
-  EQUALS,
-  COLON,
-  COMMA,
-  NUMBER,
-  IDENTIFIER
-};
-
-std::unordered_map<TokenType, std::string> type_to_str();
-
-struct Token {
-  TokenType token_type;
-  std::string value;
-  long long line;
-  long long column;
-};
-
-class Lexer {
-public:
-  explicit Lexer(const std::string &source);
-
-  std::vector<Token> tokenize();
-
-private:
-  const std::string &source_;
-  size_t position_;
-  long long line_;
-  long long col_;
-
-  Token create_token(TokenType token_type, const std::string &value) const;
-  void advance();
-  void skip_whitespace();
-  Token tokenize_number();
-  Token tokenize_identifier();
-  void throw_invalid_character_error(char invalid_char) const;
-};
-
-// Factory function
-Lexer* create_lexer(const std::string &source);
\ No newline at end of file
+#include <string>
+#include <vector>
+#include <istream>
+#include <unordered_map>
+
+#pragma once
+
+enum class TokenType {
+  END_OF_FILE,
+  NEWLINE,
+  SEMICOLON,
+  PLUS,
+  MINUS,
+  MULTIPLY,
+  DIVIDE,
+  LEFT_PARENTHESES,
+  RIGHT_PARENTHESES,
+  EQUALS,
+  COLON,
+  COMMA,
+  EXCLAMATION_MARK,
+  NUMBER,
+  IDENTIFIER,
+  INVALID // Something that is not a token, the value is the error message
+};
+
+std::unordered_map<TokenType, std::string> type_to_str();
+
+struct Token {
+  TokenType token_type;
+  std::string value;
+  long long line;
+  long long column;
+};
+
+class Lexer {
+public:
+  explicit Lexer(const std::string &source);
+  explicit Lexer(std::istream &stream); // Streaming mode: characters are pulled from the stream on demand
+  Lexer(const std::string &source, size_t begin, size_t end, long long line); // Lexes source[begin, end) which starts on the given line
+
+  std::vector<Token> tokenize();
+  Token next_token(); // Keeps returning END_OF_FILE once the source is exhausted
+
+private:
+  const std::string &source_;
+  std::istream *stream_;
+  size_t position_;
+  size_t end_;
+  long long line_;
+  long long col_;
+
+  Token create_token(TokenType token_type, const std::string &value) const;
+  bool at_end() const;
+  char peek() const;
+  void advance();
+  void skip_whitespace();
+  Token tokenize_number();
+  Token tokenize_identifier();
+
+  // Errors do not stop the lexer, they become INVALID tokens the parser reports
+  Token invalid_character_token(char invalid_char);
+};
+
+// Factory functions
+Lexer* create_lexer(const std::string &source);
+Lexer* create_lexer(std::istream &stream);
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "token_stream.hpp"
+#include "lexer.hpp"
+#include <vector>
+#include <utility>
+#include <sstream>
+#include <stdexcept>
+
+TokenStream::TokenStream(std::vector<Token> tokens) {
+    this->tokens = std::move(tokens);
+    this->lexer = nullptr;
+    this->pulled = this->tokens.size();
+}
+
+TokenStream::TokenStream(Lexer* lexer) {
+    this->tokens.resize(TOKEN_RING_SIZE);
+    this->lexer = lexer;
+    this->pulled = 0;
+}
+
+const Token& TokenStream::at(const long long position) {
+    if (this->lexer == nullptr) {
+        // The token list always ends with END_OF_FILE, reading past it keeps returning it
+        if (position >= this->pulled) {
+            return this->tokens.back();
+        }
+
+        return this->tokens[position];
+    }
+
+    if (position < this->pulled - TOKEN_RING_SIZE) {
+        std::stringstream ss;
+        ss << "Token " << position << " was already dropped from the token ring buffer";
+        throw std::runtime_error(ss.str());
+    }
+
+    while (this->pulled <= position) {
+        this->tokens[this->pulled % TOKEN_RING_SIZE] = this->lexer->next_token();
+        this->pulled++;
+    }
+
+    return this->tokens[position % TOKEN_RING_SIZE];
+}
\ No newline at end of file
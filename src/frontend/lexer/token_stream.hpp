@@ -0,0 +1,20 @@
+#include "lexer.hpp"
+#include <vector>
+
+#pragma once
+
+// Number of tokens kept around when pulling from a lexer. The parser looks at most one token behind
+// and one token ahead of its position, so a handful of slots is plenty.
+const long long TOKEN_RING_SIZE = 8;
+
+class TokenStream {
+public:
+    explicit TokenStream(std::vector<Token> tokens); // Buffered mode: the whole token list is owned by the stream
+    explicit TokenStream(Lexer* lexer); // Streaming mode: tokens are pulled from the lexer into a ring buffer
+
+    const Token& at(const long long position);
+private:
+    std::vector<Token> tokens;
+    Lexer* lexer;
+    long long pulled;
+};
\ No newline at end of file
@@ -1,171 +1,759 @@
-#include "lexer/lexer.hpp"
-#include "parser/parser.hpp"
-#include "parser/statements.hpp"
-#include "parser/node_types.hpp"
-#include "interpolation/interpolation.hpp"
-#include <iostream>
-#include <vector>
-#include <string>
-#include <iomanip>
-
-void print_expr(Expression* expr) {
-    switch (expr->node_type) {
-    case NodeType::BINARY_EXPRESSION: {
-        BinaryExpression* binary = static_cast<BinaryExpression*>(expr);
-        std::cout << "(";
-        print_expr(binary->lhs);
-        std::cout << " " << binary->op.value << " ";
-        print_expr(binary->rhs);
-        std::cout << ")";
-        break;
-    }
-    case NodeType::UNARY_EXPRESSION: {
-        UnaryExpression* unary = static_cast<UnaryExpression*>(expr);
-        std::cout << unary->sign.value;
-        print_expr(unary->value);
-        break;
-    }
-    case NodeType::CALL_EXPRESSION: {
-        CallExpression* call = static_cast<CallExpression*>(expr);
-        std::cout << call->function_name.value << "(";
-
-        long long arguments_size = call->arguments.size();
-        for (long long i = 0; i < arguments_size; i++) {
-            print_expr(call->arguments[i]);
-            if (i < arguments_size-1) {
-                std::cout << ", ";
-            }
-        }
-
-        std::cout << ")";
-        break;
-    }
-    case NodeType::NUMBER_EXPRESSION:
-        std::cout << static_cast<NumberExpression*>(expr)->value;
-        break;
-    case NodeType::NULL_EXPRESSION:
-        std::cout << "NULL";
-        break;
-    case NodeType::CELL_EXPRESSION: {
-        CellExpression* cell = static_cast<CellExpression*>(expr);
-        std::cout << cell->column.value << cell->row.value;
-        break;
-    }
-    case NodeType::RANGED_EXPRESSION: {
-        RangedExpression* ranged = static_cast<RangedExpression*>(expr);
-        print_expr(ranged->lhs);
-        std::cout << ":";
-        print_expr(ranged->rhs);
-        break;
-    }
-    }
-}
-
-void print_stmt(const long long indentation, Statement* stmt) {
-    for (long long i = 0; i < indentation; i++) {
-        std::cout << "  ";
-    }
-
-    switch (stmt->node_type) {
-    case NodeType::BLOCK_STATEMENT: {
-        BlockStatement* block = static_cast<BlockStatement*>(stmt);
-        std::cout << "(BLOCK STATEMENT length=" << block->block.size() << ", depth=" << indentation <<")\n";
-        for (long long i = 0; i < block->block.size(); i++) {
-            print_stmt(indentation+1, block->block[i]);
-        }
-
-        break;
-    }
-    case NodeType::EXPRESSION_STATEMENT:
-        print_expr(static_cast<ExpressionStatement*>(stmt)->expression);
-        break;
-    }
-}
-
-void debug_instructions(Interpolator* interpolator) {
-    for (long long i = 0; i < interpolator->instructions.size(); i++) {
-        switch (interpolator->instructions[i].instruction_type) {
-        case InstructionType::NOP:
-            std::cout << "NOP";
-            break;
-        case InstructionType::PUSH:
-            std::cout << "PUSH";
-            break;
-        case InstructionType::POP:
-            std::cout << "POP";
-            break;
-        case InstructionType::ADD:
-            std::cout << "ADD";
-            break;
-        case InstructionType::SUB:
-            std::cout << "SUB";
-            break;
-        case InstructionType::MUL:
-            std::cout << "MUL";
-            break;
-        case InstructionType::DIV:
-            std::cout << "DIV";
-            break;
-        case InstructionType::UPLUS:
-            std::cout << "UPLUS";
-            break;
-        case InstructionType::UMINUS:
-            std::cout << "UMINUS";
-            break;
-        case InstructionType::STOC:
-            std::cout << "STOC";
-            break;
-        case InstructionType::STOR:
-            std::cout << "STOR";
-            break;
-        case InstructionType::LODC:
-            std::cout << "LODC";
-            break;
-        case InstructionType::LODR:
-            std::cout << "LODR";
-            break;
-        case InstructionType::CALL:
-            std::cout << "CALL";
-            break;
-        }
-
-        std::cout << " " << interpolator->instructions[i].start_column << ":" << interpolator->instructions[i].start_row;
-        for (long long j = 0; j < interpolator->instructions[i].arguments.size(); j++) {
-            std::cout << " " << interpolator->instructions[i].arguments[j]->start_column << " " << interpolator->instructions[i].arguments[j]->start_line << " ";
-            if (interpolator->instructions[i].arguments[j]->data_type == DataType::NUMBER) {
-                std::cout << static_cast<Number*>(interpolator->instructions[i].arguments[j])->value;
-            } else {
-                std::cout << std::quoted(static_cast<String*>(interpolator->instructions[i].arguments[j])->value);
-            }
-        }
-
-        std::cout << "\n";
-    }
-}
-
-int main(std::string vm_src) {
-    std::string code = "EXCELLANG(A1, A2, ,,,,, 69)";
-    Lexer* lexer = create_lexer(code);
-    std::vector<Token> tokens = lexer->tokenize();
-
-    std::cout << "lexer:\n";
-    for (long long i = 0; i < tokens.size(); i++) {
-        std::cout << tokens[i].column << ":" << tokens[i].line << " " << static_cast<int>(tokens[i].token_type) << " " << tokens[i].value << "\n";
-    }
-
-    std::cout << "\n";
-
-    Parser* parser = create_parser(tokens);
-    BlockStatement* block = parser->parse();
-
-    std::cout << "parser:\n";
-    print_stmt(0, block);
-    std::cout << "\n\n";
-
-    Interpolator* interpolator = create_interpolator(block);
-    interpolator->interpolate();
-
-    std::cout << "VM:\n";
-    debug_instructions(interpolator);
-    return 0;
+#include "lexer/lexer.hpp"
+#include "parser/parser.hpp"
+#include "parser/statements.hpp"
+#include "parser/node_types.hpp"
+#include "interpolation/interpolation.hpp"
+#include "pipeline/pipeline.hpp"
+#include "pipeline/batch_compile.hpp"
+#include "backend/cpp_emitter.hpp"
+#include "server/server.hpp"
+#include "../vm/vm.hpp"
+#include "../vm/jit.hpp"
+#include "../vm/batch.hpp"
+#include "../vm/workbook.hpp"
+#include "../vm/concurrent_scope.hpp"
+#include "../vm/tables.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <iomanip>
+#include <utility>
+#include <stdexcept>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <mutex>
+
+void print_expr(Expression* expr) {
+    switch (expr->node_type) {
+    case NodeType::BINARY_EXPRESSION: {
+        BinaryExpression* binary = static_cast<BinaryExpression*>(expr);
+        std::cout << "(";
+        print_expr(binary->lhs);
+        std::cout << " " << binary->op.value << " ";
+        print_expr(binary->rhs);
+        std::cout << ")";
+        break;
+    }
+    case NodeType::UNARY_EXPRESSION: {
+        UnaryExpression* unary = static_cast<UnaryExpression*>(expr);
+        std::cout << unary->sign.value;
+        print_expr(unary->value);
+        break;
+    }
+    case NodeType::CALL_EXPRESSION: {
+        CallExpression* call = static_cast<CallExpression*>(expr);
+        std::cout << call->function_name.value << "(";
+
+        long long arguments_size = call->arguments.size();
+        for (long long i = 0; i < arguments_size; i++) {
+            print_expr(call->arguments[i]);
+            if (i < arguments_size-1) {
+                std::cout << ", ";
+            }
+        }
+
+        std::cout << ")";
+        break;
+    }
+    case NodeType::NUMBER_EXPRESSION:
+        std::cout << static_cast<NumberExpression*>(expr)->value;
+        break;
+    case NodeType::NULL_EXPRESSION:
+        std::cout << "NULL";
+        break;
+    case NodeType::CELL_EXPRESSION: {
+        CellExpression* cell = static_cast<CellExpression*>(expr);
+        if (!cell->sheet.empty()) {
+            std::cout << cell->sheet << "!";
+        }
+
+        std::cout << cell->column.value << cell->row.value;
+        break;
+    }
+    case NodeType::RANGED_EXPRESSION: {
+        RangedExpression* ranged = static_cast<RangedExpression*>(expr);
+        if (!ranged->sheet.empty()) {
+            std::cout << ranged->sheet << "!";
+        }
+
+        print_expr(ranged->lhs);
+        std::cout << ":";
+        print_expr(ranged->rhs);
+        break;
+    }
+    case NodeType::FLAG_EXPRESSION: {
+        FlagExpression* flag = static_cast<FlagExpression*>(expr);
+        std::cout << "flag " << flag->name.value << " ";
+        print_expr(flag->target);
+        break;
+    }
+    default:
+        // Statements are printed by print_stmt
+        break;
+    }
+}
+
+void print_stmt(const long long indentation, Statement* stmt) {
+    for (long long i = 0; i < indentation; i++) {
+        std::cout << "  ";
+    }
+
+    switch (stmt->node_type) {
+    case NodeType::BLOCK_STATEMENT: {
+        BlockStatement* block = static_cast<BlockStatement*>(stmt);
+        std::cout << "(BLOCK STATEMENT length=" << block->block.size() << ", depth=" << indentation <<")\n";
+        for (long long i = 0; i < block->block.size(); i++) {
+            print_stmt(indentation+1, block->block[i]);
+        }
+
+        break;
+    }
+    case NodeType::CELL_ASSIGNMENT_STATEMENT: {
+        CellAssignmentStatement* assignment = static_cast<CellAssignmentStatement*>(stmt);
+        print_expr(assignment->assignee);
+        std::cout << " = ";
+        print_expr(assignment->value);
+        std::cout << "\n";
+        break;
+    }
+    case NodeType::RANGE_ASSIGNMENT_STATEMENT: {
+        RangeAssignmentStatement* assignment = static_cast<RangeAssignmentStatement*>(stmt);
+        print_expr(assignment->assignee);
+        std::cout << " = ";
+        print_expr(assignment->value);
+        std::cout << "\n";
+        break;
+    }
+    case NodeType::EXPRESSION_STATEMENT:
+        print_expr(static_cast<ExpressionStatement*>(stmt)->expression);
+        std::cout << "\n";
+        break;
+    case NodeType::FLAG_ASSIGNMENT_STATEMENT: {
+        FlagAssignmentStatement* assignment = static_cast<FlagAssignmentStatement*>(stmt);
+        print_expr(assignment->assignee);
+        std::cout << " = " << (assignment->value ? "true" : "false") << "\n";
+        break;
+    }
+    default:
+        // Expressions are printed by print_expr as part of their statement
+        break;
+    }
+}
+
+void debug_instructions(const std::vector<Instruction>& instructions) {
+    for (long long i = 0; i < instructions.size(); i++) {
+        switch (instructions[i].instruction_type) {
+        case InstructionType::NOP:
+            std::cout << "NOP";
+            break;
+        case InstructionType::PUSH:
+            std::cout << "PUSH";
+            break;
+        case InstructionType::POP:
+            std::cout << "POP";
+            break;
+        case InstructionType::ADD:
+            std::cout << "ADD";
+            break;
+        case InstructionType::SUB:
+            std::cout << "SUB";
+            break;
+        case InstructionType::MUL:
+            std::cout << "MUL";
+            break;
+        case InstructionType::DIV:
+            std::cout << "DIV";
+            break;
+        case InstructionType::UPLUS:
+            std::cout << "UPLUS";
+            break;
+        case InstructionType::UMINUS:
+            std::cout << "UMINUS";
+            break;
+        case InstructionType::STOC:
+            std::cout << "STOC";
+            break;
+        case InstructionType::STOR:
+            std::cout << "STOR";
+            break;
+        case InstructionType::LODC:
+            std::cout << "LODC";
+            break;
+        case InstructionType::LODR:
+            std::cout << "LODR";
+            break;
+        case InstructionType::CALL:
+            std::cout << "CALL";
+            break;
+        case InstructionType::STOCS:
+            std::cout << "STOCS";
+            break;
+        case InstructionType::LODCS:
+            std::cout << "LODCS";
+            break;
+        case InstructionType::STORS:
+            std::cout << "STORS";
+            break;
+        case InstructionType::LODRS:
+            std::cout << "LODRS";
+            break;
+        case InstructionType::STOF:
+            std::cout << "STOF";
+            break;
+        case InstructionType::STFR:
+            std::cout << "STFR";
+            break;
+        case InstructionType::LODF:
+            std::cout << "LODF";
+            break;
+        case InstructionType::CNTF:
+            std::cout << "CNTF";
+            break;
+        case InstructionType::ADD_NN:
+            std::cout << "ADD_NN";
+            break;
+        case InstructionType::SUB_NN:
+            std::cout << "SUB_NN";
+            break;
+        case InstructionType::MUL_NN:
+            std::cout << "MUL_NN";
+            break;
+        case InstructionType::DIV_NN:
+            std::cout << "DIV_NN";
+            break;
+        case InstructionType::LODC_N:
+            std::cout << "LODC_N";
+            break;
+        case InstructionType::STOA:
+            std::cout << "STOA";
+            break;
+        case InstructionType::STOAS:
+            std::cout << "STOAS";
+            break;
+        }
+
+        std::cout << " " << instructions[i].start_column << ":" << instructions[i].start_row;
+        for (long long j = 0; j < instructions[i].arguments.size(); j++) {
+            std::cout << " " << instructions[i].arguments[j]->start_column << " " << instructions[i].arguments[j]->start_line << " ";
+            if (instructions[i].arguments[j]->data_type == DataType::NUMBER) {
+                std::cout << static_cast<Number*>(instructions[i].arguments[j])->value;
+            } else {
+                std::cout << std::quoted(static_cast<String*>(instructions[i].arguments[j])->value);
+            }
+        }
+
+        std::cout << "\n";
+    }
+}
+
+// Reads a CSV file whose header names cells ("A1,B2") and whose rows are one scenario each
+BatchScope* read_scenarios(std::istream& in) {
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+
+    if (lines.empty()) {
+        throw std::runtime_error("Scenario file has no header");
+    }
+
+    std::vector<long long> keys;
+    std::stringstream header(lines[0]);
+    std::string cell;
+    while (std::getline(header, cell, ',')) {
+        size_t digits = cell.find_first_of("0123456789");
+        if (digits == 0 || digits == std::string::npos) {
+            throw std::runtime_error("Scenario header entry '" + cell + "' is not a cell");
+        }
+
+        keys.push_back(cell_key(column_to_ord(cell.substr(0, digits)), std::stoll(cell.substr(digits))));
+    }
+
+    BatchScope* scope = create_batch_scope(lines.size() - 1);
+    for (long long lane = 1; lane < static_cast<long long>(lines.size()); lane++) {
+        std::stringstream row(lines[lane]);
+        std::string value;
+        for (long long i = 0; i < static_cast<long long>(keys.size()) && std::getline(row, value, ','); i++) {
+            scope->plane(keys[i])[lane - 1] = std::stod(value);
+        }
+    }
+
+    return scope;
+}
+
+// A plain scope behind one mutex, the baseline --bench-store compares the concurrent scope against
+class LockedScope {
+public:
+    bool retrieve_number(const long long key, double& value) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->scope.retrieve_number(key, value);
+    }
+
+    void assign_number(const long long key, const double value) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->scope.assign_number(key, value);
+    }
+private:
+    std::mutex mutex;
+    Scope scope;
+};
+
+const long long BENCH_STORE_OPERATIONS = 1 << 20; // Per thread
+const long long BENCH_STORE_COLUMNS = 64;
+const long long BENCH_STORE_ROWS = 4096;
+
+// Runs a random mix of number reads and writes on every thread and returns millions of operations
+// per second. With disjoint every thread stays inside its own block of columns, otherwise all
+// threads share one block
+template <typename Store>
+double bench_store(Store& store, const long long threads, const long long write_percent, const bool disjoint) {
+    std::vector<std::thread> workers;
+    std::atomic<double> sink(0);
+    auto start = std::chrono::steady_clock::now();
+    for (long long t = 0; t < threads; t++) {
+        workers.emplace_back([&store, &sink, t, write_percent, disjoint]() {
+            unsigned long long state = 0x9e3779b97f4a7c15ULL * (t + 1);
+            long long first_column = disjoint ? 1 + t * BENCH_STORE_COLUMNS : 1;
+            double sum = 0;
+            for (long long i = 0; i < BENCH_STORE_OPERATIONS; i++) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                long long column = first_column + static_cast<long long>(state % BENCH_STORE_COLUMNS);
+                long long row = static_cast<long long>((state >> 8) % BENCH_STORE_ROWS);
+                long long key = (column << 40) | row;
+                if (static_cast<long long>((state >> 32) % 100) < write_percent) {
+                    store.assign_number(key, static_cast<double>(i));
+                } else {
+                    double value;
+                    store.retrieve_number(key, value);
+                    sum += value;
+                }
+            }
+
+            sink.store(sum);
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return threads * BENCH_STORE_OPERATIONS / elapsed.count() / 1e6;
+}
+
+void bench_stores(const long long threads) {
+    struct Workload {
+        std::string name;
+        long long write_percent;
+        bool disjoint;
+    };
+
+    std::vector<Workload> workloads = {
+        {"read-heavy", 10, false},
+        {"write-heavy", 90, false},
+        {"disjoint-range", 50, true},
+    };
+
+    std::cout << std::left << std::setw(16) << "workload" << std::setw(10) << "threads" << std::setw(20) << "concurrent Mops/s" << "mutex Mops/s\n";
+    for (const Workload& workload : workloads) {
+        ConcurrentScope* concurrent = create_concurrent_scope();
+        LockedScope* locked = new LockedScope();
+        double concurrent_rate = bench_store(*concurrent, threads, workload.write_percent, workload.disjoint);
+        double locked_rate = bench_store(*locked, threads, workload.write_percent, workload.disjoint);
+        std::cout << std::left << std::setw(16) << workload.name << std::setw(10) << threads << std::setw(20) << std::fixed << std::setprecision(2) << concurrent_rate << locked_rate << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        delete concurrent;
+        delete locked;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string code = "EXCELLANG(A1, A2, ,,,,, 69)";
+    std::string path = "";
+    bool stream = false;
+    bool parallel = false;
+    bool emit_cpp = false;
+    bool run = false;
+    bool jit = true;
+    bool call_cache = true;
+    bool verify_jit = false;
+    bool check = false;
+    bool stats = false;
+    long long repeat = 1;
+    long long publish_every = 0;
+    long long memory_budget = 0;
+    std::string spill_file = "excellang.spill";
+    bool bench = false;
+    bool lazy = false;
+    bool sum_index = false;
+    std::string cells = "";
+    std::string socket_path = "";
+    std::string scenarios = "";
+    std::string batch_input = "";
+    std::string artifact = "";
+    std::vector<std::pair<std::string, std::string>> sheets;
+    std::string output = "";
+    long long threads = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--stream") {
+            stream = true;
+        } else if (argument == "--parallel") {
+            parallel = true;
+        } else if (argument == "--emit-cpp") {
+            emit_cpp = true;
+        } else if (argument == "--run") {
+            run = true;
+        } else if (argument == "--no-jit") {
+            jit = false;
+        } else if (argument == "--no-call-cache") {
+            call_cache = false;
+        } else if (argument == "--verify-jit") {
+            verify_jit = true;
+        } else if (argument == "--check") {
+            check = true;
+        } else if (argument == "--lazy") {
+            // --lazy computes cell assignments when their cell is read, the sheet stays the same as without it
+            lazy = true;
+        } else if (argument == "--sum-index") {
+            // --sum-index answers SUM, COUNT and AVERAGE over ranges from per-tile prefix sums
+            sum_index = true;
+        } else if (argument == "--cells" && i + 1 < argc) {
+            cells = argv[++i];
+        } else if (argument == "--table" && i + 1 < argc) {
+            // --table path.csv, the first one is TABLE(1, row, column) and so on
+            register_table(argv[++i]);
+        } else if (argument == "--serve" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (argument == "--bench-store") {
+            bench = true;
+        } else if (argument == "--stats") {
+            stats = true;
+        } else if (argument == "--sheet" && i + 1 < argc) {
+            // --sheet Name=path.elg, adds a sheet to the workbook
+            std::string sheet = argv[++i];
+            size_t equals = sheet.find('=');
+            if (equals == std::string::npos) {
+                std::cerr << "--sheet expects Name=path\n";
+                return 1;
+            }
+
+            sheets.push_back({sheet.substr(0, equals), sheet.substr(equals + 1)});
+        } else if (argument == "--batch" && i + 1 < argc) {
+            scenarios = argv[++i];
+        } else if (argument == "--compile-batch" && i + 1 < argc) {
+            // --compile-batch dir|list.txt -o outdir compiles every source to outdir in one process
+            batch_input = argv[++i];
+        } else if (argument == "--artifact" && i + 1 < argc) {
+            // --artifact outdir/file.elc runs a program --compile-batch wrote instead of compiling one
+            artifact = argv[++i];
+        } else if (argument == "--publish-every" && i + 1 < argc) {
+            publish_every = std::stoll(argv[++i]);
+        } else if (argument == "--memory-budget" && i + 1 < argc) {
+            // --memory-budget MB keeps the sheet's tiles beyond that in the --spill-file
+            memory_budget = std::stoll(argv[++i]);
+        } else if (argument == "--spill-file" && i + 1 < argc) {
+            spill_file = argv[++i];
+        } else if (argument == "--repeat" && i + 1 < argc) {
+            repeat = std::stoll(argv[++i]);
+        } else if (argument == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (argument == "--threads" && i + 1 < argc) {
+            threads = std::stoll(argv[++i]);
+        } else {
+            path = argument;
+        }
+    }
+
+    if (bench) {
+        bench_stores(threads == 0 ? std::thread::hardware_concurrency() : threads);
+        return 0;
+    }
+
+    if (!socket_path.empty()) {
+        // --serve path.sock keeps evaluating programs sent by the client until it asks to shut down
+        Server* server = create_server(socket_path);
+        std::cerr << "Serving on " << socket_path << "\n";
+        server->serve();
+        std::cerr << "Served " << server->requests.load() << " requests\n";
+        delete server;
+        return 0;
+    }
+
+    if (!batch_input.empty()) {
+        if (output.empty()) {
+            std::cerr << "--compile-batch needs an output directory (-o)\n";
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<BatchFile> files = plan_batch(batch_input, output);
+        long long constants = compile_batch(files, output, threads);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        long long used = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+        print_batch_summary(std::cout, files, constants, std::min<long long>(used, files.size()), elapsed.count());
+        for (const BatchFile& file : files) {
+            if (!file.error.empty()) {
+                return 1;
+            }
+        }
+
+        return 0;
+    }
+
+    if (!sheets.empty()) {
+        Workbook* workbook = create_workbook();
+        std::vector<std::vector<Instruction>> programs(sheets.size());
+        for (long long i = 0; i < static_cast<long long>(sheets.size()); i++) {
+            std::ifstream file(sheets[i].second);
+            if (!file) {
+                std::cerr << "Could not open " << sheets[i].second << "\n";
+                return 1;
+            }
+
+            std::stringstream ss;
+            ss << file.rdbuf();
+            programs[i] = compile_parallel(ss.str(), 1);
+            workbook->add_sheet(sheets[i].first, &programs[i]);
+        }
+
+        workbook->evaluate(threads);
+        workbook->dump(std::cout);
+        return 0;
+    }
+
+    if (stream) {
+        if (path.empty()) {
+            std::cerr << "--stream needs a source file\n";
+            return 1;
+        }
+
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "Could not open " << path << "\n";
+            return 1;
+        }
+
+        compile_streamed(file, [](std::vector<Instruction>& instructions) {
+            debug_instructions(instructions);
+        });
+        return 0;
+    }
+
+    if (!path.empty()) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "Could not open " << path << "\n";
+            return 1;
+        }
+
+        std::stringstream ss;
+        ss << file.rdbuf();
+        code = ss.str();
+    }
+
+    if (check) {
+        // Reports every syntax error in the source instead of stopping at the first one
+        std::vector<Diagnostic> diagnostics = check_syntax(code);
+        for (const Diagnostic& diagnostic : diagnostics) {
+            std::cout << diagnostic.message << "\n";
+        }
+
+        return diagnostics.empty() ? 0 : 1;
+    }
+
+    if (parallel) {
+        std::vector<Instruction> instructions = compile_parallel(code, threads);
+        debug_instructions(instructions);
+        return 0;
+    }
+
+    if (verify_jit) {
+        // Differential check: the same program run by the plain interpreter and with the JIT
+        // has to leave identical sheets behind
+        std::vector<Instruction> instructions = compile_parallel(code, threads);
+        long long runs = std::max(repeat, JIT_THRESHOLD + 1);
+
+        Scope interpreted_scope;
+        VM interpreted(instructions, &interpreted_scope);
+        interpreted.set_jit_enabled(false);
+
+        Scope jit_scope;
+        VM jitted(instructions, &jit_scope);
+        for (long long i = 0; i < runs; i++) {
+            interpreted.run();
+            jitted.run();
+        }
+
+        std::stringstream expected;
+        std::stringstream actual;
+        interpreted_scope.dump(expected);
+        jit_scope.dump(actual);
+        if (expected.str() != actual.str()) {
+            std::cout << "JIT result differs from the interpreter after " << runs << " runs\n";
+            std::cout << "interpreter:\n" << expected.str() << "jit:\n" << actual.str();
+            return 1;
+        }
+
+        std::cout << "JIT matches the interpreter after " << runs << " runs\n";
+        return 0;
+    }
+
+    if (!scenarios.empty()) {
+        std::ifstream file(scenarios);
+        if (!file) {
+            std::cerr << "Could not open " << scenarios << "\n";
+            return 1;
+        }
+
+        std::vector<Instruction> instructions = compile_parallel(code, threads);
+        BatchScope* scope = read_scenarios(file);
+        BatchVM* vm = create_batch_vm(instructions, scope);
+        for (long long i = 0; i < repeat; i++) {
+            vm->run();
+        }
+
+        scope->dump_csv(std::cout);
+        return 0;
+    }
+
+    if (run) {
+        std::vector<Instruction> instructions = artifact.empty() ? compile_parallel(code, threads) : load_artifact(artifact);
+        Scope* scope = new Scope();
+        if (memory_budget > 0) {
+            if (publish_every > 0) {
+                std::cerr << "--publish-every cannot be combined with --memory-budget\n";
+                return 1;
+            }
+
+            scope->set_memory_budget(spill_file, memory_budget << 20);
+        }
+
+        scope->set_sum_index(sum_index);
+        VM* vm = create_vm(instructions, scope);
+        vm->set_jit_enabled(jit);
+        vm->set_call_cache_enabled(call_cache);
+        vm->set_lazy(lazy);
+
+        // With --publish-every the sheet is published every N cell writes and a reporter thread
+        // reads the snapshots while the program is still running
+        std::atomic<bool> done(false);
+        std::thread reporter;
+        if (publish_every > 0) {
+            scope->set_publish_interval(publish_every);
+            reporter = std::thread([scope, &done]() {
+                long long seen = -1;
+                while (!done.load()) {
+                    std::shared_ptr<const Snapshot> snapshot = scope->latest();
+                    if (snapshot != nullptr && snapshot->version != seen) {
+                        seen = snapshot->version;
+                        std::cerr << "snapshot " << snapshot->version << ": " << snapshot->cell_count() << " cells\n";
+                    }
+
+                    std::this_thread::yield();
+                }
+            });
+        }
+
+        for (long long i = 0; i < repeat; i++) {
+            vm->run();
+        }
+
+        if (publish_every > 0) {
+            done.store(true);
+            reporter.join();
+        }
+
+        if (!cells.empty()) {
+            // --cells A1,B2 prints only these cells, with --lazy nothing else gets computed
+            std::stringstream list(cells);
+            std::string cell;
+            while (std::getline(list, cell, ',')) {
+                size_t digits = cell.find_first_of("0123456789");
+                if (digits == 0 || digits == std::string::npos) {
+                    std::cerr << "'" << cell << "' is not a cell\n";
+                    return 1;
+                }
+
+                RuntimeValue* value = vm->retrieve(column_to_ord(cell.substr(0, digits)), std::stoll(cell.substr(digits)));
+                std::cout << cell << " = " << std::setprecision(15);
+                if (value->data_type == DataType::NUMBER) {
+                    std::cout << static_cast<Number*>(value)->value << "\n";
+                } else {
+                    std::cout << std::quoted(static_cast<String*>(value)->value) << "\n";
+                }
+
+                delete value;
+            }
+        } else {
+            vm->evaluate_formulas();
+            scope->dump(std::cout);
+        }
+
+        if (stats) {
+            vm->print_stats(std::cerr);
+        }
+
+        return 0;
+    }
+
+    if (emit_cpp) {
+        std::vector<Instruction> instructions = compile_parallel(code, threads);
+        CppEmitter* emitter = create_cpp_emitter(instructions);
+        std::string emitted;
+        try {
+            emitted = emitter->emit();
+        } catch (const std::runtime_error& error) {
+            // Programs the backend cannot translate are reported instead of aborting
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+
+        if (output.empty()) {
+            std::cout << emitted;
+        } else {
+            std::ofstream file(output);
+            file << emitted;
+        }
+
+        return 0;
+    }
+
+    Lexer* lexer = create_lexer(code);
+    std::vector<Token> tokens = lexer->tokenize();
+
+    std::cout << "lexer:\n";
+    for (long long i = 0; i < tokens.size(); i++) {
+        std::cout << tokens[i].column << ":" << tokens[i].line << " " << static_cast<int>(tokens[i].token_type) << " " << tokens[i].value << "\n";
+    }
+
+    std::cout << "\n";
+
+    Parser* parser = create_parser(std::move(tokens));
+    BlockStatement* block = parser->parse();
+
+    std::cout << "parser:\n";
+    print_stmt(0, block);
+    std::cout << "\n";
+
+    Interpolator* interpolator = create_interpolator(block);
+    interpolator->interpolate();
+
+    std::cout << "VM:\n";
+    debug_instructions(interpolator->instructions);
+    return 0;
 }
\ No newline at end of file
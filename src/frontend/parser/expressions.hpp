@@ -1,56 +1,76 @@
-#include "node_types.hpp"
-#include "../lexer/lexer.hpp"
-#include <string>
-#include <vector>
-
-#pragma once
-
-class BinaryExpression : public Expression {
-public:
-    BinaryExpression(Expression* lhs, Token op, Expression* rhs);
-    Expression* lhs;
-    Token op;
-    Expression* rhs;
-};
-
-class UnaryExpression : public Expression {
-public:
-    UnaryExpression(Token sign, Expression* value);
-    Token sign;
-    Expression* value;
-};
-
-class CallExpression : public Expression {
-public:
-    using Expression::start_column;
-    using Expression::start_line;
-    CallExpression(Token function_name_token, std::vector<Expression*> arguments);
-    Token function_name;
-    std::vector<Expression*> arguments;
-};
-
-class NumberExpression : public Expression {
-public:
-    NumberExpression(Token number_token);
-    double value;
-    bool has_decimal;
-};
-
-class NullExpression : public Expression {
-public:
-    NullExpression(Token semicolon);
-};
-
-class CellExpression : public Expression {
-public:
-    CellExpression(Token column_token, Token row_token);
-    Token column;
-    Token row;
-};
-
-class RangedExpression : public Expression {
-public:
-    RangedExpression(CellExpression* lhs, CellExpression* rhs);
-    CellExpression* lhs;
-    CellExpression* rhs;
-};
\ No newline at end of file
+#include "node_types.hpp"
+#include "../lexer/lexer.hpp"
+#include <string>
+#include <vector>
+
+#pragma once
+
+class BinaryExpression : public Expression {
+public:
+    BinaryExpression(Expression* lhs, Token op, Expression* rhs);
+    ~BinaryExpression();
+    Expression* lhs;
+    Token op;
+    Expression* rhs;
+};
+
+class UnaryExpression : public Expression {
+public:
+    UnaryExpression(Token sign, Expression* value);
+    ~UnaryExpression();
+    Token sign;
+    Expression* value;
+};
+
+class CallExpression : public Expression {
+public:
+    using Expression::start_column;
+    using Expression::start_line;
+    CallExpression(Token function_name_token, std::vector<Expression*> arguments);
+    ~CallExpression();
+    Token function_name;
+    std::vector<Expression*> arguments;
+};
+
+class NumberExpression : public Expression {
+public:
+    NumberExpression(Token number_token);
+    double value;
+    bool has_decimal;
+};
+
+class NullExpression : public Expression {
+public:
+    NullExpression(Token semicolon);
+};
+
+class CellExpression : public Expression {
+public:
+    CellExpression(Token column_token, Token row_token);
+    Token column;
+    Token row;
+    std::string sheet; // Empty for cells of the sheet the program runs on
+};
+
+class RangedExpression : public Expression {
+public:
+    RangedExpression(CellExpression* lhs, CellExpression* rhs);
+    ~RangedExpression();
+    CellExpression* lhs;
+    CellExpression* rhs;
+    std::string sheet;
+};
+
+// Cell flags, written "flag bold A1". On a cell it reads as 1 or 0, on a range as the number of cells
+// that have the flag set
+class FlagExpression : public Expression {
+public:
+    FlagExpression(Token flag_keyword, Token name, Expression* target);
+    ~FlagExpression();
+    Token name;
+    long long flag;
+    Expression* target; // A CellExpression or a RangedExpression
+};
+
+// Flag names are case-sensitive, returns -1 for names that are not flags
+long long flag_index(const std::string& name);
\ No newline at end of file
@@ -1,216 +1,458 @@
-#include "statements.hpp"
-#include "node_types.hpp"
-#include "parser.hpp"
-#include "../lexer/lexer.hpp"
-#include <sstream>
-
-Parser::Parser(const std::vector<Token>& tokens) {
-    this->tokens = tokens;
-    this->position = 0;
-}
-
-BlockStatement* Parser::parse() {
-    std::vector<Statement*> block(0);
-    while (this->tokens[this->position].token_type != TokenType::END_OF_FILE) {
-        this->advance_newline();
-        if (this->tokens[this->position].token_type == TokenType::END_OF_FILE) {
-            break;
-        }
-
-        block.push_back(this->parse_statement());
-    }
-
-    return new BlockStatement(block);
-}
-
-Statement* Parser::parse_statement() {
-    switch (this->tokens[this->position].token_type) {
-    default:
-        Expression* expression = this->parse_expression();
-        ExpressionStatement* returned = new ExpressionStatement(expression);
-        this->newline_check();
-        return returned;
-    }
-}
-
-Expression* Parser::parse_expression() {
-    return this->parse_additive_expression();
-}
-
-Expression* Parser::parse_additive_expression() {
-    Expression* lhs = this->parse_multiplicative_expression();
-    while (this->tokens[this->position].token_type == TokenType::PLUS || this->tokens[this->position].token_type == TokenType::MINUS) {
-        Token op = this->tokens[this->position];
-        this->position++;
-        
-        Expression* rhs = this->parse_multiplicative_expression();
-        lhs = new BinaryExpression(lhs, op, rhs);
-    }
-
-    return lhs;
-}
-
-Expression* Parser::parse_multiplicative_expression() {
-    Expression* lhs = this->parse_unary_expression();
-    while (this->tokens[this->position].token_type == TokenType::MULTIPLY || this->tokens[this->position].token_type == TokenType::DIVIDE) {
-        Token op = this->tokens[this->position];
-        this->position++;
-        
-        Expression* rhs = this->parse_unary_expression();
-        lhs = new BinaryExpression(lhs, op, rhs);
-    }
-
-    return lhs;
-}
-
-Expression* Parser::parse_unary_expression() {
-    switch (this->tokens[this->position].token_type) {
-    case TokenType::PLUS: {
-        Token op = this->tokens[this->position];
-        this->position++;
-        
-        return new UnaryExpression(op, this->parse_unary_expression());
-    }
-    case TokenType::MINUS: {
-        Token op = this->tokens[this->position];
-        this->position++;
-        
-        return new UnaryExpression(op, this->parse_unary_expression());
-    }
-    default:
-        return this->parse_primary_expression();
-    }
-}
-
-Expression* Parser::parse_primary_expression() {
-    switch (this->tokens[this->position].token_type) {
-    case TokenType::NUMBER: {
-        Token current_token = this->tokens[this->position];
-        NumberExpression* returned = new NumberExpression(current_token);
-        
-        this->position++;
-        return returned;
-    }
-    case TokenType::IDENTIFIER: {
-        Token identifier = this->tokens[this->position];
-        this->position++;
-
-        if (this->tokens[this->position].token_type == TokenType::NUMBER && this->tokens[this->position].value[0] != 'd') {
-            this->position--;
-            return this->parse_ranged_expression();
-        } else {
-            return this->parse_call_expression(identifier);
-        }
-    }
-    case TokenType::LEFT_PARENTHESES: {
-        long long left_parenthese_column = this->tokens[this->position].column;
-        long long left_parenthese_line = this->tokens[this->position].line;
-
-        this->position++;
-        Expression* expression = this->parse_expression();
-        if (this->tokens[this->position].token_type != TokenType::RIGHT_PARENTHESES) {
-            this->throw_not_matching_token(TokenType::RIGHT_PARENTHESES, this->tokens[this->position]);
-        }
-
-        this->position++;
-        expression->start_column = left_parenthese_column;
-        expression->start_line = left_parenthese_line;
-
-        return expression;
-    }
-    default:
-        this->throw_invalid_syntax_error(this->tokens[this->position]);
-        return nullptr;
-    }
-}
-
-CellExpression* Parser::parse_cell_expression() {
-    Token column = this->tokens[this->position];
-    this->position++;
-
-    if (this->tokens[this->position].token_type != TokenType::NUMBER) {
-        Token errored_token = this->tokens[this->position];
-        this->throw_not_matching_token(TokenType::NUMBER, errored_token);
-    }
-
-    Token row = this->tokens[this->position];
-    this->position++;
-    
-    CellExpression* returned = new CellExpression(column, row);
-    return returned;
-}
-
-CallExpression* Parser::parse_call_expression(Token function_name_token) {
-    if (this->tokens[this->position].token_type != TokenType::LEFT_PARENTHESES) {
-        this->throw_not_matching_token(TokenType::LEFT_PARENTHESES, this->tokens[this->position]);
-    }
-
-    this->position++;
-
-    bool comma = false;
-    std::vector<Expression*> arguments(0);
-    while (this->tokens[this->position].token_type != TokenType::RIGHT_PARENTHESES) {
-        if (comma && this->tokens[this->position].token_type != TokenType::COMMA) {
-            this->throw_not_matching_token(TokenType::COMMA, this->tokens[this->position]);
-        }
-
-        comma = true;
-        this->position++;
-        while (this->tokens[this->position].token_type == TokenType::COMMA) {
-            arguments.push_back(new NullExpression(this->tokens[this->position]));
-            this->position++;
-        }
-
-        if (this->tokens[this->position].token_type == TokenType::RIGHT_PARENTHESES) {
-            break;
-        }
-
-        arguments.push_back(this->parse_expression());
-    }
-
-    this->position++;
-    return new CallExpression(function_name_token, arguments);
-}
-
-Expression* Parser::parse_ranged_expression() {
-    CellExpression* corner1 = parse_cell_expression();
-    if (this->tokens[this->position].token_type != TokenType::COLON) {
-        return corner1;
-    }
-
-    this->position++;
-
-    CellExpression* corner2 = parse_cell_expression();
-    RangedExpression* returned = new RangedExpression(corner1, corner2);
-    return returned;
-}
-
-void Parser::throw_invalid_syntax_error(const Token token) {
-    std::stringstream ss;
-    ss << "Invalid syntax at " << token.column << ":" << token.line;
-    throw std::runtime_error(ss.str());
-}
-
-void Parser::throw_not_matching_token(const TokenType& expected, const Token token) {
-    std::stringstream ss;
-    ss << "Expected '" << type_to_str()[expected] << "' at " << token.column << ":" << token.line << ", got " << token.value;
-    throw std::runtime_error(ss.str());
-}
-
-void Parser::advance_newline() {
-    while (this->tokens[this->position].token_type == TokenType::NEWLINE || this->tokens[this->position].token_type == TokenType::SEMICOLON) {
-        this->position++;
-    }
-}
-
-void Parser::newline_check() {
-    if (this->tokens[this->position].token_type != TokenType::NEWLINE && this->tokens[this->position].token_type != TokenType::SEMICOLON && this->tokens[this->position].token_type != TokenType::END_OF_FILE) {
-        std::stringstream ss;
-        ss << "Expected newline or semicolon at " << this->tokens[this->position].column << ":" << this->tokens[this->position].line << ", got " << this->tokens[this->position].value;
-        throw std::runtime_error(ss.str());
-    }
-}
-
-Parser* create_parser(const std::vector<Token>& tokens) {
-    return new Parser(tokens);
+#include "statements.hpp"
+#include "node_types.hpp"
+#include "parser.hpp"
+#include "../lexer/lexer.hpp"
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+Parser::Parser(std::vector<Token> tokens) : tokens(std::move(tokens)) {
+    this->position = 0;
+    this->recover = false;
+    this->failed = false;
+}
+
+Parser::Parser(Lexer* lexer) : tokens(lexer) {
+    this->position = 0;
+    this->recover = false;
+    this->failed = false;
+}
+
+BlockStatement* Parser::parse() {
+    std::vector<Statement*> block(0);
+    Statement* statement = this->parse_next();
+    while (statement != nullptr) {
+        block.push_back(statement);
+        statement = this->parse_next();
+    }
+
+    return new BlockStatement(block);
+}
+
+Statement* Parser::parse_next() {
+    while (true) {
+        this->advance_newline();
+        if (this->tokens.at(this->position).token_type == TokenType::END_OF_FILE) {
+            return nullptr;
+        }
+
+        Statement* statement = this->parse_statement();
+        if (statement != nullptr) {
+            return statement;
+        }
+
+        if (!this->recover) {
+            throw std::runtime_error(this->diagnostics.back().message);
+        }
+
+        this->synchronize();
+    }
+}
+
+Statement* Parser::parse_statement() {
+    switch (this->tokens.at(this->position).token_type) {
+    default:
+        Expression* expression = this->parse_expression();
+        if (expression == nullptr) {
+            return nullptr;
+        }
+
+        Statement* returned = nullptr;
+        if (this->tokens.at(this->position).token_type == TokenType::EQUALS) {
+            returned = this->parse_assignment_statement(expression);
+        } else {
+            returned = new ExpressionStatement(expression);
+        }
+
+        if (returned != nullptr && !this->newline_check()) {
+            delete returned;
+            return nullptr;
+        }
+
+        return returned;
+    }
+}
+
+Statement* Parser::parse_assignment_statement(Expression* assignee) {
+    Token equals = this->tokens.at(this->position);
+    this->position++;
+
+    switch (assignee->node_type) {
+    case NodeType::CELL_EXPRESSION:
+    case NodeType::RANGED_EXPRESSION: {
+        Expression* value = this->parse_expression();
+        if (value == nullptr) {
+            delete assignee;
+            return nullptr;
+        }
+
+        if (assignee->node_type == NodeType::CELL_EXPRESSION) {
+            return new CellAssignmentStatement(static_cast<CellExpression*>(assignee), value);
+        }
+
+        return new RangeAssignmentStatement(static_cast<RangedExpression*>(assignee), value);
+    }
+    case NodeType::FLAG_EXPRESSION: {
+        // Flags are set with the (case-sensitive) keywords true and false only
+        Token value = this->tokens.at(this->position);
+        if (value.token_type != TokenType::IDENTIFIER || (value.value != "true" && value.value != "false")) {
+            delete assignee;
+            this->report_invalid_syntax_error(value);
+            return nullptr;
+        }
+
+        this->position++;
+        return new FlagAssignmentStatement(static_cast<FlagExpression*>(assignee), value.value == "true");
+    }
+    default:
+        delete assignee;
+        this->report_invalid_syntax_error(equals);
+        return nullptr;
+    }
+}
+
+Expression* Parser::parse_expression() {
+    return this->parse_additive_expression();
+}
+
+Expression* Parser::parse_additive_expression() {
+    Expression* lhs = this->parse_multiplicative_expression();
+    while (lhs != nullptr && (this->tokens.at(this->position).token_type == TokenType::PLUS || this->tokens.at(this->position).token_type == TokenType::MINUS)) {
+        Token op = this->tokens.at(this->position);
+        this->position++;
+        
+        Expression* rhs = this->parse_multiplicative_expression();
+        if (rhs == nullptr) {
+            delete lhs;
+            return nullptr;
+        }
+
+        lhs = new BinaryExpression(lhs, op, rhs);
+    }
+
+    return lhs;
+}
+
+Expression* Parser::parse_multiplicative_expression() {
+    Expression* lhs = this->parse_unary_expression();
+    while (lhs != nullptr && (this->tokens.at(this->position).token_type == TokenType::MULTIPLY || this->tokens.at(this->position).token_type == TokenType::DIVIDE)) {
+        Token op = this->tokens.at(this->position);
+        this->position++;
+        
+        Expression* rhs = this->parse_unary_expression();
+        if (rhs == nullptr) {
+            delete lhs;
+            return nullptr;
+        }
+
+        lhs = new BinaryExpression(lhs, op, rhs);
+    }
+
+    return lhs;
+}
+
+Expression* Parser::parse_unary_expression() {
+    switch (this->tokens.at(this->position).token_type) {
+    case TokenType::PLUS:
+    case TokenType::MINUS: {
+        Token op = this->tokens.at(this->position);
+        this->position++;
+        
+        Expression* operand = this->parse_unary_expression();
+        if (operand == nullptr) {
+            return nullptr;
+        }
+
+        return new UnaryExpression(op, operand);
+    }
+    default:
+        return this->parse_primary_expression();
+    }
+}
+
+Expression* Parser::parse_primary_expression() {
+    switch (this->tokens.at(this->position).token_type) {
+    case TokenType::NUMBER: {
+        Token current_token = this->tokens.at(this->position);
+        NumberExpression* returned = new NumberExpression(current_token);
+        
+        this->position++;
+        return returned;
+    }
+    case TokenType::IDENTIFIER: {
+        Token identifier = this->tokens.at(this->position);
+        this->position++;
+
+        // "flag bold A1", the keyword is case-sensitive and a column called flag is followed by its row
+        if (identifier.value == "flag" && this->tokens.at(this->position).token_type == TokenType::IDENTIFIER) {
+            return this->parse_flag_expression(identifier);
+        }
+
+        // Sheet names look like identifiers or cells ("Totals!A1", "Sheet2!A1")
+        if (this->tokens.at(this->position).token_type == TokenType::EXCLAMATION_MARK) {
+            this->position++;
+            return this->parse_sheet_reference(identifier.value, identifier);
+        }
+
+        if (this->tokens.at(this->position).token_type == TokenType::NUMBER && this->tokens.at(this->position).value[0] != 'd') {
+            if (this->tokens.at(this->position + 1).token_type == TokenType::EXCLAMATION_MARK) {
+                std::string sheet = identifier.value + this->tokens.at(this->position).value;
+                this->position += 2;
+                return this->parse_sheet_reference(sheet, identifier);
+            }
+
+            this->position--;
+            return this->parse_ranged_expression();
+        } else {
+            return this->parse_call_expression(identifier);
+        }
+    }
+    case TokenType::LEFT_PARENTHESES: {
+        long long left_parenthese_column = this->tokens.at(this->position).column;
+        long long left_parenthese_line = this->tokens.at(this->position).line;
+
+        this->position++;
+        Expression* expression = this->parse_expression();
+        if (expression == nullptr) {
+            return nullptr;
+        }
+
+        if (this->tokens.at(this->position).token_type != TokenType::RIGHT_PARENTHESES) {
+            delete expression;
+            this->report_not_matching_token(TokenType::RIGHT_PARENTHESES, this->tokens.at(this->position));
+            return nullptr;
+        }
+
+        this->position++;
+        expression->start_column = left_parenthese_column;
+        expression->start_line = left_parenthese_line;
+
+        return expression;
+    }
+    default:
+        this->report_invalid_syntax_error(this->tokens.at(this->position));
+        return nullptr;
+    }
+}
+
+CellExpression* Parser::parse_cell_expression() {
+    Token column = this->tokens.at(this->position);
+    this->position++;
+
+    if (this->tokens.at(this->position).token_type != TokenType::NUMBER) {
+        Token errored_token = this->tokens.at(this->position);
+        this->report_not_matching_token(TokenType::NUMBER, errored_token);
+        return nullptr;
+    }
+
+    // Rows are whole numbers, and ones too long for a long long can only be outside of the sheet
+    Token row = this->tokens.at(this->position);
+    if (row.value[0] == 'd' || row.value.size() > 18) {
+        this->report_not_a_valid_row_number(row);
+        return nullptr;
+    }
+
+    this->position++;
+    
+    CellExpression* returned = new CellExpression(column, row);
+    return returned;
+}
+
+CallExpression* Parser::parse_call_expression(Token function_name_token) {
+    if (this->tokens.at(this->position).token_type != TokenType::LEFT_PARENTHESES) {
+        this->report_not_matching_token(TokenType::LEFT_PARENTHESES, this->tokens.at(this->position));
+        return nullptr;
+    }
+
+    this->position++;
+
+    std::vector<Expression*> arguments(0);
+    if (this->tokens.at(this->position).token_type != TokenType::RIGHT_PARENTHESES) {
+        while (true) {
+            // An empty argument (as in "F(1,,2)") is passed as a null value
+            Expression* argument = nullptr;
+            if (this->tokens.at(this->position).token_type == TokenType::COMMA || this->tokens.at(this->position).token_type == TokenType::RIGHT_PARENTHESES) {
+                argument = new NullExpression(this->tokens.at(this->position));
+            } else {
+                argument = this->parse_expression();
+            }
+
+            if (argument != nullptr) {
+                arguments.push_back(argument);
+            }
+
+            if (argument != nullptr && this->tokens.at(this->position).token_type == TokenType::RIGHT_PARENTHESES) {
+                break;
+            }
+
+            if (argument == nullptr || this->tokens.at(this->position).token_type != TokenType::COMMA) {
+                for (Expression* parsed : arguments) {
+                    delete parsed;
+                }
+
+                this->report_not_matching_token(TokenType::COMMA, this->tokens.at(this->position));
+                return nullptr;
+            }
+
+            this->position++;
+        }
+    }
+
+    this->position++;
+    return new CallExpression(function_name_token, arguments);
+}
+
+Expression* Parser::parse_ranged_expression() {
+    CellExpression* corner1 = parse_cell_expression();
+    if (corner1 == nullptr || this->tokens.at(this->position).token_type != TokenType::COLON) {
+        return corner1;
+    }
+
+    this->position++;
+
+    CellExpression* corner2 = parse_cell_expression();
+    if (corner2 == nullptr) {
+        delete corner1;
+        return nullptr;
+    }
+
+    RangedExpression* returned = new RangedExpression(corner1, corner2);
+    return returned;
+}
+
+Expression* Parser::parse_sheet_reference(const std::string& sheet, const Token& sheet_token) {
+    if (this->tokens.at(this->position).token_type != TokenType::IDENTIFIER) {
+        this->report_not_matching_token(TokenType::IDENTIFIER, this->tokens.at(this->position));
+        return nullptr;
+    }
+
+    Expression* reference = this->parse_ranged_expression();
+    if (reference == nullptr) {
+        return nullptr;
+    }
+
+    if (reference->node_type == NodeType::CELL_EXPRESSION) {
+        static_cast<CellExpression*>(reference)->sheet = sheet;
+    } else {
+        static_cast<RangedExpression*>(reference)->sheet = sheet;
+    }
+
+    reference->start_column = sheet_token.column;
+    reference->start_line = sheet_token.line;
+    return reference;
+}
+
+FlagExpression* Parser::parse_flag_expression(Token flag_keyword) {
+    Token name = this->tokens.at(this->position);
+    if (flag_index(name.value) < 0) {
+        this->report_invalid_syntax_error(name);
+        return nullptr;
+    }
+
+    this->position++;
+    if (this->tokens.at(this->position).token_type != TokenType::IDENTIFIER) {
+        this->report_not_matching_token(TokenType::IDENTIFIER, this->tokens.at(this->position));
+        return nullptr;
+    }
+
+    Expression* target = this->parse_ranged_expression();
+    if (target == nullptr) {
+        return nullptr;
+    }
+
+    return new FlagExpression(flag_keyword, name, target);
+}
+
+// What a diagnostic prints for the token it got, tokens without visible text by their name
+static std::string describe_token(const Token& token) {
+    if (token.token_type == TokenType::NEWLINE) {
+        return "newline";
+    }
+
+    if (token.token_type == TokenType::END_OF_FILE) {
+        return type_to_str()[token.token_type];
+    }
+
+    return token.value;
+}
+
+void Parser::report_invalid_syntax_error(const Token token) {
+    std::stringstream ss;
+    ss << "Invalid syntax at " << token.column << ":" << token.line;
+    this->report(token, ss.str());
+}
+
+void Parser::report_not_matching_token(const TokenType& expected, const Token token) {
+    std::stringstream ss;
+    ss << "Expected '" << type_to_str()[expected] << "' at " << token.column << ":" << token.line << ", got " << describe_token(token);
+    this->report(token, ss.str());
+}
+
+void Parser::report_not_a_valid_row_number(const Token token) {
+    std::stringstream ss;
+    ss << token.value.substr(token.value[0] == 'd' ? 1 : 0) << " at " << token.column << ":" << token.line << " is not a valid row number!";
+    this->report(token, ss.str());
+}
+
+void Parser::report_expected_newline(const Token token) {
+    std::stringstream ss;
+    ss << "Expected newline or semicolon at " << token.column << ":" << token.line << ", got " << describe_token(token);
+    this->report(token, ss.str());
+}
+
+void Parser::report(const Token& token, const std::string& message) {
+    if (this->failed) {
+        return;
+    }
+
+    // An invalid token is the actual problem wherever the parser runs into it
+    this->failed = true;
+    if (token.token_type == TokenType::INVALID) {
+        this->diagnostics.push_back(Diagnostic{token.line, token.column, token.value});
+    } else {
+        this->diagnostics.push_back(Diagnostic{token.line, token.column, message});
+    }
+}
+
+void Parser::synchronize() {
+    // Lexer errors are independent of the syntax error, so the invalid tokens skipped are reported too.
+    // The one the syntax error was reported at is already in diagnostics.
+    while (true) {
+        const Token& token = this->tokens.at(this->position);
+        if (token.token_type == TokenType::NEWLINE || token.token_type == TokenType::SEMICOLON || token.token_type == TokenType::END_OF_FILE) {
+            break;
+        }
+
+        const Diagnostic& last = this->diagnostics.back();
+        if (token.token_type == TokenType::INVALID && (last.line != token.line || last.column != token.column)) {
+            this->diagnostics.push_back(Diagnostic{token.line, token.column, token.value});
+        }
+
+        this->position++;
+    }
+
+    this->failed = false;
+}
+
+void Parser::advance_newline() {
+    while (this->tokens.at(this->position).token_type == TokenType::NEWLINE || this->tokens.at(this->position).token_type == TokenType::SEMICOLON) {
+        this->position++;
+    }
+}
+
+bool Parser::newline_check() {
+    if (this->tokens.at(this->position).token_type != TokenType::NEWLINE && this->tokens.at(this->position).token_type != TokenType::SEMICOLON && this->tokens.at(this->position).token_type != TokenType::END_OF_FILE) {
+        this->report_expected_newline(this->tokens.at(this->position));
+        return false;
+    }
+
+    return true;
+}
+
+Parser* create_parser(std::vector<Token> tokens) {
+    return new Parser(std::move(tokens));
+}
+
+Parser* create_parser(Lexer* lexer) {
+    return new Parser(lexer);
 }
\ No newline at end of file
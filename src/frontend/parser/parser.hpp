@@ -1,41 +1,64 @@
-#include "statements.hpp"
-#include "node_types.hpp"
-#include "../lexer/lexer.hpp"
-#include <vector>
-#include <string>
-
-#pragma once
-
-class Parser {
-public:
-    explicit Parser(const std::vector<Token>& tokens);
-    BlockStatement* parse();
-
-private:
-    // Init
-    std::vector<Token> tokens;
-    long long position;
-
-    // Statements
-    Statement* parse_statement();
-
-    // Expressions
-    Expression* parse_expression();
-    Expression* parse_additive_expression();
-    Expression* parse_multiplicative_expression();
-    Expression* parse_unary_expression();
-    Expression* parse_primary_expression();
-    CellExpression* parse_cell_expression();
-    Expression* parse_ranged_expression();
-    CallExpression* parse_call_expression(Token function_name_token);
-
-    // Errors
-    void throw_not_matching_token(const TokenType& expected, const Token token);
-    void throw_invalid_syntax_error(const Token token);
-
-    // Helpers
-    void advance_newline();
-    void newline_check();
-};
-
-Parser* create_parser(const std::vector<Token>& tokens);
\ No newline at end of file
+#include "statements.hpp"
+#include "node_types.hpp"
+#include "../lexer/lexer.hpp"
+#include "../lexer/token_stream.hpp"
+#include <vector>
+#include <string>
+
+#pragma once
+
+struct Diagnostic {
+    long long line;
+    long long column;
+    std::string message; // Same text the parser throws without recovery, position included
+};
+
+// Errors never throw inside the parser: the parse function that finds one records it and returns
+// nullptr, and so do its callers up to parse_next. Without recovery parse_next then throws the error,
+// with recovery it skips to the end of the statement and goes on, so one pass finds every error.
+class Parser {
+public:
+    explicit Parser(std::vector<Token> tokens);
+    explicit Parser(Lexer* lexer);
+    BlockStatement* parse();
+    Statement* parse_next(); // Parses the next top-level statement, returns nullptr at the end of the file
+
+    bool recover; // Set to collect errors in diagnostics instead of throwing the first one
+    std::vector<Diagnostic> diagnostics; // In source order
+private:
+    // Init
+    TokenStream tokens;
+    long long position;
+    bool failed; // The statement being parsed has an error, only its first one is reported
+
+    // Statements
+    Statement* parse_statement();
+    Statement* parse_assignment_statement(Expression* assignee);
+
+    // Expressions
+    Expression* parse_expression();
+    Expression* parse_additive_expression();
+    Expression* parse_multiplicative_expression();
+    Expression* parse_unary_expression();
+    Expression* parse_primary_expression();
+    CellExpression* parse_cell_expression();
+    Expression* parse_ranged_expression();
+    Expression* parse_sheet_reference(const std::string& sheet, const Token& sheet_token);
+    FlagExpression* parse_flag_expression(Token flag_keyword);
+    CallExpression* parse_call_expression(Token function_name_token);
+
+    // Errors
+    void report_not_matching_token(const TokenType& expected, const Token token);
+    void report_invalid_syntax_error(const Token token);
+    void report_not_a_valid_row_number(const Token token);
+    void report_expected_newline(const Token token);
+    void report(const Token& token, const std::string& message);
+    void synchronize(); // Skips the rest of a statement that failed, reporting the invalid tokens in it
+
+    // Helpers
+    void advance_newline();
+    bool newline_check();
+};
+
+Parser* create_parser(std::vector<Token> tokens);
+Parser* create_parser(Lexer* lexer);
\ No newline at end of file
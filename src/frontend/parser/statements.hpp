@@ -1,31 +1,43 @@
-#include "node_types.hpp"
-#include "expressions.hpp"
-#include <vector>
-
-#pragma once
-
-class BlockStatement : public Statement {
-public:
-    BlockStatement(std::vector<Statement*> block);
-    std::vector<Statement*> block;
-};
-
-class CellAssignmentStatement : public Statement {
-public:
-    CellAssignmentStatement(CellExpression* assignee, Expression* value);
-    CellExpression* assignee;
-    Expression* value;
-};
-
-class RangeAssignmentStatement : public Statement {
-public:
-    RangeAssignmentStatement(RangedExpression* assignee, Expression* value);
-    RangedExpression* assignee;
-    Expression* value;
-};
-
-class ExpressionStatement : public Statement {
-public:
-    ExpressionStatement(Expression* expression);
-    Expression* expression;
+#include "node_types.hpp"
+#include "expressions.hpp"
+#include <vector>
+
+#pragma once
+
+class BlockStatement : public Statement {
+public:
+    BlockStatement(std::vector<Statement*> block);
+    ~BlockStatement();
+    std::vector<Statement*> block;
+};
+
+class CellAssignmentStatement : public Statement {
+public:
+    CellAssignmentStatement(CellExpression* assignee, Expression* value);
+    ~CellAssignmentStatement();
+    CellExpression* assignee;
+    Expression* value;
+};
+
+class RangeAssignmentStatement : public Statement {
+public:
+    RangeAssignmentStatement(RangedExpression* assignee, Expression* value);
+    ~RangeAssignmentStatement();
+    RangedExpression* assignee;
+    Expression* value;
+};
+
+class ExpressionStatement : public Statement {
+public:
+    ExpressionStatement(Expression* expression);
+    ~ExpressionStatement();
+    Expression* expression;
+};
+
+class FlagAssignmentStatement : public Statement {
+public:
+    FlagAssignmentStatement(FlagExpression* assignee, const bool value);
+    ~FlagAssignmentStatement();
+    FlagExpression* assignee;
+    bool value;
 };
\ No newline at end of file
@@ -0,0 +1,517 @@
+#include "batch_compile.hpp"
+#include "pipeline.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// An instruction is written as its type, position and argument count, followed by a constant id and
+// a position for every argument
+struct EncodedProgram {
+    std::vector<long long> words;
+    std::vector<std::pair<size_t, const Constant*>> constants; // Word to fill in with the id of the constant
+};
+
+static std::string constant_key(const RuntimeValue* value) {
+    std::string key(1, static_cast<char>(value->data_type));
+    if (value->data_type == DataType::NUMBER) {
+        double number = static_cast<const Number*>(value)->value;
+        key.append(reinterpret_cast<const char*>(&number), sizeof(number));
+    } else {
+        key += static_cast<const String*>(value)->value;
+    }
+
+    return key;
+}
+
+const Constant* ConstantPool::intern(const RuntimeValue* value) {
+    std::string key = constant_key(value);
+    Shard& shard = this->shards[std::hash<std::string>()(key) % CONSTANT_POOL_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.constants.find(key);
+    if (found != shard.constants.end()) {
+        return &found->second;
+    }
+
+    Constant constant = {value->data_type, 0, "", -1};
+    if (value->data_type == DataType::NUMBER) {
+        constant.number = static_cast<const Number*>(value)->value;
+    } else {
+        constant.text = static_cast<const String*>(value)->value;
+    }
+
+    return &shard.constants.emplace(std::move(key), std::move(constant)).first->second;
+}
+
+void ConstantPool::freeze() {
+    this->ordered.clear();
+    for (Shard& shard : this->shards) {
+        for (auto& constant : shard.constants) {
+            this->ordered.push_back(&constant.second);
+        }
+    }
+
+    // Numbers first, then strings
+    std::sort(this->ordered.begin(), this->ordered.end(), [](const Constant* a, const Constant* b) {
+        if (a->data_type != b->data_type) {
+            return a->data_type < b->data_type;
+        }
+
+        if (a->data_type == DataType::NUMBER) {
+            if (a->number != b->number) {
+                return a->number < b->number;
+            }
+
+            // 0 and -0 are different constants
+            unsigned long long a_bits;
+            unsigned long long b_bits;
+            std::memcpy(&a_bits, &a->number, sizeof(double));
+            std::memcpy(&b_bits, &b->number, sizeof(double));
+            return a_bits < b_bits;
+        }
+
+        return a->text < b->text;
+    });
+
+    for (long long i = 0; i < static_cast<long long>(this->ordered.size()); i++) {
+        const_cast<Constant*>(this->ordered[i])->id = i;
+    }
+}
+
+static void write_words(std::ostream& out, const long long* words, const size_t count) {
+    out.write(reinterpret_cast<const char*>(words), count * sizeof(long long));
+}
+
+void ConstantPool::write(std::ostream& out) const {
+    long long header[2] = {CONSTANT_POOL_MAGIC, static_cast<long long>(this->ordered.size())};
+    write_words(out, header, 2);
+    for (const Constant* constant : this->ordered) {
+        if (constant->data_type == DataType::NUMBER) {
+            long long fields[2];
+            fields[0] = static_cast<long long>(DataType::NUMBER);
+            std::memcpy(&fields[1], &constant->number, sizeof(double));
+            write_words(out, fields, 2);
+        } else {
+            long long fields[2] = {static_cast<long long>(DataType::STRING), static_cast<long long>(constant->text.size())};
+            write_words(out, fields, 2);
+            out << constant->text;
+        }
+    }
+}
+
+long long ConstantPool::size() const {
+    return this->ordered.size();
+}
+
+static EncodedProgram encode_program(const std::vector<Instruction>& instructions, ConstantPool& pool) {
+    EncodedProgram program;
+    program.words.push_back(ARTIFACT_MAGIC);
+    program.words.push_back(instructions.size());
+    for (const Instruction& instruction : instructions) {
+        program.words.push_back(static_cast<long long>(instruction.instruction_type));
+        program.words.push_back(instruction.start_column);
+        program.words.push_back(instruction.start_row);
+        program.words.push_back(instruction.arguments.size());
+        for (const RuntimeValue* argument : instruction.arguments) {
+            program.constants.push_back({program.words.size(), pool.intern(argument)});
+            program.words.push_back(-1);
+            program.words.push_back(argument->start_column);
+            program.words.push_back(argument->start_line);
+        }
+    }
+
+    return program;
+}
+
+static std::string artifact_path(const std::filesystem::path& source, const std::filesystem::path& output) {
+    std::filesystem::path artifact = output / (source.is_absolute() ? source.relative_path() : source);
+    artifact.replace_extension(".elc");
+    return artifact.string();
+}
+
+std::vector<BatchFile> plan_batch(const std::string& input, const std::string& output) {
+    std::vector<std::string> sources;
+    std::vector<std::string> relative;
+    if (std::filesystem::is_directory(input)) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(input)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".elg") {
+                sources.push_back(entry.path().string());
+            }
+        }
+
+        std::sort(sources.begin(), sources.end());
+        for (const std::string& source : sources) {
+            relative.push_back(std::filesystem::path(source).lexically_relative(input).string());
+        }
+    } else {
+        std::ifstream list(input);
+        if (!list) {
+            throw std::runtime_error("Could not open " + input);
+        }
+
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+
+            if (!line.empty()) {
+                sources.push_back(line);
+                relative.push_back(line);
+            }
+        }
+    }
+
+    std::vector<BatchFile> files;
+    for (size_t i = 0; i < sources.size(); i++) {
+        files.push_back(BatchFile{sources[i], artifact_path(relative[i], output), 0, 0, 0, ""});
+    }
+
+    return files;
+}
+
+static double seconds_since(const std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs work(i) for every file, each thread taking the next file as soon as it is done with one
+static void for_each_file(const long long files, const long long threads, const std::function<void(long long)>& work) {
+    std::atomic<long long> next(0);
+    std::vector<std::thread> workers;
+    for (long long t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (long long i = next++; i < files; i = next++) {
+                work(i);
+            }
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+long long compile_batch(std::vector<BatchFile>& files, const std::string& output, long long threads) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    threads = std::max(1LL, std::min<long long>(threads, files.size()));
+
+    ConstantPool pool;
+    std::vector<EncodedProgram> programs(files.size());
+    for_each_file(files.size(), threads, [&](const long long i) {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            std::ifstream file(files[i].source, std::ios::binary);
+            if (!file) {
+                throw std::runtime_error("Could not open " + files[i].source);
+            }
+
+            std::stringstream ss;
+            ss << file.rdbuf();
+            std::vector<Instruction> instructions = compile_parallel(ss.str(), 1);
+            programs[i] = encode_program(instructions, pool);
+            files[i].instructions = instructions.size();
+            free_instructions(instructions);
+        } catch (const std::exception& error) {
+            files[i].error = error.what();
+        }
+
+        files[i].compile_seconds = seconds_since(start);
+    });
+
+    pool.freeze();
+
+    // Directories are created up front, so the writers never race to create the same one
+    std::set<std::filesystem::path> directories = {std::filesystem::path(output)};
+    for (const BatchFile& file : files) {
+        if (file.error.empty()) {
+            directories.insert(std::filesystem::path(file.artifact).parent_path());
+        }
+    }
+
+    for (const std::filesystem::path& directory : directories) {
+        if (!directory.empty()) {
+            std::filesystem::create_directories(directory);
+        }
+    }
+
+    for_each_file(files.size(), threads, [&](const long long i) {
+        if (!files[i].error.empty()) {
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        EncodedProgram& program = programs[i];
+        for (auto& constant : program.constants) {
+            program.words[constant.first] = constant.second->id;
+        }
+
+        std::ofstream artifact(files[i].artifact, std::ios::binary);
+        write_words(artifact, program.words.data(), program.words.size());
+        if (!artifact) {
+            files[i].error = "Could not write " + files[i].artifact;
+        }
+
+        program = EncodedProgram();
+        files[i].write_seconds = seconds_since(start);
+    });
+
+    std::string pool_path = (std::filesystem::path(output) / CONSTANT_POOL_FILE).string();
+    std::ofstream out(pool_path, std::ios::binary);
+    pool.write(out);
+    if (!out) {
+        throw std::runtime_error("Could not write " + pool_path);
+    }
+
+    return pool.size();
+}
+
+const long long BATCH_SUMMARY_SLOWEST = 5;
+
+void print_batch_summary(std::ostream& out, const std::vector<BatchFile>& files, const long long constants, const long long threads, const double seconds) {
+    long long failed = 0;
+    long long instructions = 0;
+    double compiling = 0;
+    double writing = 0;
+    for (const BatchFile& file : files) {
+        failed += file.error.empty() ? 0 : 1;
+        instructions += file.instructions;
+        compiling += file.compile_seconds;
+        writing += file.write_seconds;
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "compiled " << files.size() - failed << " of " << files.size() << " files (" << instructions << " instructions) in " << seconds << "s on " << threads << " threads\n";
+    out << "time spent compiling " << compiling << "s, writing " << writing << "s\n";
+    out << "constant pool: " << constants << " constants\n";
+
+    std::vector<const BatchFile*> slowest;
+    for (const BatchFile& file : files) {
+        slowest.push_back(&file);
+    }
+
+    long long shown = std::min<long long>(BATCH_SUMMARY_SLOWEST, slowest.size());
+    std::partial_sort(slowest.begin(), slowest.begin() + shown, slowest.end(), [](const BatchFile* a, const BatchFile* b) {
+        return a->compile_seconds + a->write_seconds > b->compile_seconds + b->write_seconds;
+    });
+
+    if (shown > 0) {
+        out << "slowest:\n";
+    }
+
+    for (long long i = 0; i < shown; i++) {
+        out << "  " << slowest[i]->source << " " << (slowest[i]->compile_seconds + slowest[i]->write_seconds) * 1000 << "ms\n";
+    }
+
+    for (const BatchFile& file : files) {
+        if (!file.error.empty()) {
+            out << "failed " << file.source << ": " << file.error << "\n";
+        }
+    }
+
+    out.unsetf(std::ios::fixed);
+}
+
+static void read_words(std::istream& in, long long* words, const size_t count, const std::string& path) {
+    if (!in.read(reinterpret_cast<char*>(words), count * sizeof(long long))) {
+        throw std::runtime_error("Truncated bytecode file " + path);
+    }
+}
+
+static std::vector<RuntimeValue*> read_constant_pool(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    long long header[2];
+    read_words(in, header, 2, path);
+    if (header[0] != CONSTANT_POOL_MAGIC || header[1] < 0) {
+        throw std::runtime_error(path + " is not a constant pool");
+    }
+
+    std::vector<RuntimeValue*> constants;
+    try {
+        for (long long i = 0; i < header[1]; i++) {
+            long long fields[2];
+            read_words(in, fields, 2, path);
+            if (fields[0] == static_cast<long long>(DataType::NUMBER)) {
+                double number;
+                std::memcpy(&number, &fields[1], sizeof(double));
+                constants.push_back(new Number(0, 0, number));
+            } else if (fields[0] == static_cast<long long>(DataType::STRING) && fields[1] >= 0) {
+                std::string text(fields[1], '\0');
+                if (!in.read(&text[0], fields[1])) {
+                    throw std::runtime_error("Truncated bytecode file " + path);
+                }
+
+                constants.push_back(new String(0, 0, std::move(text)));
+            } else {
+                throw std::runtime_error(path + " is not a constant pool");
+            }
+        }
+    } catch (...) {
+        for (RuntimeValue* constant : constants) {
+            delete constant;
+        }
+
+        throw;
+    }
+
+    return constants;
+}
+
+// The pool sits at the top of the output directory, artifacts may be in subdirectories of it
+static std::string find_constant_pool(const std::string& artifact) {
+    std::filesystem::path directory = std::filesystem::absolute(artifact).parent_path();
+    while (!std::filesystem::exists(directory / CONSTANT_POOL_FILE)) {
+        if (directory == directory.root_path() || directory.empty()) {
+            throw std::runtime_error("No " + CONSTANT_POOL_FILE + " found for " + artifact);
+        }
+
+        directory = directory.parent_path();
+    }
+
+    return (directory / CONSTANT_POOL_FILE).string();
+}
+
+// The operand types every instruction is written with, 'S' for a string and 'N' for a number. STOA and
+// STOAS are followed by any amount of steps, all numbers.
+static std::string operand_types(const InstructionType type) {
+    switch (type) {
+    case InstructionType::PUSH:
+        return "?";
+    case InstructionType::STOC:
+    case InstructionType::LODC:
+    case InstructionType::LODC_N:
+    case InstructionType::CALL:
+        return "SN";
+    case InstructionType::STOR:
+    case InstructionType::LODR:
+        return "SNSN";
+    case InstructionType::STOCS:
+    case InstructionType::LODCS:
+        return "SSN";
+    case InstructionType::STORS:
+    case InstructionType::LODRS:
+        return "SSNSN";
+    case InstructionType::STOF:
+        return "NSNN";
+    case InstructionType::STFR:
+        return "NSNSNN";
+    case InstructionType::LODF:
+        return "NSN";
+    case InstructionType::CNTF:
+        return "NSNSN";
+    case InstructionType::STOA:
+        return "SNSNN";
+    case InstructionType::STOAS:
+        return "SSNSNN";
+    default:
+        return "";
+    }
+}
+
+// Largest count of popped values an artifact may hold, every whole number up to it is a double
+const double ARTIFACT_COUNT_LIMIT = 1LL << 53;
+
+// An artifact is read back without the parser and interpolator that guarantee the shape of every
+// instruction, so the operands are checked before the VM trusts them
+static bool well_formed(const Instruction& instruction) {
+    InstructionType type = instruction.instruction_type;
+    std::string types = operand_types(type);
+    bool steps = type == InstructionType::STOA || type == InstructionType::STOAS;
+    long long amount = instruction.arguments.size();
+    if (steps ? amount < static_cast<long long>(types.size()) : amount != static_cast<long long>(types.size())) {
+        return false;
+    }
+
+    for (long long i = 0; i < amount; i++) {
+        DataType data_type = instruction.arguments[i]->data_type;
+        char expected = i < static_cast<long long>(types.size()) ? types[i] : 'N';
+        if ((expected == 'S' && data_type != DataType::STRING) || (expected == 'N' && data_type != DataType::NUMBER)) {
+            return false;
+        }
+    }
+
+    // Counts of popped values have to be whole and not negative
+    long long count_index = type == InstructionType::CALL ? 1 : steps ? types.size() - 1 : -1;
+    if (count_index >= 0) {
+        double count = static_cast<const Number*>(instruction.arguments[count_index])->value;
+        if (!(count >= 0 && count <= ARTIFACT_COUNT_LIMIT) || std::trunc(count) != count) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::vector<Instruction> load_artifact(const std::string& path) {
+    std::vector<RuntimeValue*> constants = read_constant_pool(find_constant_pool(path));
+    std::vector<Instruction> instructions;
+    try {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Could not open " + path);
+        }
+
+        long long header[2];
+        read_words(in, header, 2, path);
+        if (header[0] != ARTIFACT_MAGIC || header[1] < 0) {
+            throw std::runtime_error(path + " is not a bytecode artifact");
+        }
+
+        for (long long i = 0; i < header[1]; i++) {
+            long long fields[4];
+            read_words(in, fields, 4, path);
+            if (fields[0] < 0 || fields[0] > static_cast<long long>(InstructionType::STOAS) || fields[3] < 0) {
+                throw std::runtime_error(path + " is not a bytecode artifact");
+            }
+
+            instructions.push_back(Instruction{static_cast<InstructionType>(fields[0]), fields[1], fields[2], {}});
+            for (long long j = 0; j < fields[3]; j++) {
+                long long argument[3];
+                read_words(in, argument, 3, path);
+                if (argument[0] < 0 || argument[0] >= static_cast<long long>(constants.size())) {
+                    throw std::runtime_error(path + " refers to a constant its pool does not have");
+                }
+
+                RuntimeValue* value = copy_value(constants[argument[0]]);
+                value->start_column = argument[1];
+                value->start_line = argument[2];
+                instructions.back().arguments.push_back(value);
+            }
+
+            if (!well_formed(instructions.back())) {
+                throw std::runtime_error(path + " is not a bytecode artifact");
+            }
+        }
+    } catch (...) {
+        free_instructions(instructions);
+        for (RuntimeValue* constant : constants) {
+            delete constant;
+        }
+
+        throw;
+    }
+
+    for (RuntimeValue* constant : constants) {
+        delete constant;
+    }
+
+    return instructions;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "../interpolation/interpolation.hpp"
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#pragma once
+
+const long long CONSTANT_POOL_SHARDS = 16;
+
+// Artifacts and the pool are sequences of native long long words starting with one of these
+const long long ARTIFACT_MAGIC = 0x31434c45; // "ELC1"
+const long long CONSTANT_POOL_MAGIC = 0x31504c45; // "ELP1"
+
+// Written next to the artifacts of a batch, every artifact of the batch refers to it
+const std::string CONSTANT_POOL_FILE = "constants.pool";
+
+// A number or string shared by every artifact of a batch
+struct Constant {
+    DataType data_type;
+    double number;
+    std::string text;
+    long long id; // Assigned by ConstantPool::freeze
+};
+
+// The constants of a batch, interned from any number of threads. Every shard has its own lock, so
+// workers interning different constants rarely wait for each other. Ids are only handed out once
+// everything is interned, in sorted order, so the same sources always give the same bytes.
+class ConstantPool {
+public:
+    const Constant* intern(const RuntimeValue* value); // Stays valid as long as the pool
+    void freeze(); // Assigns the ids, nothing may be interned afterwards
+    void write(std::ostream& out) const;
+    long long size() const;
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Constant> constants; // Type and bytes of the value -> constant
+    };
+
+    Shard shards[CONSTANT_POOL_SHARDS];
+    std::vector<const Constant*> ordered; // By id, once frozen
+};
+
+// One source of a batch and what became of it
+struct BatchFile {
+    std::string source;
+    std::string artifact;
+    long long instructions;
+    double compile_seconds; // Reading, compiling and interning
+    double write_seconds;
+    std::string error; // Empty if the artifact was written
+};
+
+// The sources below a directory (every .elg file, sorted) or listed in a file (one path per line).
+// Every artifact goes to the same relative path under output, with an .elc extension.
+std::vector<BatchFile> plan_batch(const std::string& input, const std::string& output);
+
+// Compiles every file on a pool of threads sharing one constant pool, then writes the artifacts and
+// the pool to output. A file that fails to compile gets its error recorded, the others go on.
+// threads = 0 uses one thread per hardware thread. Returns the number of constants in the pool.
+long long compile_batch(std::vector<BatchFile>& files, const std::string& output, long long threads);
+
+void print_batch_summary(std::ostream& out, const std::vector<BatchFile>& files, const long long constants, const long long threads, const double seconds);
+
+// Loads an artifact written by compile_batch, the pool is looked for in its directory and the ones above
+std::vector<Instruction> load_artifact(const std::string& path);
\ No newline at end of file
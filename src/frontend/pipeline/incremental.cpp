@@ -0,0 +1,209 @@
+#include "incremental.hpp"
+#include "../lexer/lexer.hpp"
+#include "../parser/parser.hpp"
+#include "../parser/statements.hpp"
+#include "../interpolation/interpolation.hpp"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+static std::vector<std::string> split_lines(const std::string& source) {
+    std::vector<std::string> lines;
+    size_t begin = 0;
+    size_t newline = source.find('\n');
+    while (newline != std::string::npos) {
+        lines.push_back(source.substr(begin, newline - begin));
+        begin = newline + 1;
+        newline = source.find('\n', begin);
+    }
+
+    lines.push_back(source.substr(begin));
+    return lines;
+}
+
+static void shift_lines(Instruction& instruction, const long long delta) {
+    instruction.start_row += delta;
+    for (RuntimeValue* argument : instruction.arguments) {
+        if (argument->start_line != 0) {
+            argument->start_line += delta;
+        }
+    }
+}
+
+IncrementalCompiler::IncrementalCompiler() {
+    this->recompiled_lines = 0;
+}
+
+IncrementalCompiler::~IncrementalCompiler() {
+    for (CompiledLine& line : this->lines) {
+        this->free_line(line);
+    }
+
+    free_instructions(this->instructions);
+}
+
+void IncrementalCompiler::update(const std::string& source) {
+    std::vector<std::string> texts = split_lines(source);
+    long long old_size = this->lines.size();
+    long long new_size = texts.size();
+
+    std::vector<size_t> hashes(new_size);
+    for (long long i = 0; i < new_size; i++) {
+        hashes[i] = std::hash<std::string>()(texts[i]);
+    }
+
+    long long prefix = 0;
+    while (prefix < old_size && prefix < new_size && this->lines[prefix].hash == hashes[prefix] && this->lines[prefix].text == texts[prefix]) {
+        prefix++;
+    }
+
+    long long suffix = 0;
+    while (suffix < old_size - prefix && suffix < new_size - prefix && this->lines[old_size - 1 - suffix].hash == hashes[new_size - 1 - suffix] && this->lines[old_size - 1 - suffix].text == texts[new_size - 1 - suffix]) {
+        suffix++;
+    }
+
+    std::vector<std::string> changed(std::make_move_iterator(texts.begin() + prefix), std::make_move_iterator(texts.end() - suffix));
+    this->replace_lines(prefix, old_size - prefix - suffix, changed);
+}
+
+void IncrementalCompiler::edit_line(const long long line, const std::string& text) {
+    if (line < 1 || line > static_cast<long long>(this->lines.size())) {
+        this->throw_line_out_of_range(line);
+    }
+
+    if (this->lines[line - 1].hash == std::hash<std::string>()(text) && this->lines[line - 1].text == text) {
+        this->recompiled_lines = 0;
+        return;
+    }
+
+    this->replace_lines(line - 1, 1, {text});
+}
+
+const std::vector<Instruction>& IncrementalCompiler::get_instructions() const {
+    return this->instructions;
+}
+
+long long IncrementalCompiler::line_count() const {
+    return this->lines.size();
+}
+
+// Replaces target[start, start + removed) with replacement, only moving the tail when the sizes differ
+template <typename T>
+static void splice(std::vector<T>& target, const long long start, const long long removed, std::vector<T>& replacement) {
+    long long replaced = std::min<long long>(removed, replacement.size());
+    std::move(replacement.begin(), replacement.begin() + replaced, target.begin() + start);
+    if (removed > replaced) {
+        target.erase(target.begin() + start + replaced, target.begin() + start + removed);
+    } else {
+        target.insert(target.begin() + start + replaced, std::make_move_iterator(replacement.begin() + replaced), std::make_move_iterator(replacement.end()));
+    }
+}
+
+void IncrementalCompiler::replace_lines(const long long first, const long long removed, const std::vector<std::string>& texts) {
+    // Compile first so a syntax error leaves the previous state untouched
+    std::vector<CompiledLine> compiled;
+    std::vector<Instruction> spliced;
+    try {
+        for (long long i = 0; i < static_cast<long long>(texts.size()); i++) {
+            compiled.push_back(this->compile_line(texts[i], first + i + 1, spliced));
+        }
+    } catch (...) {
+        for (CompiledLine& line : compiled) {
+            this->free_line(line);
+        }
+
+        free_instructions(spliced);
+        throw;
+    }
+
+    long long instruction_start = first < static_cast<long long>(this->lines.size()) ? this->lines[first].instruction_start : this->instructions.size();
+    long long instruction_count = 0;
+    for (long long i = first; i < first + removed; i++) {
+        instruction_count += this->lines[i].instruction_count;
+        this->free_line(this->lines[i]);
+    }
+
+    for (long long i = instruction_start; i < instruction_start + instruction_count; i++) {
+        for (RuntimeValue* argument : this->instructions[i].arguments) {
+            delete argument;
+        }
+    }
+
+    long long offset = instruction_start;
+    for (CompiledLine& line : compiled) {
+        line.instruction_start = offset;
+        offset += line.instruction_count;
+    }
+
+    long long new_count = spliced.size();
+    splice(this->instructions, instruction_start, instruction_count, spliced);
+    splice(this->lines, first, removed, compiled);
+
+    // Everything after the edit moves by the difference in instructions and lines
+    long long instruction_delta = new_count - instruction_count;
+    long long line_delta = static_cast<long long>(texts.size()) - removed;
+    if (instruction_delta != 0) {
+        for (long long i = first + texts.size(); i < static_cast<long long>(this->lines.size()); i++) {
+            this->lines[i].instruction_start += instruction_delta;
+        }
+    }
+
+    if (line_delta != 0) {
+        for (long long i = instruction_start + new_count; i < static_cast<long long>(this->instructions.size()); i++) {
+            shift_lines(this->instructions[i], line_delta);
+        }
+    }
+
+    this->recompiled_lines = texts.size();
+}
+
+CompiledLine IncrementalCompiler::compile_line(const std::string& text, const long long line_number, std::vector<Instruction>& output) {
+    CompiledLine line;
+    line.hash = std::hash<std::string>()(text);
+    line.text = text;
+
+    Lexer lexer(line.text, 0, line.text.size(), line_number);
+    line.tokens = lexer.tokenize();
+
+    Parser parser(line.tokens);
+    Interpolator interpolator(nullptr);
+    try {
+        Statement* statement = parser.parse_next();
+        while (statement != nullptr) {
+            line.statements.push_back(statement);
+            interpolator.interpolate(statement);
+            statement = parser.parse_next();
+        }
+    } catch (...) {
+        this->free_line(line);
+        free_instructions(interpolator.instructions);
+        throw;
+    }
+
+    line.instruction_count = interpolator.instructions.size();
+    std::move(interpolator.instructions.begin(), interpolator.instructions.end(), std::back_inserter(output));
+    return line;
+}
+
+void IncrementalCompiler::free_line(CompiledLine& line) {
+    for (Statement* statement : line.statements) {
+        delete statement;
+    }
+
+    line.statements.clear();
+}
+
+void IncrementalCompiler::throw_line_out_of_range(const long long line) {
+    std::stringstream ss;
+    ss << "Line " << line << " is out of range, the source has " << this->lines.size() << " lines";
+    throw std::runtime_error(ss.str());
+}
+
+IncrementalCompiler* create_incremental_compiler() {
+    return new IncrementalCompiler();
+}
\ No newline at end of file
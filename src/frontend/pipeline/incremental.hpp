@@ -0,0 +1,44 @@
+#include "../lexer/lexer.hpp"
+#include "../parser/statements.hpp"
+#include "../interpolation/interpolation.hpp"
+#include <string>
+#include <vector>
+
+#pragma once
+
+// Statements never span lines, so a line is the unit of recompilation. Tokens and AST nodes keep the
+// positions the line had when it was compiled, only the instructions are moved along with later edits.
+struct CompiledLine {
+    size_t hash;
+    std::string text;
+    std::vector<Token> tokens;
+    std::vector<Statement*> statements;
+    long long instruction_start;
+    long long instruction_count;
+};
+
+// Keeps the compiled form of a source around and, when the source changes, only re-lexes, reparses
+// and re-interpolates the lines that differ. The new instructions are spliced into the stream in place.
+class IncrementalCompiler {
+public:
+    IncrementalCompiler();
+    ~IncrementalCompiler();
+
+    void update(const std::string& source); // Diffs the new source against the current one line by line
+    void edit_line(const long long line, const std::string& text); // Replaces a single line (1-based)
+
+    const std::vector<Instruction>& get_instructions() const;
+    long long line_count() const;
+    long long recompiled_lines; // Number of lines compiled by the last update
+private:
+    std::vector<CompiledLine> lines;
+    std::vector<Instruction> instructions;
+
+    void replace_lines(const long long first, const long long removed, const std::vector<std::string>& texts);
+    CompiledLine compile_line(const std::string& text, const long long line_number, std::vector<Instruction>& output);
+    void free_line(CompiledLine& line);
+
+    void throw_line_out_of_range(const long long line);
+};
+
+IncrementalCompiler* create_incremental_compiler();
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "pipeline.hpp"
+#include "../lexer/lexer.hpp"
+#include "../parser/parser.hpp"
+#include "../parser/statements.hpp"
+#include "../interpolation/interpolation.hpp"
+#include "../../vm/specialize.hpp"
+#include <algorithm>
+#include <exception>
+#include <istream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+void compile_streamed(std::istream& source, const InstructionSink& sink) {
+    Lexer lexer(source);
+    Parser parser(&lexer);
+    Interpolator interpolator(nullptr);
+
+    Statement* statement = parser.parse_next();
+    while (statement != nullptr) {
+        interpolator.interpolate(statement);
+        delete statement;
+
+        sink(interpolator.instructions);
+        free_instructions(interpolator.instructions);
+
+        statement = parser.parse_next();
+    }
+}
+
+static std::vector<Instruction> compile_chunk(const std::string& source, const size_t begin, const size_t end, const long long line) {
+    Lexer lexer(source, begin, end, line);
+    Parser parser(&lexer);
+    Interpolator interpolator(nullptr);
+
+    Statement* statement = parser.parse_next();
+    while (statement != nullptr) {
+        interpolator.interpolate(statement);
+        delete statement;
+
+        statement = parser.parse_next();
+    }
+
+    return std::move(interpolator.instructions);
+}
+
+std::vector<Instruction> compile_parallel(const std::string& source, long long threads) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    threads = std::min<long long>(threads, source.size() / PARALLEL_MIN_CHUNK_SIZE + 1);
+
+    // Chunk boundaries sit right after a newline, lines are counted so every chunk reports the
+    // same line numbers a serial compile would
+    std::vector<size_t> begins = {0};
+    std::vector<long long> lines = {1};
+    size_t chunk_size = source.size() / threads;
+    for (long long i = 1; i < threads; i++) {
+        size_t target = std::max<size_t>(begins.back(), i * chunk_size);
+        size_t newline = source.find('\n', target);
+        if (newline == std::string::npos) {
+            break;
+        }
+
+        lines.push_back(lines.back() + std::count(source.begin() + begins.back(), source.begin() + newline + 1, '\n'));
+        begins.push_back(newline + 1);
+    }
+
+    long long chunks = begins.size();
+    if (chunks == 1) {
+        // Not worth a thread, batch compiles call this for thousands of small files
+        std::vector<Instruction> instructions = compile_chunk(source, 0, source.size(), 1);
+        specialize_numbers(instructions);
+        return instructions;
+    }
+
+    std::vector<std::vector<Instruction>> results(chunks);
+    std::vector<std::exception_ptr> errors(chunks);
+    std::vector<std::thread> workers;
+    for (long long i = 0; i < chunks; i++) {
+        size_t end = i + 1 < chunks ? begins[i + 1] : source.size();
+        workers.emplace_back([&, i, end]() {
+            try {
+                results[i] = compile_chunk(source, begins[i], end, lines[i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    size_t total = 0;
+    for (long long i = 0; i < chunks; i++) {
+        if (errors[i] != nullptr) {
+            for (std::vector<Instruction>& result : results) {
+                free_instructions(result);
+            }
+
+            std::rethrow_exception(errors[i]);
+        }
+
+        total += results[i].size();
+    }
+
+    std::vector<Instruction> instructions = std::move(results[0]);
+    instructions.reserve(total);
+    for (long long i = 1; i < chunks; i++) {
+        std::move(results[i].begin(), results[i].end(), std::back_inserter(instructions));
+    }
+
+    specialize_numbers(instructions);
+    return instructions;
+}
+
+std::vector<Diagnostic> check_syntax(const std::string& source) {
+    Lexer lexer(source);
+    Parser parser(&lexer);
+    parser.recover = true;
+
+    Statement* statement = parser.parse_next();
+    while (statement != nullptr) {
+        delete statement;
+        statement = parser.parse_next();
+    }
+
+    return std::move(parser.diagnostics);
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "../interpolation/interpolation.hpp"
+#include "../parser/parser.hpp"
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+#pragma once
+
+// Receives the instructions of one top-level statement. Whatever is left in the list once the sink
+// returns is freed, so a sink that wants to keep instructions has to move them out.
+typedef std::function<void(std::vector<Instruction>& instructions)> InstructionSink;
+
+// Lexes, parses and interpolates the source one top-level statement at a time. Tokens go through a
+// small ring buffer and each statement's AST is freed as soon as it is interpolated, so memory use
+// does not grow with the size of the source.
+void compile_streamed(std::istream& source, const InstructionSink& sink);
+
+// Sources smaller than this are not worth splitting across threads
+const size_t PARALLEL_MIN_CHUNK_SIZE = 64 * 1024;
+
+// Splits the source into chunks at newlines (which always end a statement) and lexes, parses and
+// interpolates every chunk on its own thread. The instruction streams are concatenated in source
+// order, so the result is the same as compiling the whole source serially. threads = 0 uses one
+// thread per hardware thread. The result has been through specialize_numbers.
+std::vector<Instruction> compile_parallel(const std::string& source, long long threads);
+
+// Lexes and parses the whole source with error recovery and returns every error in it, without
+// compiling anything
+std::vector<Diagnostic> check_syntax(const std::string& source);
\ No newline at end of file
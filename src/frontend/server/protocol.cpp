@@ -0,0 +1,169 @@
+#include "protocol.hpp"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+const size_t CONNECTION_READ_SIZE = 64 * 1024;
+
+Connection::Connection(const int fd) {
+    this->fd = fd;
+    this->consumed = 0;
+}
+
+Connection::~Connection() {
+#ifndef _WIN32
+    close(this->fd);
+#endif
+}
+
+bool Connection::fill() {
+#ifndef _WIN32
+    if (this->consumed > 0) {
+        this->buffer.erase(0, this->consumed);
+        this->consumed = 0;
+    }
+
+    size_t size = this->buffer.size();
+    this->buffer.resize(size + CONNECTION_READ_SIZE);
+    ssize_t received;
+    do {
+        received = recv(this->fd, &this->buffer[size], CONNECTION_READ_SIZE, 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0) {
+        this->buffer.resize(size);
+        this->throw_socket_error("recv");
+    }
+
+    this->buffer.resize(size + received);
+    return received > 0;
+#else
+    this->throw_socket_error("recv");
+    return false;
+#endif
+}
+
+bool Connection::read_message(Message& message) {
+    size_t newline;
+    while ((newline = this->buffer.find('\n', this->consumed)) == std::string::npos) {
+        if (this->buffer.size() - this->consumed > MESSAGE_MAX_HEADER) {
+            this->throw_malformed_header(this->buffer.substr(this->consumed, MESSAGE_MAX_HEADER));
+        }
+
+        if (!this->fill()) {
+            if (this->buffer.size() > this->consumed) {
+                this->throw_malformed_header(this->buffer.substr(this->consumed));
+            }
+
+            return false;
+        }
+    }
+
+    std::string header = this->buffer.substr(this->consumed, newline - this->consumed);
+    this->consumed = newline + 1;
+
+    message.words.clear();
+    std::stringstream ss(header);
+    std::string word;
+    while (ss >> word) {
+        message.words.push_back(word);
+    }
+
+    if (message.words.empty() || message.words.back().find_first_not_of("0123456789") != std::string::npos) {
+        this->throw_malformed_header(header);
+    }
+
+    // Checked digit by digit, a length too large for stoull is just as much too large
+    const std::string& digits = message.words.back();
+    size_t length = 0;
+    for (char digit : digits) {
+        length = length * 10 + (digit - '0');
+        if (length > MESSAGE_MAX_PAYLOAD) {
+            this->throw_payload_too_large(header);
+        }
+    }
+
+    message.words.pop_back();
+    if (message.words.empty()) {
+        this->throw_malformed_header(header);
+    }
+
+    while (this->buffer.size() - this->consumed < length) {
+        if (!this->fill()) {
+            this->throw_malformed_header(header);
+        }
+    }
+
+    message.payload = this->buffer.substr(this->consumed, length);
+    this->consumed += length;
+    return true;
+}
+
+void Connection::write_message(const std::vector<std::string>& words, const std::string& payload) {
+    std::string data;
+    for (const std::string& word : words) {
+        data += word;
+        data += ' ';
+    }
+
+    data += std::to_string(payload.size());
+    data += '\n';
+    data += payload;
+    this->write_all(data);
+}
+
+void Connection::write_all(const std::string& data) {
+#ifndef _WIN32
+    // MSG_NOSIGNAL: a client that went away is an error for this connection, not a SIGPIPE for the process
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t written = send(this->fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            this->throw_socket_error("send");
+        }
+
+        sent += written;
+    }
+#else
+    (void)data;
+    this->throw_socket_error("send");
+#endif
+}
+
+void Connection::throw_malformed_header(const std::string& header) {
+    std::stringstream ss;
+    ss << "Malformed message header '" << header << "', expected words followed by the payload length";
+    throw std::runtime_error(ss.str());
+}
+
+void Connection::throw_payload_too_large(const std::string& header) {
+    std::stringstream ss;
+    ss << "Payload of message '" << header << "' is larger than the limit of " << MESSAGE_MAX_PAYLOAD << " bytes";
+    throw std::runtime_error(ss.str());
+}
+
+void Connection::throw_socket_error(const std::string& operation) {
+    std::stringstream ss;
+#ifndef _WIN32
+    ss << "Socket " << operation << " failed: " << std::strerror(errno);
+#else
+    ss << "Socket " << operation << " is not supported on this platform";
+#endif
+    throw std::runtime_error(ss.str());
+}
+
+Connection* create_connection(const int fd) {
+    return new Connection(fd);
+}
\ No newline at end of file
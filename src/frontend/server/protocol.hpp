@@ -0,0 +1,43 @@
+#include <string>
+#include <vector>
+
+#pragma once
+
+// Every message, in either direction, is one header line of space separated words whose last word is
+// the length of the payload that follows it:
+//
+//     RUN Sheet1 24\n<24 bytes of source>
+//     OK 11\nA1 = 42\n...
+//
+// so sources and results can contain anything, newlines included.
+
+const size_t MESSAGE_MAX_HEADER = 4096; // Bytes of a header line, without the newline
+const size_t MESSAGE_MAX_PAYLOAD = 256 * 1024 * 1024; // Larger payloads are rejected before any of them is read
+struct Message {
+    std::vector<std::string> words; // The header without the payload length
+    std::string payload;
+};
+
+// A connected socket. Reads are buffered, so a connection can only be read through one Connection.
+class Connection {
+public:
+    explicit Connection(const int fd);
+    ~Connection(); // Closes the socket
+
+    bool read_message(Message& message); // Returns false once the other side has closed the connection
+    void write_message(const std::vector<std::string>& words, const std::string& payload);
+private:
+    int fd;
+    std::string buffer;
+    size_t consumed; // Bytes of buffer already handed out
+
+    bool fill(); // Reads more bytes into the buffer, false on end of stream
+    void write_all(const std::string& data);
+
+    // Errors
+    void throw_malformed_header(const std::string& header);
+    void throw_payload_too_large(const std::string& header);
+    void throw_socket_error(const std::string& operation);
+};
+
+Connection* create_connection(const int fd);
\ No newline at end of file
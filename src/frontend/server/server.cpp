@@ -0,0 +1,402 @@
+#include "server.hpp"
+#include "protocol.hpp"
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+Document::Document() {
+    this->compiler = create_incremental_compiler();
+    this->scope = new Scope();
+    this->vm = nullptr;
+    this->source_known = false;
+    this->runs = 0;
+}
+
+Document::~Document() {
+    // The VM refers to the compiler's instructions, so it goes first
+    delete this->vm;
+    delete this->compiler;
+    delete this->scope;
+}
+
+Server::Server(const std::string& path) {
+    this->path = path;
+    this->listener = -1;
+    this->requests = 0;
+    this->stopping = false;
+}
+
+Server::~Server() {
+#ifndef _WIN32
+    if (this->listener >= 0) {
+        close(this->listener);
+        unlink(this->path.c_str());
+    }
+#endif
+}
+
+void Server::listen_on_socket() {
+#ifndef _WIN32
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (this->path.size() >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        this->throw_socket_error("bind");
+    }
+
+    std::memcpy(address.sun_path, this->path.c_str(), this->path.size());
+
+    this->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->listener < 0) {
+        this->throw_socket_error("socket");
+    }
+
+    // A socket file left behind by a server that did not shut down cleanly would make bind fail. It is
+    // only stale if nothing accepts connections on it anymore, a running server keeps its socket.
+    struct stat status;
+    if (stat(this->path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool refused = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 && errno == ECONNREFUSED;
+        if (probe >= 0) {
+            close(probe);
+        }
+
+        if (refused) {
+            unlink(this->path.c_str());
+        }
+    }
+
+    if (bind(this->listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(this->listener);
+        this->listener = -1;
+        this->throw_socket_error("bind");
+    }
+
+    if (listen(this->listener, SERVER_BACKLOG) < 0) {
+        this->throw_socket_error("listen");
+    }
+#else
+    this->throw_socket_error("socket");
+#endif
+}
+
+void Server::serve() {
+    this->listen_on_socket();
+#ifndef _WIN32
+    while (!this->stopping.load()) {
+        int fd = accept(this->listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            if (this->stopping.load()) {
+                break;
+            }
+
+            int error = errno;
+            this->stop();
+            this->join_connections(true);
+            errno = error;
+            this->throw_socket_error("accept");
+        }
+
+        this->join_connections(false);
+        std::lock_guard<std::mutex> lock(this->connections_mutex);
+        if (this->stopping.load()) {
+            // stop() already shut the other connections down, this one would be missed
+            close(fd);
+            break;
+        }
+
+        Connection* connection = create_connection(fd);
+        this->connection_fds.insert(fd);
+        std::thread thread([this, connection, fd]() {
+            this->handle_connection(connection, fd);
+        });
+        this->threads.emplace(thread.get_id(), std::move(thread));
+    }
+
+    // Requests still running finish first, their replies fail on the shut down sockets
+    this->join_connections(true);
+#endif
+}
+
+void Server::stop() {
+#ifndef _WIN32
+    // Wakes up the accept in serve() and every connection blocked reading its next message
+    std::lock_guard<std::mutex> lock(this->connections_mutex);
+    this->stopping.store(true);
+    shutdown(this->listener, SHUT_RDWR);
+    for (int fd : this->connection_fds) {
+        shutdown(fd, SHUT_RDWR);
+    }
+#endif
+}
+
+void Server::join_connections(const bool all) {
+    std::vector<std::thread> joinable;
+    {
+        std::lock_guard<std::mutex> lock(this->connections_mutex);
+        if (all) {
+            for (auto& thread : this->threads) {
+                joinable.push_back(std::move(thread.second));
+            }
+
+            this->threads.clear();
+        } else {
+            for (const std::thread::id& id : this->finished) {
+                joinable.push_back(std::move(this->threads.at(id)));
+                this->threads.erase(id);
+            }
+        }
+
+        this->finished.clear();
+    }
+
+    for (std::thread& thread : joinable) {
+        thread.join();
+    }
+}
+
+void Server::handle_connection(Connection* connection, const int fd) {
+    try {
+        Message message;
+        while (connection->read_message(message)) {
+            this->requests++;
+            std::stringstream reply;
+            try {
+                this->handle_message(message, reply);
+            } catch (const std::exception& e) {
+                connection->write_message({"ERROR"}, e.what());
+                continue;
+            }
+
+            connection->write_message({"OK"}, reply.str());
+            if (message.words[0] == "SHUTDOWN") {
+                this->stop();
+                break;
+            }
+        }
+    } catch (const std::exception& e) {
+        // A malformed message or a broken socket only ends this connection
+    }
+
+    // The fd leaves the set before it is closed, so stop() never shuts down a reused fd
+    {
+        std::lock_guard<std::mutex> lock(this->connections_mutex);
+        this->connection_fds.erase(fd);
+        this->finished.push_back(std::this_thread::get_id());
+    }
+
+    delete connection;
+}
+
+void Server::handle_message(const Message& message, std::ostream& reply) {
+    const std::string& command = message.words[0];
+    if (command == "SHUTDOWN") {
+        this->expect_arguments(message, 0);
+        return;
+    }
+
+    if (command == "RUN") {
+        this->expect_arguments(message, 1);
+        std::shared_ptr<Document> document = this->find_document(message.words[1], true);
+        std::lock_guard<std::mutex> lock(document->mutex);
+        if (!document->source_known || document->source != message.payload) {
+            // A syntax error leaves the compiled program as it was, so the old VM stays valid then
+            document->compiler->update(message.payload);
+            document->source = message.payload;
+            document->source_known = true;
+            delete document->vm;
+            document->vm = nullptr;
+        }
+
+        this->run_document(*document, reply);
+        return;
+    }
+
+    if (command == "EDIT") {
+        this->expect_arguments(message, 2);
+        std::shared_ptr<Document> document = this->find_document(message.words[1], false);
+        std::lock_guard<std::mutex> lock(document->mutex);
+        if (message.words[2].find_first_not_of("0123456789") != std::string::npos) {
+            this->throw_not_a_line(message.words[2]);
+        }
+
+        long long line = std::stoll(message.words[2]);
+        std::string text = message.payload;
+        if (!text.empty() && text.back() == '\n') {
+            text.pop_back();
+        }
+
+        document->compiler->edit_line(line, text);
+        if (document->compiler->recompiled_lines != 0) {
+            document->source_known = false;
+            delete document->vm;
+            document->vm = nullptr;
+        }
+
+        this->run_document(*document, reply);
+        return;
+    }
+
+    if (command == "GET") {
+        this->expect_arguments(message, 1);
+        std::shared_ptr<Document> document = this->find_document(message.words[1], false);
+        std::lock_guard<std::mutex> lock(document->mutex);
+        std::stringstream list(message.payload);
+        std::string cell;
+        while (std::getline(list, cell, ',')) {
+            while (!cell.empty() && std::isspace(static_cast<unsigned char>(cell.back()))) {
+                cell.pop_back();
+            }
+
+            size_t digits = cell.find_first_of("0123456789");
+            if (digits == 0 || digits == std::string::npos || cell.find_first_not_of("0123456789", digits) != std::string::npos) {
+                this->throw_not_a_cell(cell);
+            }
+
+            RuntimeValue* value = document->scope->retrieve(0, 0, column_to_ord(cell.substr(0, digits)), std::stoll(cell.substr(digits)));
+            reply << cell << " = " << std::setprecision(15);
+            if (value->data_type == DataType::NUMBER) {
+                reply << static_cast<Number*>(value)->value << "\n";
+            } else {
+                reply << std::quoted(static_cast<String*>(value)->value) << "\n";
+            }
+
+            delete value;
+        }
+
+        return;
+    }
+
+    if (command == "DUMP") {
+        this->expect_arguments(message, 1);
+        std::shared_ptr<Document> document = this->find_document(message.words[1], false);
+        std::lock_guard<std::mutex> lock(document->mutex);
+        document->scope->dump(reply);
+        return;
+    }
+
+    if (command == "STATS") {
+        this->expect_arguments(message, 1);
+        std::shared_ptr<Document> document = this->find_document(message.words[1], false);
+        std::lock_guard<std::mutex> lock(document->mutex);
+        reply << "lines: " << document->compiler->line_count() << "\n";
+        reply << "instructions: " << document->compiler->get_instructions().size() << "\n";
+        reply << "recompiled lines: " << document->compiler->recompiled_lines << "\n";
+        reply << "runs: " << document->runs << "\n";
+        if (document->vm != nullptr) {
+            document->vm->print_stats(reply);
+        }
+
+        return;
+    }
+
+    if (command == "DROP") {
+        this->expect_arguments(message, 1);
+        std::lock_guard<std::mutex> lock(this->documents_mutex);
+        if (this->documents.erase(message.words[1]) == 0) {
+            this->throw_unknown_document(message.words[1]);
+        }
+
+        return;
+    }
+
+    this->throw_unknown_command(message);
+}
+
+std::shared_ptr<Document> Server::find_document(const std::string& name, const bool create) {
+    std::lock_guard<std::mutex> lock(this->documents_mutex);
+    auto it = this->documents.find(name);
+    if (it != this->documents.end()) {
+        return it->second;
+    }
+
+    if (!create) {
+        this->throw_unknown_document(name);
+    }
+
+    std::shared_ptr<Document> document = std::make_shared<Document>();
+    this->documents[name] = document;
+    return document;
+}
+
+void Server::run_document(Document& document, std::ostream& out) {
+    if (document.vm == nullptr) {
+        document.vm = create_vm(document.compiler->get_instructions(), document.scope);
+    }
+
+    // Every run starts from an empty sheet, like a fresh --run would
+    document.scope->clear();
+    document.vm->run();
+    document.runs++;
+    document.scope->dump(out);
+}
+
+void Server::expect_arguments(const Message& message, const size_t count) {
+    if (message.words.size() != count + 1) {
+        this->throw_wrong_argument_count(message, count);
+    }
+}
+
+void Server::throw_unknown_command(const Message& message) {
+    std::stringstream ss;
+    ss << "Unknown command '" << message.words[0] << "', expected RUN, EDIT, GET, DUMP, STATS, DROP or SHUTDOWN";
+    throw std::runtime_error(ss.str());
+}
+
+void Server::throw_wrong_argument_count(const Message& message, const size_t expected) {
+    std::stringstream ss;
+    ss << message.words[0] << " takes " << expected << " argument" << (expected == 1 ? "" : "s") << ", got " << message.words.size() - 1;
+    throw std::runtime_error(ss.str());
+}
+
+void Server::throw_unknown_document(const std::string& name) {
+    std::stringstream ss;
+    ss << "Unknown document '" << name << "', RUN it first";
+    throw std::runtime_error(ss.str());
+}
+
+void Server::throw_not_a_cell(const std::string& cell) {
+    std::stringstream ss;
+    ss << "'" << cell << "' is not a cell";
+    throw std::runtime_error(ss.str());
+}
+
+void Server::throw_not_a_line(const std::string& line) {
+    std::stringstream ss;
+    ss << "'" << line << "' is not a line number";
+    throw std::runtime_error(ss.str());
+}
+
+void Server::throw_socket_error(const std::string& operation) {
+    std::stringstream ss;
+#ifndef _WIN32
+    ss << "Socket " << operation << " on " << this->path << " failed: " << std::strerror(errno);
+#else
+    ss << "Unix domain sockets are not supported on this platform, cannot " << operation << " " << this->path;
+#endif
+    throw std::runtime_error(ss.str());
+}
+
+Server* create_server(const std::string& path) {
+    return new Server(path);
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "protocol.hpp"
+#include "../pipeline/incremental.hpp"
+#include "../../vm/vm.hpp"
+
+#pragma once
+
+const long long SERVER_BACKLOG = 64; // Connections the kernel queues while the server is busy accepting
+
+// A named program the server keeps compiled, together with the sheet its last run left behind
+struct Document {
+    Document();
+    ~Document();
+
+    std::mutex mutex; // Held for every request on the document
+    IncrementalCompiler* compiler;
+    Scope* scope;
+    VM* vm; // Built for the current instructions, nullptr whenever they changed since
+    std::string source; // Source of the last RUN, only meaningful while source_known
+    bool source_known; // False after an EDIT, the next RUN diffs against the compiler's lines instead
+    long long runs;
+};
+
+// A long-running evaluator listening on a Unix domain socket. Clients send whole programs (RUN) or
+// single line edits (EDIT) for named documents, the server recompiles only the lines that changed,
+// reruns the program and streams the sheet back. Programs, their JIT-compiled blocks and call caches
+// stay warm between requests, so a client that resends the same program pays for nothing but the run.
+// Every run starts from an empty sheet like a fresh --run, what stays resident is the sheet the last
+// run left behind, which GET and DUMP read without running anything. Each connection is served on its
+// own thread, requests on different documents run in parallel.
+//
+// Requests, one per message (see protocol.hpp):
+//     RUN <document>          payload: the source             reply: the sheet
+//     EDIT <document> <line>  payload: the new line           reply: the sheet
+//     GET <document>          payload: cells, like A1,B2      reply: one "A1 = value" line per cell
+//     DUMP <document>                                         reply: the sheet
+//     STATS <document>                                        reply: compiler and VM statistics
+//     DROP <document>
+//     SHUTDOWN                                                stops accepting connections
+// Replies are OK with the result or ERROR with the message of the exception the request raised.
+class Server {
+public:
+    explicit Server(const std::string& path);
+    ~Server(); // Removes the socket file
+    void serve(); // Accepts connections until a client sends SHUTDOWN, returns once every connection ended
+
+    std::atomic<long long> requests;
+private:
+    std::string path;
+    int listener;
+    std::atomic<bool> stopping;
+    std::mutex documents_mutex; // Guards the map, not the documents
+    std::unordered_map<std::string, std::shared_ptr<Document>> documents;
+    std::mutex connections_mutex; // Guards the fields below
+    std::unordered_set<int> connection_fds; // Sockets of the connections being served, shut down by stop()
+    std::unordered_map<std::thread::id, std::thread> threads; // One per connection, joined by serve()
+    std::vector<std::thread::id> finished; // Threads whose connection ended and that can be joined
+
+    void listen_on_socket();
+    void handle_connection(Connection* connection, const int fd);
+    void join_connections(const bool all); // Joins the finished threads, or every thread
+    void handle_message(const Message& message, std::ostream& reply);
+    std::shared_ptr<Document> find_document(const std::string& name, const bool create);
+    void run_document(Document& document, std::ostream& out);
+    void stop();
+    void expect_arguments(const Message& message, const size_t count); // count does not include the command
+
+    // Errors
+    void throw_unknown_command(const Message& message);
+    void throw_wrong_argument_count(const Message& message, const size_t expected);
+    void throw_unknown_document(const std::string& name);
+    void throw_not_a_cell(const std::string& cell);
+    void throw_not_a_line(const std::string& line);
+    void throw_socket_error(const std::string& operation);
+};
+
+Server* create_server(const std::string& path);
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "excellang.hpp"
+#include "../frontend/pipeline/pipeline.hpp"
+#include "../vm/vm.hpp"
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+Program::Program(std::vector<Instruction> instructions) {
+    this->instructions = std::move(instructions);
+}
+
+Program::~Program() {
+    free_instructions(this->instructions);
+}
+
+const std::vector<Instruction>& Program::get_instructions() const {
+    return this->instructions;
+}
+
+Program* compile_program(const std::string& source, const long long threads) {
+    return new Program(compile_parallel(source, threads));
+}
+
+Sheet::Sheet() {
+    this->scope = new Scope();
+}
+
+Sheet::~Sheet() {
+    delete this->scope;
+}
+
+// Splits "A1" into its column and row, false if the text is not a cell
+static bool parse_cell(const std::string& cell, long long& column, long long& row) {
+    size_t digits = cell.find_first_of("0123456789");
+    if (digits == 0 || digits == std::string::npos || cell.find_first_not_of("0123456789", digits) != std::string::npos) {
+        return false;
+    }
+
+    for (size_t i = 0; i < digits; i++) {
+        if (!std::isalpha(static_cast<unsigned char>(cell[i]))) {
+            return false;
+        }
+    }
+
+    column = column_to_ord(cell.substr(0, digits));
+    row = std::stoll(cell.substr(digits));
+    return true;
+}
+
+void Sheet::set_number(const std::string& cell, const double value) {
+    long long column, row;
+    if (!parse_cell(cell, column, row)) {
+        this->throw_not_a_cell(cell);
+    }
+
+    this->scope->assign_number(cell_key(column, row), value);
+}
+
+void Sheet::set_text(const std::string& cell, const std::string& text) {
+    long long column, row;
+    if (!parse_cell(cell, column, row)) {
+        this->throw_not_a_cell(cell);
+    }
+
+    this->scope->assign_cell(column, row, new String(0, 0, text));
+}
+
+void Sheet::erase(const std::string& cell) {
+    long long column, row;
+    if (!parse_cell(cell, column, row)) {
+        this->throw_not_a_cell(cell);
+    }
+
+    this->scope->erase_cell(column, row);
+}
+
+bool Sheet::get(const std::string& cell, CellValue& value) const {
+    long long column, row;
+    if (!parse_cell(cell, column, row)) {
+        this->throw_not_a_cell(cell);
+    }
+
+    return this->get(column, row, value);
+}
+
+bool Sheet::get(const long long column, const long long row, CellValue& value) const {
+    long long key = cell_key(column, row);
+    value.column = column;
+    value.row = row;
+    switch (this->scope->retrieve_type(key)) {
+    case CellType::EMPTY:
+        return false;
+    case CellType::NUMBER:
+        value.data_type = DataType::NUMBER;
+        this->scope->retrieve_number(key, value.number);
+        value.text.clear();
+        return true;
+    case CellType::STRING: {
+        RuntimeValue* text = this->scope->retrieve(0, 0, column, row);
+        value.data_type = DataType::STRING;
+        value.number = 0;
+        value.text = static_cast<String*>(text)->value;
+        delete text;
+        return true;
+    }
+    }
+
+    return false;
+}
+
+std::vector<CellValue> Sheet::cells() const {
+    std::vector<long long> keys = this->scope->assigned_cells();
+    std::vector<CellValue> values(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        this->get(keys[i] >> 40, keys[i] & MAX_ROW, values[i]);
+    }
+
+    return values;
+}
+
+void Sheet::clear() {
+    this->scope->clear();
+}
+
+void Sheet::set_memory_budget(const std::string& spill_path, const long long bytes) {
+    this->scope->set_memory_budget(spill_path, bytes);
+}
+
+void Sheet::set_sum_index(const bool enabled) {
+    this->scope->set_sum_index(enabled);
+}
+
+void Sheet::throw_not_a_cell(const std::string& cell) const {
+    std::stringstream ss;
+    ss << "'" << cell << "' is not a cell";
+    throw std::runtime_error(ss.str());
+}
+
+Sheet* create_sheet() {
+    return new Sheet();
+}
+
+Evaluator::Evaluator(const Program* program) {
+    this->idle_scope = new Scope();
+    this->vm = create_vm(program->get_instructions(), this->idle_scope);
+}
+
+Evaluator::~Evaluator() {
+    delete this->vm;
+    delete this->idle_scope;
+}
+
+void Evaluator::run(Sheet& sheet) {
+    // The VM is pointed back at its own sheet afterwards, so it never holds on to one it does not own
+    this->vm->set_scope(sheet.scope);
+    try {
+        this->vm->run();
+    } catch (...) {
+        this->vm->set_scope(this->idle_scope);
+        throw;
+    }
+
+    this->vm->set_scope(this->idle_scope);
+}
+
+void Evaluator::set_jit_enabled(const bool enabled) {
+    this->vm->set_jit_enabled(enabled);
+}
+
+Evaluator* create_evaluator(const Program* program) {
+    return new Evaluator(program);
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include <string>
+#include <vector>
+#include "../frontend/interpolation/interpolation.hpp"
+#include "../vm/vm.hpp"
+
+#pragma once
+
+// The embedding API of libexcellang. A program is compiled once into a Program, which never changes
+// afterwards and can be run by any number of threads at the same time. Each thread runs it through
+// its own Evaluator against whichever Sheets it likes, and reads the results back as CellValues.
+//
+//     Program* program = compile_program("A1 = B1 * 2");
+//     Evaluator evaluator(program);      // one per thread
+//     Sheet sheet;
+//     sheet.set_number("B1", 21);
+//     evaluator.run(sheet);
+//     CellValue value;
+//     sheet.get("A1", value);             // value.number == 42
+//
+// Errors, in compiling as well as in running, are thrown as std::runtime_error.
+
+// The value of one cell, copied out of the sheet
+struct CellValue {
+    long long column;
+    long long row;
+    DataType data_type;
+    double number; // Only for NUMBER
+    std::string text; // Only for STRING
+};
+
+// Compiled instructions. Lexing, parsing and interpolation all happen in compile_program.
+class Program {
+public:
+    explicit Program(std::vector<Instruction> instructions);
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+    ~Program();
+    const std::vector<Instruction>& get_instructions() const;
+private:
+    std::vector<Instruction> instructions;
+};
+
+// threads = 0 compiles large sources on one thread per hardware thread
+Program* compile_program(const std::string& source, const long long threads = 1);
+
+// The cells of one sheet. Inputs can be set before a run, a run leaves its results next to them.
+class Sheet {
+public:
+    Sheet();
+    Sheet(const Sheet&) = delete;
+    Sheet& operator=(const Sheet&) = delete;
+    ~Sheet();
+    void set_number(const std::string& cell, const double value);
+    void set_text(const std::string& cell, const std::string& text);
+    void erase(const std::string& cell); // Makes the cell empty again
+    bool get(const std::string& cell, CellValue& value) const; // Returns false for an empty cell
+    bool get(const long long column, const long long row, CellValue& value) const;
+    std::vector<CellValue> cells() const; // Every non-empty cell in column-major order
+    void clear();
+    void set_memory_budget(const std::string& spill_path, const long long bytes); // Tiles beyond bytes are paged out to a file at spill_path
+    void set_sum_index(const bool enabled); // Answers SUM, COUNT and AVERAGE over ranges of the sheet from prefix sums
+
+    Scope* scope;
+private:
+    // Errors
+    void throw_not_a_cell(const std::string& cell) const;
+};
+
+Sheet* create_sheet();
+
+// Runs one program. The VM inside keeps its compiled blocks and call cache between runs, which is
+// also why an Evaluator must only be used by one thread at a time.
+class Evaluator {
+public:
+    explicit Evaluator(const Program* program);
+    Evaluator(const Evaluator&) = delete;
+    Evaluator& operator=(const Evaluator&) = delete;
+    ~Evaluator();
+    void run(Sheet& sheet);
+    void set_jit_enabled(const bool enabled);
+private:
+    VM* vm;
+    Scope* idle_scope; // The VM needs a sheet between runs
+};
+
+Evaluator* create_evaluator(const Program* program);
\ No newline at end of file
@@ -0,0 +1,362 @@
+#include "array.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A value the program works on: a range shaped like the target, or a scalar
+struct ArrayOperand {
+    const Range* range; // nullptr for scalars
+    double number;
+    bool text; // The scalar is a string, plain copies only
+    std::string string;
+    std::vector<double> block; // ARRAY_BLOCK_ROWS values of the range for the current block, empty cells are 0
+};
+
+// An entry of the evaluation stack, a block of values or a scalar where values is nullptr
+struct ArrayValue {
+    double* values;
+    double scalar;
+};
+
+// A computed block of one column, waiting to be written
+struct ArrayBlock {
+    long long column;
+    long long row;
+    std::vector<double> numbers;
+    std::vector<std::pair<long long, std::string>> texts; // Index into the block -> string, plain copies only
+};
+
+static void throw_not_a_number(const Instruction& instruction, const RuntimeValue* value) {
+    std::stringstream ss;
+    ss << "Value from " << value->start_column << ":" << value->start_line << " used by the instruction at " << instruction.start_column << ":" << instruction.start_row << " is not a number";
+    throw std::runtime_error(ss.str());
+}
+
+static void throw_malformed_array_formula(const Instruction& instruction) {
+    std::stringstream ss;
+    ss << "Array formula at " << instruction.start_column << ":" << instruction.start_row << " does not match its operands";
+    throw std::runtime_error(ss.str());
+}
+
+// Every step has what it pops and the program uses up all operands, leaving one result
+static void check_steps(const Instruction& instruction, const std::vector<ArrayStep>& steps, const long long operand_amount) {
+    long long depth = 0;
+    long long used = 0;
+    for (ArrayStep step : steps) {
+        long long pops = step == ArrayStep::OPERAND ? 0 : step == ArrayStep::UPLUS || step == ArrayStep::UMINUS ? 1 : 2;
+        if (depth < pops || step < ArrayStep::OPERAND || step > ArrayStep::UMINUS) {
+            throw_malformed_array_formula(instruction);
+        }
+
+        used += step == ArrayStep::OPERAND ? 1 : 0;
+        depth += step == ArrayStep::OPERAND ? 1 : 1 - pops;
+    }
+
+    if (depth != 1 || used != operand_amount) {
+        throw_malformed_array_formula(instruction);
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(_WIN32)
+#define ARRAY_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define ARRAY_KERNEL
+#endif
+
+// Kernels always work on a whole block, lhs = lhs op rhs where one side may be a scalar. Rows past the
+// end of a short block are computed too and never written.
+#ifdef __GNUC__
+// Unaligned 4-double vector, becomes one ymm register with AVX2 and two xmm registers otherwise
+typedef double block_vector __attribute__((vector_size(32), aligned(8)));
+const long long BLOCK_VECTOR_WIDTH = 4;
+static_assert(ARRAY_BLOCK_ROWS % BLOCK_VECTOR_WIDTH == 0, "Blocks have to be whole vectors");
+
+#define BLOCK_KERNELS(name, op) \
+    ARRAY_KERNEL static void name(double* lhs, const double* rhs) { \
+        for (long long i = 0; i < ARRAY_BLOCK_ROWS; i += BLOCK_VECTOR_WIDTH) { \
+            block_vector a; \
+            block_vector b; \
+            std::memcpy(&a, lhs + i, sizeof(a)); \
+            std::memcpy(&b, rhs + i, sizeof(b)); \
+            a = a op b; \
+            std::memcpy(lhs + i, &a, sizeof(a)); \
+        } \
+    } \
+    ARRAY_KERNEL static void name##_scalar(double* lhs, const double rhs) { \
+        block_vector b = {rhs, rhs, rhs, rhs}; \
+        for (long long i = 0; i < ARRAY_BLOCK_ROWS; i += BLOCK_VECTOR_WIDTH) { \
+            block_vector a; \
+            std::memcpy(&a, lhs + i, sizeof(a)); \
+            a = a op b; \
+            std::memcpy(lhs + i, &a, sizeof(a)); \
+        } \
+    } \
+    ARRAY_KERNEL static void scalar_##name(const double lhs, double* rhs) { \
+        block_vector a = {lhs, lhs, lhs, lhs}; \
+        for (long long i = 0; i < ARRAY_BLOCK_ROWS; i += BLOCK_VECTOR_WIDTH) { \
+            block_vector b; \
+            std::memcpy(&b, rhs + i, sizeof(b)); \
+            b = a op b; \
+            std::memcpy(rhs + i, &b, sizeof(b)); \
+        } \
+    }
+#else
+#define BLOCK_KERNELS(name, op) \
+    static void name(double* lhs, const double* rhs) { \
+        for (long long i = 0; i < ARRAY_BLOCK_ROWS; i++) { \
+            lhs[i] = lhs[i] op rhs[i]; \
+        } \
+    } \
+    static void name##_scalar(double* lhs, const double rhs) { \
+        for (long long i = 0; i < ARRAY_BLOCK_ROWS; i++) { \
+            lhs[i] = lhs[i] op rhs; \
+        } \
+    } \
+    static void scalar_##name(const double lhs, double* rhs) { \
+        for (long long i = 0; i < ARRAY_BLOCK_ROWS; i++) { \
+            rhs[i] = lhs op rhs[i]; \
+        } \
+    }
+#endif
+
+BLOCK_KERNELS(block_add, +)
+BLOCK_KERNELS(block_sub, -)
+BLOCK_KERNELS(block_mul, *)
+BLOCK_KERNELS(block_div, /)
+
+ARRAY_KERNEL static void block_negate(double* values) {
+    for (long long i = 0; i < ARRAY_BLOCK_ROWS; i++) {
+        values[i] = -values[i];
+    }
+}
+
+// Every operand is used once, so its block is overwritten with the result instead of copied
+static void apply_binary(std::vector<ArrayValue>& stack, const ArrayStep step) {
+    ArrayValue rhs = stack.back();
+    stack.pop_back();
+    ArrayValue& lhs = stack.back();
+
+    void (*blocks)(double*, const double*) = block_add;
+    void (*with_scalar)(double*, const double) = block_add_scalar;
+    void (*scalar_with)(const double, double*) = scalar_block_add;
+    switch (step) {
+    case ArrayStep::SUB:
+        blocks = block_sub;
+        with_scalar = block_sub_scalar;
+        scalar_with = scalar_block_sub;
+        break;
+    case ArrayStep::MUL:
+        blocks = block_mul;
+        with_scalar = block_mul_scalar;
+        scalar_with = scalar_block_mul;
+        break;
+    case ArrayStep::DIV:
+        blocks = block_div;
+        with_scalar = block_div_scalar;
+        scalar_with = scalar_block_div;
+        break;
+    default:
+        break;
+    }
+
+    if (lhs.values != nullptr && rhs.values != nullptr) {
+        blocks(lhs.values, rhs.values);
+    } else if (lhs.values != nullptr) {
+        with_scalar(lhs.values, rhs.scalar);
+    } else if (rhs.values != nullptr) {
+        scalar_with(lhs.scalar, rhs.values);
+        lhs = rhs;
+    } else {
+        double a = lhs.scalar;
+        double b = rhs.scalar;
+        lhs.scalar = step == ArrayStep::ADD ? a + b : step == ArrayStep::SUB ? a - b : step == ArrayStep::MUL ? a * b : a / b;
+    }
+}
+
+static ArrayValue run_steps(const std::vector<ArrayStep>& steps, const std::vector<ArrayValue>& operands) {
+    std::vector<ArrayValue> stack;
+    size_t next = 0;
+    for (ArrayStep step : steps) {
+        switch (step) {
+        case ArrayStep::OPERAND:
+            stack.push_back(operands[next++]);
+            break;
+        case ArrayStep::UPLUS:
+            break;
+        case ArrayStep::UMINUS:
+            if (stack.back().values == nullptr) {
+                stack.back().scalar = -stack.back().scalar;
+            } else {
+                block_negate(stack.back().values);
+            }
+
+            break;
+        default:
+            apply_binary(stack, step);
+        }
+    }
+
+    return stack.back();
+}
+
+// Reads rows [row, row + length) of one column of the operand, relative to its top-left corner
+static void read_block(ArrayOperand& operand, const long long column, const long long row, const long long length, std::vector<std::pair<long long, std::string>>* texts, const Instruction& instruction) {
+    const Range* range = operand.range;
+    operand.block.assign(ARRAY_BLOCK_ROWS, 0);
+    Range part(range->start_column, range->start_line, range->sheet, range->first_column + column, range->first_row + row, range->first_column + column, range->first_row + row + length - 1);
+    RangeIterator cells(&part);
+    while (cells.next()) {
+        double* out = operand.block.data() + (cells.row - part.first_row);
+        unsigned long long all = cells.length == TILE_ROWS ? ~0ULL : (1ULL << cells.length) - 1;
+        if (cells.number_bits == all) {
+            std::copy(cells.numbers, cells.numbers + cells.length, out);
+        } else {
+            for (long long j = 0; j < cells.length; j++) {
+                if ((cells.number_bits >> j) & 1) {
+                    out[j] = cells.numbers[j];
+                }
+            }
+        }
+
+        if (cells.text_bits == 0) {
+            continue;
+        }
+
+        if (texts == nullptr) {
+            throw_not_a_number(instruction, range);
+        }
+
+        for (long long j = 0; j < cells.length; j++) {
+            if ((cells.text_bits >> j) & 1) {
+                texts->push_back({cells.row - part.first_row + j, cells.text(j)});
+            }
+        }
+    }
+}
+
+static void write_block(Scope* target, const ArrayBlock& block) {
+    target->assign_numbers(block.column, block.row, block.numbers.data(), block.numbers.size());
+    for (auto& text : block.texts) {
+        target->assign_text(cell_key(block.column, block.row + text.first), text.second);
+    }
+}
+
+void assign_array(Scope* target, const Instruction& instruction, const std::vector<RuntimeValue*>& operands) {
+    long long offset = instruction.instruction_type == InstructionType::STOAS ? 1 : 0;
+    long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[offset])->value);
+    long long row1 = static_cast<Number*>(instruction.arguments[offset + 1])->value;
+    long long column2 = column_to_ord(static_cast<String*>(instruction.arguments[offset + 2])->value);
+    long long row2 = static_cast<Number*>(instruction.arguments[offset + 3])->value;
+    long long first_column = std::min(column1, column2);
+    long long last_column = std::max(column1, column2);
+    long long first_row = std::min(row1, row2);
+    long long last_row = std::max(row1, row2);
+
+    std::vector<ArrayStep> steps;
+    for (size_t i = offset + 5; i < instruction.arguments.size(); i++) {
+        steps.push_back(static_cast<ArrayStep>(static_cast<long long>(static_cast<Number*>(instruction.arguments[i])->value)));
+    }
+
+    check_steps(instruction, steps, operands.size());
+    bool copy = steps.size() == 1;
+
+    // Single cells are read once and broadcast like scalars
+    std::vector<ArrayOperand> inputs(operands.size());
+    bool scalars_only = true;
+    bool out_of_line = false;
+    for (size_t i = 0; i < operands.size(); i++) {
+        ArrayOperand& input = inputs[i];
+        input.range = nullptr;
+        input.number = 0;
+        input.text = false;
+
+        const RuntimeValue* value = operands[i];
+        RuntimeValue* corner = nullptr;
+        if (value->data_type == DataType::RANGE) {
+            const Range* range = static_cast<const Range*>(value);
+            if (range->first_column != range->last_column || range->first_row != range->last_row) {
+                if (range->last_column - range->first_column != last_column - first_column || range->last_row - range->first_row != last_row - first_row) {
+                    throw_malformed_array_formula(instruction);
+                }
+
+                // Reading a block after an earlier one was written would see the new values
+                bool overlaps = range->sheet == target && range->first_column <= last_column && first_column <= range->last_column && range->first_row <= last_row && first_row <= range->last_row;
+                out_of_line = out_of_line || (overlaps && (range->first_column != first_column || range->first_row != first_row));
+                input.range = range;
+                scalars_only = false;
+                continue;
+            }
+
+            corner = range->top_left();
+            value = corner;
+        }
+
+        if (value->data_type == DataType::STRING) {
+            if (!copy) {
+                delete corner;
+                throw_not_a_number(instruction, operands[i]);
+            }
+
+            input.text = true;
+            input.string = static_cast<const String*>(value)->value;
+        } else {
+            input.number = static_cast<const Number*>(value)->value;
+        }
+
+        delete corner;
+    }
+
+    if (scalars_only) {
+        if (copy && inputs[0].text) {
+            String value(instruction.start_column, instruction.start_row, inputs[0].string);
+            target->assign_range(first_column, first_row, last_column, last_row, &value);
+            return;
+        }
+
+        std::vector<ArrayValue> values;
+        for (const ArrayOperand& input : inputs) {
+            values.push_back(ArrayValue{nullptr, input.number});
+        }
+
+        Number value(instruction.start_column, instruction.start_row, run_steps(steps, values).scalar);
+        target->assign_range(first_column, first_row, last_column, last_row, &value);
+        return;
+    }
+
+    std::vector<ArrayBlock> pending;
+    std::vector<ArrayValue> values(inputs.size());
+    long long rows = last_row - first_row + 1;
+    for (long long column = 0; column <= last_column - first_column; column++) {
+        for (long long row = 0; row < rows; row += ARRAY_BLOCK_ROWS) {
+            long long length = std::min(ARRAY_BLOCK_ROWS, rows - row);
+            ArrayBlock block = {first_column + column, first_row + row, {}, {}};
+            for (size_t i = 0; i < inputs.size(); i++) {
+                if (inputs[i].range == nullptr) {
+                    values[i] = ArrayValue{nullptr, inputs[i].number};
+                    continue;
+                }
+
+                read_block(inputs[i], column, row, length, copy ? &block.texts : nullptr, instruction);
+                values[i] = ArrayValue{inputs[i].block.data(), 0};
+            }
+
+            ArrayValue result = run_steps(steps, values);
+            block.numbers.assign(result.values, result.values + length);
+            if (out_of_line) {
+                pending.push_back(std::move(block));
+            } else {
+                write_block(target, block);
+            }
+        }
+    }
+
+    for (const ArrayBlock& block : pending) {
+        write_block(target, block);
+    }
+
+    target->count_writes((last_column - first_column + 1) * rows);
+}
\ No newline at end of file
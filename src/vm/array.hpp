@@ -0,0 +1,15 @@
+#include <vector>
+#include "../frontend/interpolation/interpolation.hpp"
+#include "scope.hpp"
+
+#pragma once
+
+// Rows of one column an array formula computes at a time
+const long long ARRAY_BLOCK_ROWS = 16 * TILE_ROWS;
+
+// Runs the element-wise program of a STOA or STOAS on the values it popped (bottom-most first) and
+// stores the result to target. Every block of rows of an operand range is read into a plain array first,
+// so each step is one vector kernel over the block (AVX2 where the CPU has it). Strings are only allowed when the
+// program is a plain copy, anything else reports them like the scalar arithmetic would. If an operand
+// overlaps the target out of line, the whole result is computed before any of it is written.
+void assign_array(Scope* target, const Instruction& instruction, const std::vector<RuntimeValue*>& operands);
\ No newline at end of file
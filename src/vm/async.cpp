@@ -0,0 +1,263 @@
+#include "async.hpp"
+#include "vm.hpp"
+#include "builtins.hpp"
+#include "io_pool.hpp"
+#include <algorithm>
+#include <exception>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+static bool overlaps(const CellRect& a, const CellRect& b) {
+    return a.column1 <= b.column2 && b.column1 <= a.column2 && a.row1 <= b.row2 && b.row1 <= a.row2;
+}
+
+static bool any_overlaps(const std::vector<CellRect>& a, const std::vector<CellRect>& b) {
+    for (const CellRect& x : a) {
+        for (const CellRect& y : b) {
+            if (overlaps(x, y)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static CellRect cell_rect(const Instruction& instruction, const bool range) {
+    long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[0])->value);
+    long long row1 = static_cast<Number*>(instruction.arguments[1])->value;
+    if (!range) {
+        return CellRect{column1, row1, column1, row1};
+    }
+
+    long long column2 = column_to_ord(static_cast<String*>(instruction.arguments[2])->value);
+    long long row2 = static_cast<Number*>(instruction.arguments[3])->value;
+    return CellRect{std::min(column1, column2), std::min(row1, row2), std::max(column1, column2), std::max(row1, row2)};
+}
+
+Async::Async(VM* vm) {
+    this->vm = vm;
+    this->io = create_io_pool(IO_POOL_THREADS);
+    this->parked_statements = 0;
+    this->waits = 0;
+
+    long long instruction_amount = vm->instructions.size();
+    std::vector<long long> starts = find_store_spans(vm->instructions);
+    this->span_of.assign(instruction_amount, -1);
+    this->span_ends.assign(instruction_amount, -1);
+    for (long long position = 0; position < instruction_amount; position++) {
+        if (starts[position] < 0) {
+            continue;
+        }
+
+        this->span_ends[starts[position]] = position;
+        for (long long i = starts[position]; i <= position; i++) {
+            this->span_of[i] = starts[position];
+        }
+    }
+}
+
+Async::~Async() {
+    this->clear();
+    delete this->io;
+}
+
+bool Async::has_parked() const {
+    return !this->parked.empty();
+}
+
+bool Async::suspend(const BuiltinFunction* builtin, std::vector<RuntimeValue*>& arguments, const Instruction& instruction, const long long position) {
+    long long start = this->span_of[position];
+    if (start < 0) {
+        return false;
+    }
+
+    // The statement's own values are the ones it pushed since its start, minus the arguments the call took
+    long long depth = 0;
+    for (long long i = start; i < position; i++) {
+        std::pair<long long, long long> effect = stack_effect(this->vm->instructions[i]);
+        depth += effect.second - effect.first;
+    }
+
+    depth -= arguments.size();
+    if (depth < 0 || depth > this->vm->stack_depth()) {
+        return false;
+    }
+
+    ParkedStatement statement;
+    statement.resume = position + 1;
+    statement.end = this->span_ends[start];
+    statement.frame.assign(this->vm->top - depth, this->vm->top);
+    statement.deoptimized = this->vm->deoptimized;
+    statement.access = this->access_of(start, statement.end + 1);
+    this->vm->top -= depth;
+
+    // The request owns the arguments from here on, the instruction outlives it because the VM waits
+    // for outstanding requests before it goes away
+    std::vector<RuntimeValue*> owned = std::move(arguments);
+    arguments.clear();
+    long long ticket = this->io->submit([builtin, owned, &instruction]() {
+        RuntimeValue* result = nullptr;
+        try {
+            result = builtin->function(owned, instruction);
+        } catch (...) {
+            for (RuntimeValue* argument : owned) {
+                delete argument;
+            }
+
+            throw;
+        }
+
+        for (RuntimeValue* argument : owned) {
+            delete argument;
+        }
+
+        return result;
+    });
+
+    this->parked[ticket] = std::move(statement);
+    this->parked_statements++;
+    this->vm->jump = this->parked[ticket].end + 1;
+    return true;
+}
+
+void Async::before(const long long position) {
+    // Finished calls are picked up whenever a statement starts, so their statements do not pile up
+    long long start = this->span_of[position];
+    if (start >= 0 && start != position) {
+        return;
+    }
+
+    IoCompletion completion;
+    while (this->io->poll(completion)) {
+        this->resume(completion);
+    }
+
+    if (static_cast<long long>(this->parked.size()) >= ASYNC_MAX_PARKED) {
+        this->waits++;
+        this->resume(this->io->wait());
+    }
+
+    if (this->parked.empty()) {
+        return;
+    }
+
+    CellAccess access = this->access_of(position, start >= 0 ? this->span_ends[start] + 1 : position + 1);
+    while (!this->parked.empty() && this->conflicts(access)) {
+        this->waits++;
+        this->resume(this->io->wait());
+    }
+}
+
+void Async::finish() {
+    while (!this->parked.empty()) {
+        this->waits++;
+        this->resume(this->io->wait());
+    }
+}
+
+void Async::clear() {
+    while (!this->parked.empty()) {
+        IoCompletion completion = this->io->wait();
+        delete completion.result;
+        auto it = this->parked.find(completion.ticket);
+        for (RuntimeValue* value : it->second.frame) {
+            delete value;
+        }
+
+        this->parked.erase(it);
+    }
+}
+
+void Async::resume(IoCompletion completion) {
+    auto it = this->parked.find(completion.ticket);
+    ParkedStatement statement = std::move(it->second);
+    this->parked.erase(it);
+    if (completion.error != nullptr) {
+        for (RuntimeValue* value : statement.frame) {
+            delete value;
+        }
+
+        std::rethrow_exception(completion.error);
+    }
+
+    // Resumed on top of whatever the VM is in the middle of
+    this->vm->reserve_stack(this->vm->max_depth);
+    for (RuntimeValue* value : statement.frame) {
+        this->vm->push(value);
+    }
+
+    this->vm->push(completion.result);
+
+    // The rest of the statement may park it again on another call. It runs with its own deoptimization
+    // state, its store must not clear the flag of the statement the VM is in the middle of.
+    long long executing = this->vm->executing;
+    bool deoptimized = this->vm->deoptimized;
+    this->vm->deoptimized = statement.deoptimized;
+    for (long long position = statement.resume; position <= statement.end; position++) {
+        this->vm->executing = position;
+        this->vm->execute(this->vm->instructions[position]);
+        if (this->vm->jump >= 0) {
+            this->vm->jump = -1;
+            break;
+        }
+    }
+
+    this->vm->executing = executing;
+    this->vm->deoptimized = deoptimized;
+}
+
+CellAccess Async::access_of(const long long start, const long long end) const {
+    CellAccess access;
+    access.barrier = false;
+    for (long long position = start; position < end; position++) {
+        const Instruction& instruction = this->vm->instructions[position];
+        switch (generic_type(instruction.instruction_type)) {
+        case InstructionType::LODC:
+            access.reads.push_back(cell_rect(instruction, false));
+            break;
+        case InstructionType::LODR:
+            access.reads.push_back(cell_rect(instruction, true));
+            break;
+        case InstructionType::STOC:
+            access.writes.push_back(cell_rect(instruction, false));
+            break;
+        case InstructionType::STOR:
+        case InstructionType::STOA:
+            access.writes.push_back(cell_rect(instruction, true));
+            break;
+        case InstructionType::LODCS:
+        case InstructionType::LODRS:
+        case InstructionType::STOCS:
+        case InstructionType::STORS:
+        case InstructionType::STOAS:
+        case InstructionType::STOF:
+        case InstructionType::STFR:
+        case InstructionType::LODF:
+        case InstructionType::CNTF:
+            access.barrier = true;
+            break;
+        default:
+            // Builtins only see their arguments
+            break;
+        }
+    }
+
+    return access;
+}
+
+bool Async::conflicts(const CellAccess& access) const {
+    for (auto& entry : this->parked) {
+        const CellAccess& parked = entry.second.access;
+        if (access.barrier || parked.barrier || any_overlaps(access.writes, parked.reads) || any_overlaps(access.writes, parked.writes) || any_overlaps(access.reads, parked.writes)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+Async* create_async(VM* vm) {
+    return new Async(vm);
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include <unordered_map>
+#include <vector>
+#include "vm.hpp"
+#include "builtins.hpp"
+#include "io_pool.hpp"
+
+#pragma once
+
+const long long ASYNC_MAX_PARKED = 256; // Statements waiting on I/O before the VM waits for one of them
+
+struct CellRect {
+    long long column1;
+    long long row1;
+    long long column2;
+    long long row2;
+};
+
+// Cells a run of instructions may read and write. Anything the rectangles cannot describe (other
+// sheets, flags) makes the run a barrier that conflicts with everything.
+struct CellAccess {
+    std::vector<CellRect> reads;
+    std::vector<CellRect> writes;
+    bool barrier;
+};
+
+// An assignment whose I/O call has not finished. Its frame is what it had on the stack below the
+// call's arguments, the call's result goes on top of it when the statement resumes.
+struct ParkedStatement {
+    long long resume; // Position after the CALL
+    long long end; // Position of the store
+    std::vector<RuntimeValue*> frame;
+    CellAccess access;
+    bool deoptimized; // The VM's flag when the statement was parked
+};
+
+// Suspendable execution for a VM. When an I/O builtin would block inside an assignment, the call is
+// handed to an I/O thread and the assignment is parked. The VM carries on with the following
+// statements as long as they neither read nor write the cells parked assignments use, and resumes a
+// parked assignment once its call finished or a statement conflicts with it. Every cell therefore ends
+// up with the value a plain in-order run would give it.
+class Async {
+public:
+    explicit Async(VM* vm);
+    ~Async();
+    bool suspend(const BuiltinFunction* builtin, std::vector<RuntimeValue*>& arguments, const Instruction& instruction, const long long position); // Takes the arguments if it parks the statement
+    void before(const long long position); // Called before each instruction while statements are parked
+    void finish(); // Runs every parked statement to its end
+    void clear(); // Drops the statements a failed run left parked
+    bool has_parked() const;
+
+    long long parked_statements;
+    long long waits; // Times the VM had to wait for I/O
+private:
+    VM* vm;
+    IoPool* io;
+    std::vector<long long> span_of; // Position -> start of the assignment it belongs to, -1 outside assignments
+    std::vector<long long> span_ends; // Start of an assignment -> position of its store, -1 elsewhere
+    std::unordered_map<long long, ParkedStatement> parked; // Ticket -> statement
+
+    void resume(IoCompletion completion);
+    CellAccess access_of(const long long start, const long long end) const; // Instructions in [start, end)
+    bool conflicts(const CellAccess& access) const;
+};
+
+Async* create_async(VM* vm);
\ No newline at end of file
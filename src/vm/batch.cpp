@@ -0,0 +1,289 @@
+#include "batch.hpp"
+#include "builtins.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(_WIN32)
+#define BATCH_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define BATCH_KERNEL
+#endif
+
+#ifdef __GNUC__
+// Unaligned 4-double vector, becomes one ymm register with AVX2 and two xmm registers otherwise
+typedef double lane_vector __attribute__((vector_size(32), aligned(8)));
+
+#define LANE_KERNEL(name, op) \
+    BATCH_KERNEL static void name(double* lhs, const double* rhs, const long long stride) { \
+        for (long long i = 0; i < stride; i += BATCH_LANE_WIDTH) { \
+            lane_vector a; \
+            lane_vector b; \
+            std::memcpy(&a, lhs + i, sizeof(a)); \
+            std::memcpy(&b, rhs + i, sizeof(b)); \
+            a = a op b; \
+            std::memcpy(lhs + i, &a, sizeof(a)); \
+        } \
+    }
+#else
+#define LANE_KERNEL(name, op) \
+    static void name(double* lhs, const double* rhs, const long long stride) { \
+        for (long long i = 0; i < stride; i++) { \
+            lhs[i] = lhs[i] op rhs[i]; \
+        } \
+    }
+#endif
+
+LANE_KERNEL(batch_add, +)
+LANE_KERNEL(batch_sub, -)
+LANE_KERNEL(batch_mul, *)
+LANE_KERNEL(batch_div, /)
+
+BATCH_KERNEL static void batch_negate(double* values, const long long stride) {
+    for (long long i = 0; i < stride; i++) {
+        values[i] = -values[i];
+    }
+}
+
+BATCH_KERNEL static void batch_fill(double* values, const double value, const long long stride) {
+    for (long long i = 0; i < stride; i++) {
+        values[i] = value;
+    }
+}
+
+BatchScope::BatchScope(const long long lanes) {
+    this->lanes = lanes;
+    this->stride = (lanes + BATCH_LANE_WIDTH - 1) / BATCH_LANE_WIDTH * BATCH_LANE_WIDTH;
+}
+
+double* BatchScope::plane(const long long key) {
+    std::vector<double>& plane = this->planes[key];
+    if (plane.empty()) {
+        plane.assign(this->stride, 0);
+    }
+
+    return plane.data();
+}
+
+const double* BatchScope::find_plane(const long long key) const {
+    auto it = this->planes.find(key);
+    return it == this->planes.end() ? nullptr : it->second.data();
+}
+
+void BatchScope::dump_csv(std::ostream& out) const {
+    std::vector<long long> keys;
+    for (auto& plane : this->planes) {
+        keys.push_back(plane.first);
+    }
+
+    std::sort(keys.begin(), keys.end());
+    for (long long i = 0; i < static_cast<long long>(keys.size()); i++) {
+        out << (i == 0 ? "" : ",") << ord_to_column(keys[i] >> 40) << (keys[i] & MAX_ROW);
+    }
+
+    out << "\n" << std::setprecision(15);
+    for (long long lane = 0; lane < this->lanes; lane++) {
+        for (long long i = 0; i < static_cast<long long>(keys.size()); i++) {
+            out << (i == 0 ? "" : ",") << this->planes.at(keys[i])[lane];
+        }
+
+        out << "\n";
+    }
+}
+
+BatchVM::BatchVM(const std::vector<Instruction>& instructions, BatchScope* scope) : instructions(instructions) {
+    this->scope = scope;
+    this->depth = 0;
+
+    // The program has no jumps, so the deepest the stack gets is known up front
+    long long depth = 0;
+    long long max_depth = 0;
+    for (const Instruction& instruction : this->instructions) {
+        std::pair<long long, long long> effect = stack_effect(instruction);
+        depth = std::max(0LL, depth - effect.first) + effect.second;
+        max_depth = std::max(max_depth, depth);
+    }
+
+    this->stack.assign(max_depth * scope->stride, 0);
+}
+
+void BatchVM::run() {
+    this->depth = 0;
+    for (const Instruction& instruction : this->instructions) {
+        this->execute(instruction);
+    }
+}
+
+double* BatchVM::slot(const long long index) {
+    return this->stack.data() + index * this->scope->stride;
+}
+
+void BatchVM::execute(const Instruction& instruction) {
+    long long stride = this->scope->stride;
+    switch (generic_type(instruction.instruction_type)) {
+    case InstructionType::NOP:
+        break;
+    case InstructionType::PUSH:
+        if (instruction.arguments[0]->data_type != DataType::NUMBER) {
+            this->throw_not_supported(instruction);
+        }
+
+        batch_fill(this->slot(this->depth), static_cast<Number*>(instruction.arguments[0])->value, stride);
+        this->depth++;
+        break;
+    case InstructionType::POP:
+        this->require(instruction, 1);
+        this->depth--;
+        break;
+    case InstructionType::ADD:
+        this->require(instruction, 2);
+        batch_add(this->slot(this->depth - 2), this->slot(this->depth - 1), stride);
+        this->depth--;
+        break;
+    case InstructionType::SUB:
+        this->require(instruction, 2);
+        batch_sub(this->slot(this->depth - 2), this->slot(this->depth - 1), stride);
+        this->depth--;
+        break;
+    case InstructionType::MUL:
+        this->require(instruction, 2);
+        batch_mul(this->slot(this->depth - 2), this->slot(this->depth - 1), stride);
+        this->depth--;
+        break;
+    case InstructionType::DIV:
+        this->require(instruction, 2);
+        batch_div(this->slot(this->depth - 2), this->slot(this->depth - 1), stride);
+        this->depth--;
+        break;
+    case InstructionType::UPLUS:
+        this->require(instruction, 1);
+        break;
+    case InstructionType::UMINUS:
+        this->require(instruction, 1);
+        batch_negate(this->slot(this->depth - 1), stride);
+        break;
+    case InstructionType::STOC: {
+        this->require(instruction, 1);
+        long long key = cell_key(column_to_ord(static_cast<String*>(instruction.arguments[0])->value), static_cast<Number*>(instruction.arguments[1])->value);
+        std::memcpy(this->scope->plane(key), this->slot(this->depth - 1), stride * sizeof(double));
+        this->depth--;
+        break;
+    }
+    case InstructionType::STOR: {
+        this->require(instruction, 1);
+        long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[0])->value);
+        long long row1 = static_cast<Number*>(instruction.arguments[1])->value;
+        long long column2 = column_to_ord(static_cast<String*>(instruction.arguments[2])->value);
+        long long row2 = static_cast<Number*>(instruction.arguments[3])->value;
+        for (long long column = std::min(column1, column2); column <= std::max(column1, column2); column++) {
+            for (long long row = std::min(row1, row2); row <= std::max(row1, row2); row++) {
+                std::memcpy(this->scope->plane(cell_key(column, row)), this->slot(this->depth - 1), stride * sizeof(double));
+            }
+        }
+
+        this->depth--;
+        break;
+    }
+    case InstructionType::LODC: {
+        long long column = column_to_ord(static_cast<String*>(instruction.arguments[0])->value);
+        long long row = static_cast<Number*>(instruction.arguments[1])->value;
+        const double* plane = this->scope->find_plane(cell_key(column, row));
+        if (plane == nullptr) {
+            batch_fill(this->slot(this->depth), 0, stride);
+        } else {
+            std::memcpy(this->slot(this->depth), plane, stride * sizeof(double));
+        }
+
+        this->depth++;
+        break;
+    }
+    case InstructionType::CALL:
+        this->call(instruction);
+        break;
+    default:
+        this->throw_not_supported(instruction);
+    }
+}
+
+void BatchVM::call(const Instruction& instruction) {
+    const BuiltinFunction* builtin = find_builtin(static_cast<String*>(instruction.arguments[0])->value);
+    if (builtin == nullptr) {
+        this->throw_not_supported(instruction);
+    }
+
+    long long argument_amount = static_cast<Number*>(instruction.arguments[1])->value;
+    this->require(instruction, argument_amount);
+
+    // Builtins work on single values, so they run once per scenario
+    long long base = this->depth - argument_amount;
+    std::vector<RuntimeValue*> arguments(argument_amount);
+    for (long long i = 0; i < argument_amount; i++) {
+        arguments[i] = new Number(instruction.start_column, instruction.start_row, 0);
+    }
+
+    std::vector<double> results(this->scope->lanes);
+    try {
+        for (long long lane = 0; lane < this->scope->lanes; lane++) {
+            for (long long i = 0; i < argument_amount; i++) {
+                static_cast<Number*>(arguments[i])->value = this->slot(base + i)[lane];
+            }
+
+            RuntimeValue* result = builtin->function(arguments, instruction);
+            if (result->data_type != DataType::NUMBER) {
+                delete result;
+                this->throw_not_supported(instruction);
+            }
+
+            results[lane] = static_cast<Number*>(result)->value;
+            delete result;
+        }
+    } catch (...) {
+        for (RuntimeValue* argument : arguments) {
+            delete argument;
+        }
+
+        throw;
+    }
+
+    for (RuntimeValue* argument : arguments) {
+        delete argument;
+    }
+
+    double* target = this->slot(base);
+    batch_fill(target, 0, this->scope->stride);
+    std::copy(results.begin(), results.end(), target);
+    this->depth = base + 1;
+}
+
+void BatchVM::require(const Instruction& instruction, const long long values) {
+    if (this->depth < values) {
+        this->throw_stack_underflow(instruction);
+    }
+}
+
+// Errors
+void BatchVM::throw_stack_underflow(const Instruction& instruction) {
+    std::stringstream ss;
+    ss << "Instruction at " << instruction.start_column << ":" << instruction.start_row << " pops more values than the stack holds";
+    throw std::runtime_error(ss.str());
+}
+
+void BatchVM::throw_not_supported(const Instruction& instruction) {
+    std::stringstream ss;
+    ss << "Instruction at " << instruction.start_column << ":" << instruction.start_row << " is not supported in batch mode, only numbers and known builtins are";
+    throw std::runtime_error(ss.str());
+}
+
+BatchScope* create_batch_scope(const long long lanes) {
+    return new BatchScope(lanes);
+}
+
+BatchVM* create_batch_vm(const std::vector<Instruction>& instructions, BatchScope* scope) {
+    return new BatchVM(instructions, scope);
+}
\ No newline at end of file
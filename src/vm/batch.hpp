@@ -0,0 +1,50 @@
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "vm.hpp"
+
+#pragma once
+
+// Lanes are padded to a multiple of this so every kernel works on whole 4-double vectors
+const long long BATCH_LANE_WIDTH = 4;
+
+// One sheet per scenario, stored as structure-of-arrays: every cell holds a plane with one value per
+// scenario. Only numbers are supported, ranges are not.
+class BatchScope {
+public:
+    explicit BatchScope(const long long lanes);
+    double* plane(const long long key); // Creates a zero-filled plane for cells that were never assigned
+    const double* find_plane(const long long key) const; // nullptr for cells that were never assigned
+    void dump_csv(std::ostream& out) const; // Header with the cell names, then one row per scenario
+
+    long long lanes;
+    long long stride; // lanes rounded up to BATCH_LANE_WIDTH
+private:
+    std::unordered_map<long long, std::vector<double>> planes;
+};
+
+// Runs a program once over every scenario of a BatchScope. Each operand stack slot holds one value per
+// scenario and arithmetic runs as vector kernels across all of them (AVX2 where the CPU has it).
+class BatchVM {
+public:
+    BatchVM(const std::vector<Instruction>& instructions, BatchScope* scope);
+    void run();
+private:
+    const std::vector<Instruction>& instructions;
+    BatchScope* scope;
+    std::vector<double> stack; // max_depth slots of scope->stride values each
+    long long depth;
+
+    double* slot(const long long index);
+    void execute(const Instruction& instruction);
+    void call(const Instruction& instruction);
+    void require(const Instruction& instruction, const long long values);
+
+    // Errors
+    void throw_stack_underflow(const Instruction& instruction);
+    void throw_not_supported(const Instruction& instruction);
+};
+
+BatchScope* create_batch_scope(const long long lanes);
+BatchVM* create_batch_vm(const std::vector<Instruction>& instructions, BatchScope* scope);
\ No newline at end of file
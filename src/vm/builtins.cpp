@@ -0,0 +1,261 @@
+#include "builtins.hpp"
+#include "scope.hpp"
+#include "tables.hpp"
+#include <cctype>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static double number_argument(const std::vector<RuntimeValue*>& arguments, const long long index, const Instruction& instruction) {
+    // Builtins that take single values see the top-left corner of a range
+    double value;
+    if (arguments[index]->data_type == DataType::RANGE) {
+        const Range* range = static_cast<const Range*>(arguments[index]);
+        if (range->sheet->retrieve_number(cell_key(range->first_column, range->first_row), value)) {
+            return value;
+        }
+    }
+
+    if (arguments[index]->data_type != DataType::NUMBER) {
+        std::stringstream ss;
+        ss << "Argument " << index + 1 << " of '" << static_cast<String*>(instruction.arguments[0])->value << "' at " << instruction.start_column << ":" << instruction.start_row << " is not a number";
+        throw std::runtime_error(ss.str());
+    }
+
+    return static_cast<Number*>(arguments[index])->value;
+}
+
+// Calls visit with the numbers of one argument: the argument itself or the numbers inside a range.
+// Text and empty cells of a range are skipped like spreadsheets do.
+template <typename Visit>
+static void for_each_number_of(const std::vector<RuntimeValue*>& arguments, const long long index, const Instruction& instruction, Visit visit) {
+    if (arguments[index]->data_type != DataType::RANGE) {
+        visit(number_argument(arguments, index, instruction));
+        return;
+    }
+
+    RangeIterator runs(static_cast<const Range*>(arguments[index]));
+    while (runs.next()) {
+        for (long long j = 0; j < runs.length; j++) {
+            if ((runs.number_bits >> j & 1) != 0) {
+                visit(runs.numbers[j]);
+            }
+        }
+    }
+}
+
+// Calls visit with every number an aggregate works on
+template <typename Visit>
+static void for_each_number(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction, Visit visit) {
+    for (long long i = 0; i < static_cast<long long>(arguments.size()); i++) {
+        for_each_number_of(arguments, i, instruction, visit);
+    }
+}
+
+// Sum and count of the numbers an aggregate works on. Ranges on a sheet with a sum index are answered
+// by the index, everything else is added up one number at a time.
+static void sum_numbers(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction, double& sum, long long& count) {
+    sum = 0;
+    count = 0;
+    for (long long i = 0; i < static_cast<long long>(arguments.size()); i++) {
+        if (arguments[i]->data_type == DataType::RANGE) {
+            const Range* range = static_cast<const Range*>(arguments[i]);
+            if (range->sheet->aggregate(range->first_column, range->first_row, range->last_column, range->last_row, sum, count)) {
+                continue;
+            }
+        }
+
+        for_each_number_of(arguments, i, instruction, [&](const double value) {
+            sum += value;
+            count++;
+        });
+    }
+}
+
+static RuntimeValue* builtin_sum(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    double sum;
+    long long count;
+    sum_numbers(arguments, instruction, sum, count);
+    return new Number(instruction.start_column, instruction.start_row, sum);
+}
+
+static RuntimeValue* builtin_count(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    double sum;
+    long long count;
+    sum_numbers(arguments, instruction, sum, count);
+    return new Number(instruction.start_column, instruction.start_row, count);
+}
+
+static RuntimeValue* builtin_average(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    double sum;
+    long long count;
+    sum_numbers(arguments, instruction, sum, count);
+    return new Number(instruction.start_column, instruction.start_row, count == 0 ? 0 : sum / count);
+}
+
+static RuntimeValue* builtin_min(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    double result = 0;
+    bool found = false;
+    for_each_number(arguments, instruction, [&](const double value) {
+        result = !found || value < result ? value : result;
+        found = true;
+    });
+
+    return new Number(instruction.start_column, instruction.start_row, result);
+}
+
+static RuntimeValue* builtin_max(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    double result = 0;
+    bool found = false;
+    for_each_number(arguments, instruction, [&](const double value) {
+        result = !found || value > result ? value : result;
+        found = true;
+    });
+
+    return new Number(instruction.start_column, instruction.start_row, result);
+}
+
+static RuntimeValue* builtin_abs(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    double result = arguments.empty() ? 0 : std::fabs(number_argument(arguments, 0, instruction));
+    return new Number(instruction.start_column, instruction.start_row, result);
+}
+
+static const std::string& builtin_name(const Instruction& instruction) {
+    return static_cast<String*>(instruction.arguments[0])->value;
+}
+
+static void throw_lookup_arguments(const Instruction& instruction, const char* expected) {
+    std::stringstream ss;
+    ss << "'" << builtin_name(instruction) << "' at " << instruction.start_column << ":" << instruction.start_row << " takes " << expected;
+    throw std::runtime_error(ss.str());
+}
+
+// The value a lookup looks for, a copy owned by the caller
+static RuntimeValue* lookup_value(const std::vector<RuntimeValue*>& arguments) {
+    if (arguments[0]->data_type == DataType::RANGE) {
+        return static_cast<const Range*>(arguments[0])->top_left();
+    }
+
+    return copy_value(arguments[0]);
+}
+
+// Lookups are approximate unless the argument at index is given and 0, like spreadsheets do
+static bool exact_lookup(const std::vector<RuntimeValue*>& arguments, const long long index, const Instruction& instruction) {
+    return index < static_cast<long long>(arguments.size()) && number_argument(arguments, index, instruction) == 0;
+}
+
+// Position of the lookup value in line, throws if nothing matches
+static long long find_position(const Range* line, const std::vector<RuntimeValue*>& arguments, const bool exact, const Instruction& instruction) {
+    RuntimeValue* value = lookup_value(arguments);
+    long long position;
+    bool found = line->sheet->lookup(line, value, exact, position);
+    delete value;
+    if (!found) {
+        std::stringstream ss;
+        ss << "'" << builtin_name(instruction) << "' at " << instruction.start_column << ":" << instruction.start_row << " did not find its value in " << ord_to_column(line->first_column) << line->first_row << ":" << ord_to_column(line->last_column) << line->last_row;
+        throw std::runtime_error(ss.str());
+    }
+
+    return position;
+}
+
+// MATCH(value, range, [match type]): position of value in a one-row or one-column range, counting from 1.
+// Match type 0 finds an equal value, 1 (the default) the largest value not above it.
+static RuntimeValue* builtin_match(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    const char* expected = "a value, a single row or column and optionally a match type of 0 or 1";
+    if (arguments.size() < 2 || arguments.size() > 3 || arguments[1]->data_type != DataType::RANGE) {
+        throw_lookup_arguments(instruction, expected);
+    }
+
+    const Range* range = static_cast<const Range*>(arguments[1]);
+    if (range->first_column != range->last_column && range->first_row != range->last_row) {
+        throw_lookup_arguments(instruction, expected);
+    }
+
+    bool exact = exact_lookup(arguments, 2, instruction);
+    if (!exact && arguments.size() == 3 && number_argument(arguments, 2, instruction) != 1) {
+        throw_lookup_arguments(instruction, expected);
+    }
+
+    return new Number(instruction.start_column, instruction.start_row, find_position(range, arguments, exact, instruction) + 1);
+}
+
+// VLOOKUP(value, range, column, [approximate]): finds value in the first column of the range and gives
+// the cell of that row in the column-th column. Lookups are approximate unless the last argument is 0.
+static RuntimeValue* builtin_vlookup(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    if (arguments.size() < 3 || arguments.size() > 4 || arguments[1]->data_type != DataType::RANGE) {
+        throw_lookup_arguments(instruction, "a value, a range, a column and optionally whether to match approximately");
+    }
+
+    const Range* range = static_cast<const Range*>(arguments[1]);
+    long long column = number_argument(arguments, 2, instruction);
+    if (column < 1 || column > range->last_column - range->first_column + 1) {
+        std::stringstream ss;
+        ss << "Column " << column << " of '" << builtin_name(instruction) << "' at " << instruction.start_column << ":" << instruction.start_row << " is outside of its range";
+        throw std::runtime_error(ss.str());
+    }
+
+    bool exact = exact_lookup(arguments, 3, instruction);
+    Range line(range->start_column, range->start_line, range->sheet, range->first_column, range->first_row, range->first_column, range->last_row);
+    long long row = range->first_row + find_position(&line, arguments, exact, instruction);
+    return range->sheet->retrieve(instruction.start_column, instruction.start_row, range->first_column + column - 1, row);
+}
+
+static RuntimeValue* table_value(const Table* table, const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    long long row = number_argument(arguments, 1, instruction);
+    long long column = number_argument(arguments, 2, instruction);
+    if (row < 1 || row > static_cast<long long>(table->rows.size()) || column < 1 || column > static_cast<long long>(table->rows[row - 1].size())) {
+        std::stringstream ss;
+        ss << "Row " << row << ", column " << column << " of table " << static_cast<long long>(number_argument(arguments, 0, instruction)) << " read at " << instruction.start_column << ":" << instruction.start_row << " is out of range";
+        throw std::runtime_error(ss.str());
+    }
+
+    RuntimeValue* value = copy_value(table->rows[row - 1][column - 1]);
+    value->start_column = instruction.start_column;
+    value->start_line = instruction.start_row;
+    return value;
+}
+
+static void check_table_arguments(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    if (arguments.size() != 3) {
+        std::stringstream ss;
+        ss << "'" << static_cast<String*>(instruction.arguments[0])->value << "' at " << instruction.start_column << ":" << instruction.start_row << " takes a table, a row and a column, got " << arguments.size() << " arguments";
+        throw std::runtime_error(ss.str());
+    }
+}
+
+static RuntimeValue* builtin_table(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    check_table_arguments(arguments, instruction);
+    return table_value(load_table(number_argument(arguments, 0, instruction), instruction), arguments, instruction);
+}
+
+static RuntimeValue* builtin_table_loaded(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    check_table_arguments(arguments, instruction);
+    const Table* table = find_loaded_table(number_argument(arguments, 0, instruction));
+    return table == nullptr ? nullptr : table_value(table, arguments, instruction);
+}
+
+static const std::unordered_map<std::string, BuiltinFunction> BUILTINS = {
+    {"SUM", {builtin_sum, true, true, nullptr}},
+    {"AVERAGE", {builtin_average, true, true, nullptr}},
+    {"COUNT", {builtin_count, true, true, nullptr}},
+    {"MIN", {builtin_min, true, true, nullptr}},
+    {"MAX", {builtin_max, true, true, nullptr}},
+    {"ABS", {builtin_abs, true, true, nullptr}},
+    {"MATCH", {builtin_match, true, true, nullptr}},
+    {"VLOOKUP", {builtin_vlookup, true, false, nullptr}},
+    {"TABLE", {builtin_table, false, false, builtin_table_loaded}},
+};
+
+const BuiltinFunction* find_builtin(const std::string& name) {
+    std::string upper = name;
+    for (char& character : upper) {
+        character = std::toupper(character);
+    }
+
+    auto it = BUILTINS.find(upper);
+    return it == BUILTINS.end() ? nullptr : &it->second;
+}
\ No newline at end of file
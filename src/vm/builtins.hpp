@@ -0,0 +1,18 @@
+#include <string>
+#include <vector>
+#include "../frontend/interpolation/interpolation.hpp"
+
+#pragma once
+
+// Builtins get their arguments in call order and return a new value owned by the caller
+typedef RuntimeValue* (*Builtin)(const std::vector<RuntimeValue*>& arguments, const Instruction& instruction);
+
+struct BuiltinFunction {
+    Builtin function;
+    bool pure; // The result only depends on the argument values, so calls can be cached
+    bool numeric; // Always returns a number
+    Builtin nonblocking; // Set for builtins that wait on I/O: returns nullptr instead of waiting, function may then be run on an I/O thread
+};
+
+// Function names are case-insensitive, returns nullptr for unknown functions
+const BuiltinFunction* find_builtin(const std::string& name);
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "call_cache.hpp"
+#include "scope.hpp"
+#include <cstring>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+CallCache::CallCache(const long long capacity) {
+    this->capacity = capacity;
+    this->hits = 0;
+    this->misses = 0;
+    this->bypassed = 0;
+    this->window_lookups = 0;
+    this->window_hits = 0;
+    this->bypass = 0;
+}
+
+CallCache::~CallCache() {
+    this->clear();
+}
+
+void CallCache::build_key(const BuiltinFunction* builtin, const std::vector<RuntimeValue*>& arguments, std::string& key) const {
+    key.assign(reinterpret_cast<const char*>(&builtin), sizeof(builtin));
+    for (RuntimeValue* argument : arguments) {
+        if (argument->data_type == DataType::NUMBER) {
+            char bits[sizeof(double)];
+            std::memcpy(bits, &static_cast<Number*>(argument)->value, sizeof(bits));
+            key += 'n';
+            key.append(bits, sizeof(bits));
+        } else if (argument->data_type == DataType::RANGE) {
+            // The sheet's version stands for the cells, any write to the sheet makes it a different key
+            const Range* range = static_cast<const Range*>(argument);
+            long long fields[6] = {range->sheet->id, range->version, range->first_column, range->first_row, range->last_column, range->last_row};
+            key += 'r';
+            key.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+        } else {
+            const std::string& text = static_cast<String*>(argument)->value;
+            unsigned long long length = text.size();
+            key += 's';
+            key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            key += text;
+        }
+    }
+}
+
+RuntimeValue* CallCache::find(const BuiltinFunction* builtin, const std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    if (this->bypass > 0) {
+        this->bypass--;
+        this->bypassed++;
+        this->missed.clear();
+        return nullptr;
+    }
+
+    if (this->window_lookups == CALL_CACHE_WINDOW) {
+        if (this->window_hits * 8 < this->window_lookups) {
+            this->bypass = CALL_CACHE_BYPASS;
+        }
+
+        this->window_lookups = 0;
+        this->window_hits = 0;
+    }
+
+    this->window_lookups++;
+    this->build_key(builtin, arguments, this->missed);
+    auto it = this->index.find(this->missed);
+    if (it == this->index.end()) {
+        this->misses++;
+        return nullptr;
+    }
+
+    this->hits++;
+    this->window_hits++;
+    this->missed.clear();
+    this->entries.splice(this->entries.begin(), this->entries, it->second);
+
+    // The copy reports the position of the call it stands in for
+    RuntimeValue* result = copy_value(it->second->second);
+    result->start_column = instruction.start_column;
+    result->start_line = instruction.start_row;
+    return result;
+}
+
+void CallCache::insert(const RuntimeValue* result) {
+    if (this->capacity <= 0 || this->missed.empty() || this->index.count(this->missed) != 0) {
+        return;
+    }
+
+    if (static_cast<long long>(this->entries.size()) >= this->capacity) {
+        delete this->entries.back().second;
+        this->index.erase(this->entries.back().first);
+        this->entries.pop_back();
+    }
+
+    this->entries.push_front({this->missed, copy_value(result)});
+    this->index[this->missed] = this->entries.begin();
+    this->missed.clear();
+}
+
+void CallCache::clear() {
+    for (auto& entry : this->entries) {
+        delete entry.second;
+    }
+
+    this->entries.clear();
+    this->index.clear();
+}
+
+CallCache* create_call_cache(const long long capacity) {
+    return new CallCache(capacity);
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../frontend/interpolation/interpolation.hpp"
+#include "builtins.hpp"
+
+#pragma once
+
+const long long CALL_CACHE_CAPACITY = 4096; // Results kept before the least recently used one is dropped
+const long long CALL_CACHE_WINDOW = 1024; // Lookups per hit rate sample
+const long long CALL_CACHE_BYPASS = 16 * 1024; // Calls that skip the cache after a sample with too few hits
+
+// Memoizes the results of pure builtins. Calls are keyed by the function and the exact argument values
+// (numbers by their bits, strings by their text, ranges by their sheet, corners and the sheet's version),
+// so a hit is always the value the call would return.
+// When fewer than one in eight lookups of a sample hit, keeping the cache up to date costs more than it
+// saves and calls bypass it for a while.
+class CallCache {
+public:
+    explicit CallCache(const long long capacity);
+    ~CallCache();
+    RuntimeValue* find(const BuiltinFunction* builtin, const std::vector<RuntimeValue*>& arguments, const Instruction& instruction); // Returns a copy owned by the caller, nullptr on a miss
+    void insert(const RuntimeValue* result); // Stores the result of the call the last find missed
+    void clear();
+
+    long long hits;
+    long long misses;
+    long long bypassed;
+private:
+    typedef std::list<std::pair<std::string, RuntimeValue*>> Entries;
+
+    long long capacity;
+    Entries entries; // Most recently used first
+    std::unordered_map<std::string, Entries::iterator> index;
+    std::string missed; // Key of the last lookup that missed
+    long long window_lookups;
+    long long window_hits;
+    long long bypass; // Calls left to skip
+
+    void build_key(const BuiltinFunction* builtin, const std::vector<RuntimeValue*>& arguments, std::string& key) const;
+};
+
+CallCache* create_call_cache(const long long capacity);
\ No newline at end of file
@@ -0,0 +1,387 @@
+#include "concurrent_scope.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Epoch-based reclamation, shared by every concurrent scope. A thread pins the current global epoch
+// while it works on a scope. Objects it unlinks are retired with the epoch they were retired in and
+// freed once the global epoch has moved two steps past that, at which point no pinned thread can
+// still hold a pointer to them.
+const long long EPOCH_IDLE = -1;
+
+struct EpochParticipant {
+    std::atomic<bool> in_use;
+    std::atomic<long long> epoch;
+};
+
+struct RetiredObject {
+    long long epoch;
+    void* object;
+    void (*destroy)(void*);
+};
+
+static std::atomic<long long> global_epoch(0);
+static EpochParticipant participants[EPOCH_MAX_THREADS];
+static std::mutex orphans_mutex;
+static std::vector<RetiredObject> orphans; // Left behind by threads that exited before they could free them
+
+static void free_retired(std::vector<RetiredObject>& retired) {
+    long long safe = global_epoch.load() - 2;
+    auto freeable = std::partition(retired.begin(), retired.end(), [safe](const RetiredObject& object) {
+        return object.epoch > safe;
+    });
+
+    for (auto it = freeable; it != retired.end(); it++) {
+        it->destroy(it->object);
+    }
+
+    retired.erase(freeable, retired.end());
+}
+
+static void try_advance_epoch() {
+    long long epoch = global_epoch.load();
+    for (long long i = 0; i < EPOCH_MAX_THREADS; i++) {
+        long long pinned = participants[i].epoch.load();
+        if (pinned != EPOCH_IDLE && pinned != epoch) {
+            return;
+        }
+    }
+
+    global_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+class EpochThread {
+public:
+    EpochThread() {
+        this->slot = -1;
+        for (long long i = 0; i < EPOCH_MAX_THREADS; i++) {
+            bool expected = false;
+            if (participants[i].in_use.compare_exchange_strong(expected, true)) {
+                participants[i].epoch.store(EPOCH_IDLE);
+                this->slot = i;
+                break;
+            }
+        }
+
+        if (this->slot == -1) {
+            throw std::runtime_error("Too many threads use concurrent scopes at once");
+        }
+    }
+
+    ~EpochThread() {
+        if (!this->retired.empty()) {
+            std::lock_guard<std::mutex> lock(orphans_mutex);
+            orphans.insert(orphans.end(), this->retired.begin(), this->retired.end());
+        }
+
+        participants[this->slot].in_use.store(false);
+    }
+
+    void pin() {
+        participants[this->slot].epoch.store(global_epoch.load());
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void unpin() {
+        participants[this->slot].epoch.store(EPOCH_IDLE);
+    }
+
+    void retire(void* object, void (*destroy)(void*)) {
+        this->retired.push_back(RetiredObject{global_epoch.load(), object, destroy});
+        if (static_cast<long long>(this->retired.size()) < EPOCH_RETIRE_BATCH) {
+            return;
+        }
+
+        try_advance_epoch();
+        free_retired(this->retired);
+
+        std::unique_lock<std::mutex> lock(orphans_mutex, std::try_to_lock);
+        if (lock.owns_lock() && !orphans.empty()) {
+            free_retired(orphans);
+        }
+    }
+private:
+    long long slot;
+    std::vector<RetiredObject> retired;
+};
+
+static EpochThread& epoch_thread() {
+    static thread_local EpochThread thread;
+    return thread;
+}
+
+// Keeps the calling thread pinned for the lifetime of the guard
+class EpochGuard {
+public:
+    EpochGuard() {
+        epoch_thread().pin();
+    }
+
+    ~EpochGuard() {
+        epoch_thread().unpin();
+    }
+};
+
+static void destroy_string(void* object) {
+    delete static_cast<std::string*>(object);
+}
+
+static void destroy_tile_node(void* object) {
+    ConcurrentTileNode* node = static_cast<ConcurrentTileNode*>(object);
+    for (long long offset = 0; offset < TILE_CELLS; offset++) {
+        unsigned long long cell = node->tile->cells[offset].load();
+        if ((cell & CELL_TAG_MASK) == CELL_STRING_TAG) {
+            delete reinterpret_cast<std::string*>(cell & ~CELL_TAG_MASK);
+        }
+    }
+
+    delete node->tile;
+    delete node;
+}
+
+static unsigned long long encode_number(double value) {
+    // Arithmetic only ever produces the default NaN, but keep foreign payloads out of the tag space
+    if (std::isnan(value)) {
+        value = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    unsigned long long cell;
+    std::memcpy(&cell, &value, sizeof(cell));
+    return cell;
+}
+
+static double decode_number(const unsigned long long cell) {
+    double value;
+    std::memcpy(&value, &cell, sizeof(value));
+    return value;
+}
+
+static unsigned long long encode_string(const std::string& value) {
+    return CELL_STRING_TAG | reinterpret_cast<unsigned long long>(new std::string(value));
+}
+
+static const std::string& decode_string(const unsigned long long cell) {
+    return *reinterpret_cast<const std::string*>(cell & ~CELL_TAG_MASK);
+}
+
+static long long bucket_of(const long long tile) {
+    unsigned long long hash = static_cast<unsigned long long>(tile) * 0x9e3779b97f4a7c15ULL;
+    return hash >> (64 - CONCURRENT_DIRECTORY_BITS);
+}
+
+ConcurrentScope::ConcurrentScope() {
+    this->buckets = new std::atomic<ConcurrentTileNode*>[CONCURRENT_DIRECTORY_BUCKETS];
+    for (long long i = 0; i < CONCURRENT_DIRECTORY_BUCKETS; i++) {
+        this->buckets[i].store(nullptr);
+    }
+}
+
+ConcurrentScope::~ConcurrentScope() {
+    for (long long i = 0; i < CONCURRENT_DIRECTORY_BUCKETS; i++) {
+        ConcurrentTileNode* node = this->buckets[i].load();
+        while (node != nullptr) {
+            ConcurrentTileNode* next = node->next;
+            destroy_tile_node(node);
+            node = next;
+        }
+    }
+
+    delete[] this->buckets;
+}
+
+ConcurrentTile* ConcurrentScope::find_tile(const long long key) const {
+    long long tile = tile_key(key);
+    for (ConcurrentTileNode* node = this->buckets[bucket_of(tile)].load(std::memory_order_acquire); node != nullptr; node = node->next) {
+        if (node->key == tile) {
+            return node->tile;
+        }
+    }
+
+    return nullptr;
+}
+
+ConcurrentTile* ConcurrentScope::writable_tile(const long long key) {
+    ConcurrentTile* found = this->find_tile(key);
+    if (found != nullptr) {
+        return found;
+    }
+
+    ConcurrentTileNode* node = new ConcurrentTileNode{tile_key(key), new ConcurrentTile(), nullptr};
+    node->tile->count.store(0);
+    for (long long offset = 0; offset < TILE_CELLS; offset++) {
+        node->tile->cells[offset].store(CELL_EMPTY, std::memory_order_relaxed);
+    }
+
+    // Publish the node at the head of its bucket. When another thread got there first with the same
+    // tile, use theirs
+    std::atomic<ConcurrentTileNode*>& bucket = this->buckets[bucket_of(node->key)];
+    ConcurrentTileNode* head = bucket.load(std::memory_order_acquire);
+    while (true) {
+        for (ConcurrentTileNode* other = head; other != nullptr; other = other->next) {
+            if (other->key == node->key) {
+                delete node->tile;
+                delete node;
+                return other->tile;
+            }
+        }
+
+        node->next = head;
+        if (bucket.compare_exchange_weak(head, node, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return node->tile;
+        }
+    }
+}
+
+void ConcurrentScope::store(const long long key, const unsigned long long cell) {
+    ConcurrentTile* tile = this->writable_tile(key);
+    unsigned long long old = tile->cells[tile_offset(key)].exchange(cell, std::memory_order_acq_rel);
+    if (old == CELL_EMPTY) {
+        tile->count.fetch_add(1, std::memory_order_relaxed);
+    } else if ((old & CELL_TAG_MASK) == CELL_STRING_TAG) {
+        epoch_thread().retire(reinterpret_cast<void*>(old & ~CELL_TAG_MASK), destroy_string);
+    }
+}
+
+void ConcurrentScope::assign_cell(const long long column, const long long row, RuntimeValue* value) {
+    long long key = cell_key(column, row);
+    EpochGuard guard;
+    if (value->data_type == DataType::STRING) {
+        this->store(key, encode_string(static_cast<String*>(value)->value));
+    } else {
+        this->store(key, encode_number(static_cast<Number*>(value)->value));
+    }
+
+    delete value;
+}
+
+void ConcurrentScope::assign_range(const long long column1, const long long row1, const long long column2, const long long row2, const RuntimeValue* value) {
+    long long first_column = std::min(column1, column2);
+    long long last_column = std::max(column1, column2);
+    long long first_row = std::min(row1, row2);
+    long long last_row = std::max(row1, row2);
+    cell_key(first_column, first_row);
+    cell_key(last_column, last_row);
+
+    EpochGuard guard;
+    for (long long column = first_column; column <= last_column; column++) {
+        for (long long row = first_row; row <= last_row; row++) {
+            if (value->data_type == DataType::STRING) {
+                this->store((column << 40) | row, encode_string(static_cast<const String*>(value)->value));
+            } else {
+                this->store((column << 40) | row, encode_number(static_cast<const Number*>(value)->value));
+            }
+        }
+    }
+}
+
+RuntimeValue* ConcurrentScope::retrieve(const long long start_column, const long long start_row, const long long column, const long long row) const {
+    long long key = cell_key(column, row);
+    EpochGuard guard;
+    ConcurrentTile* tile = this->find_tile(key);
+    unsigned long long cell = tile == nullptr ? CELL_EMPTY : tile->cells[tile_offset(key)].load(std::memory_order_acquire);
+    if (cell == CELL_EMPTY) {
+        return new Number(start_column, start_row, 0);
+    }
+
+    if ((cell & CELL_TAG_MASK) == CELL_STRING_TAG) {
+        return new String(start_column, start_row, decode_string(cell));
+    }
+
+    return new Number(start_column, start_row, decode_number(cell));
+}
+
+bool ConcurrentScope::retrieve_number(const long long key, double& value) const {
+    EpochGuard guard;
+    ConcurrentTile* tile = this->find_tile(key);
+    unsigned long long cell = tile == nullptr ? CELL_EMPTY : tile->cells[tile_offset(key)].load(std::memory_order_acquire);
+    if (cell == CELL_EMPTY) {
+        value = 0;
+        return true;
+    }
+
+    if ((cell & CELL_TAG_MASK) == CELL_STRING_TAG) {
+        return false;
+    }
+
+    value = decode_number(cell);
+    return true;
+}
+
+void ConcurrentScope::assign_number(const long long key, const double value) {
+    EpochGuard guard;
+    this->store(key, encode_number(value));
+}
+
+void ConcurrentScope::clear() {
+    EpochGuard guard;
+    for (long long i = 0; i < CONCURRENT_DIRECTORY_BUCKETS; i++) {
+        ConcurrentTileNode* node = this->buckets[i].exchange(nullptr, std::memory_order_acq_rel);
+        while (node != nullptr) {
+            ConcurrentTileNode* next = node->next;
+            epoch_thread().retire(node, destroy_tile_node);
+            node = next;
+        }
+    }
+}
+
+long long ConcurrentScope::cell_count() const {
+    EpochGuard guard;
+    long long count = 0;
+    for (long long i = 0; i < CONCURRENT_DIRECTORY_BUCKETS; i++) {
+        for (ConcurrentTileNode* node = this->buckets[i].load(std::memory_order_acquire); node != nullptr; node = node->next) {
+            count += node->tile->count.load(std::memory_order_relaxed);
+        }
+    }
+
+    return count;
+}
+
+void ConcurrentScope::dump(std::ostream& out) const {
+    EpochGuard guard;
+    std::vector<std::pair<long long, unsigned long long>> cells;
+    std::vector<std::string> strings;
+    for (long long i = 0; i < CONCURRENT_DIRECTORY_BUCKETS; i++) {
+        for (ConcurrentTileNode* node = this->buckets[i].load(std::memory_order_acquire); node != nullptr; node = node->next) {
+            long long first_column = (node->key >> 40) * TILE_COLUMNS + 1;
+            long long first_row = (node->key & MAX_ROW) * TILE_ROWS;
+            for (long long offset = 0; offset < TILE_CELLS; offset++) {
+                unsigned long long cell = node->tile->cells[offset].load(std::memory_order_acquire);
+                if (cell == CELL_EMPTY) {
+                    continue;
+                }
+
+                // Strings are copied while pinned, the cell word then only remembers which copy it is
+                if ((cell & CELL_TAG_MASK) == CELL_STRING_TAG) {
+                    strings.push_back(decode_string(cell));
+                    cell = CELL_STRING_TAG | (strings.size() - 1);
+                }
+
+                long long column = first_column + offset / TILE_ROWS;
+                long long row = first_row + offset % TILE_ROWS;
+                cells.push_back({(column << 40) | row, cell});
+            }
+        }
+    }
+
+    std::sort(cells.begin(), cells.end());
+    for (auto& cell : cells) {
+        out << ord_to_column(cell.first >> 40) << (cell.first & MAX_ROW) << " = ";
+        if ((cell.second & CELL_TAG_MASK) == CELL_STRING_TAG) {
+            out << std::quoted(strings[cell.second & ~CELL_TAG_MASK]) << "\n";
+        } else {
+            out << std::setprecision(15) << decode_number(cell.second) << "\n";
+        }
+    }
+}
+
+ConcurrentScope* create_concurrent_scope() {
+    return new ConcurrentScope();
+}
\ No newline at end of file
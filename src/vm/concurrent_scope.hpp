@@ -0,0 +1,57 @@
+#include <atomic>
+#include <string>
+#include <ostream>
+#include "../frontend/interpolation/interpolation.hpp"
+#include "scope.hpp"
+
+#pragma once
+
+// Each cell of a concurrent tile is one 64-bit word, either the bits of a double or a tagged value
+// living in the NaN space: an empty cell or a pointer to a heap string
+const unsigned long long CELL_TAG_MASK = 0xffff000000000000ULL;
+const unsigned long long CELL_EMPTY = 0xfffa000000000000ULL;
+const unsigned long long CELL_STRING_TAG = 0xfff9000000000000ULL;
+
+const long long CONCURRENT_DIRECTORY_BITS = 12;
+const long long CONCURRENT_DIRECTORY_BUCKETS = 1LL << CONCURRENT_DIRECTORY_BITS;
+const long long EPOCH_MAX_THREADS = 256;
+const long long EPOCH_RETIRE_BATCH = 64; // Retired objects a thread collects before it tries to free them
+
+struct ConcurrentTile {
+    std::atomic<long long> count; // Non-empty cells
+    std::atomic<unsigned long long> cells[TILE_CELLS];
+};
+
+struct ConcurrentTileNode {
+    long long key;
+    ConcurrentTile* tile;
+    ConcurrentTileNode* next;
+};
+
+// A cell store many threads can read and write at once without taking locks. Tiles are found through
+// a fixed set of buckets whose lists only grow by compare-and-swap at the head, numbers are plain
+// atomic stores and loads, and replaced strings and cleared tiles are freed through epoch-based
+// reclamation once no thread can still be reading them.
+class ConcurrentScope {
+public:
+    ConcurrentScope();
+    ~ConcurrentScope(); // No other thread may use the scope anymore
+    void assign_cell(const long long column, const long long row, RuntimeValue* value); // Takes ownership of value
+    void assign_range(const long long column1, const long long row1, const long long column2, const long long row2, const RuntimeValue* value);
+    RuntimeValue* retrieve(const long long start_column, const long long start_row, const long long column, const long long row) const; // Returns a copy owned by the caller
+
+    bool retrieve_number(const long long key, double& value) const;
+    void assign_number(const long long key, const double value);
+
+    void clear(); // Detaches every tile, threads still reading them keep a valid view until they are done
+    long long cell_count() const;
+    void dump(std::ostream& out) const;
+private:
+    std::atomic<ConcurrentTileNode*>* buckets;
+
+    ConcurrentTile* find_tile(const long long key) const;
+    ConcurrentTile* writable_tile(const long long key);
+    void store(const long long key, const unsigned long long cell);
+};
+
+ConcurrentScope* create_concurrent_scope();
\ No newline at end of file
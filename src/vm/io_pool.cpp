@@ -0,0 +1,114 @@
+#include "io_pool.hpp"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+IoPool::IoPool(const long long threads) {
+    this->completed = 0;
+    this->next_ticket = 0;
+    this->stopping = false;
+    for (long long i = 0; i < threads; i++) {
+        this->workers.emplace_back([this]() {
+            this->work();
+        });
+    }
+}
+
+IoPool::~IoPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+
+    this->requested.notify_all();
+    for (std::thread& worker : this->workers) {
+        worker.join();
+    }
+
+    for (IoCompletion& completion : this->completions) {
+        delete completion.result;
+    }
+}
+
+long long IoPool::submit(IoRequest request) {
+    long long ticket;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        ticket = this->next_ticket++;
+        this->requests.emplace_back(ticket, std::move(request));
+    }
+
+    this->requested.notify_one();
+    return ticket;
+}
+
+bool IoPool::poll(IoCompletion& completion) {
+    if (this->completed.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->completions.empty()) {
+        return false;
+    }
+
+    completion = this->completions.front();
+    this->completions.pop_front();
+    this->completed--;
+    return true;
+}
+
+IoCompletion IoPool::wait() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->finished.wait(lock, [this]() {
+        return !this->completions.empty();
+    });
+
+    IoCompletion completion = this->completions.front();
+    this->completions.pop_front();
+    this->completed--;
+    return completion;
+}
+
+void IoPool::work() {
+    // Requests left in the queue when the pool stops still run, their submitter owns what they captured
+    while (true) {
+        std::pair<long long, IoRequest> request;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->requested.wait(lock, [this]() {
+                return this->stopping || !this->requests.empty();
+            });
+
+            if (this->requests.empty()) {
+                return;
+            }
+
+            request = std::move(this->requests.front());
+            this->requests.pop_front();
+        }
+
+        IoCompletion completion{request.first, nullptr, nullptr};
+        try {
+            completion.result = request.second();
+        } catch (...) {
+            completion.error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->completions.push_back(completion);
+            this->completed++;
+        }
+
+        this->finished.notify_one();
+    }
+}
+
+IoPool* create_io_pool(const long long threads) {
+    return new IoPool(threads);
+}
\ No newline at end of file
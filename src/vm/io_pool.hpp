@@ -0,0 +1,50 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../frontend/interpolation/interpolation.hpp"
+
+#pragma once
+
+const long long IO_POOL_THREADS = 4;
+
+// Work that may block, returns a value owned by whoever collects the completion
+typedef std::function<RuntimeValue*()> IoRequest;
+
+struct IoCompletion {
+    long long ticket;
+    RuntimeValue* result; // nullptr if the request threw
+    std::exception_ptr error;
+};
+
+// Runs blocking requests on a few threads of its own and hands their results back in completion order.
+// Reading local files cannot be made non-blocking with epoll (regular files are always "ready"), so the
+// blocking happens on these threads while the thread that submitted carries on.
+class IoPool {
+public:
+    explicit IoPool(const long long threads);
+    ~IoPool(); // Finishes the requests already submitted and drops their results
+    long long submit(IoRequest request); // Returns the ticket the completion will carry
+    bool poll(IoCompletion& completion); // Takes a finished request if there is one, never blocks
+    IoCompletion wait(); // Blocks until a request finishes, there has to be one outstanding
+
+    std::atomic<long long> completed; // Finished requests not collected yet, lets callers skip poll
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable requested;
+    std::condition_variable finished;
+    std::deque<std::pair<long long, IoRequest>> requests;
+    std::deque<IoCompletion> completions;
+    long long next_ticket;
+    bool stopping;
+
+    void work();
+};
+
+IoPool* create_io_pool(const long long threads);
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include "jit.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define EXCELLANG_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Called from compiled code, these use the regular C calling convention
+static long long jit_load(Scope* scope, long long key, double* value) {
+    return scope->retrieve_number(key, *value) ? 1 : 0;
+}
+
+static void jit_store(Scope* scope, long long key, double value) {
+    scope->assign_number(key, value);
+}
+
+static bool is_jittable(const Instruction& instruction) {
+    switch (generic_type(instruction.instruction_type)) {
+    case InstructionType::NOP:
+    case InstructionType::POP:
+    case InstructionType::ADD:
+    case InstructionType::SUB:
+    case InstructionType::MUL:
+    case InstructionType::DIV:
+    case InstructionType::UPLUS:
+    case InstructionType::UMINUS:
+    case InstructionType::STOC:
+    case InstructionType::LODC:
+        return true;
+    case InstructionType::PUSH:
+        return instruction.arguments[0]->data_type == DataType::NUMBER;
+    default:
+        return false;
+    }
+}
+
+Jit::Jit(VM* vm) {
+    this->vm = vm;
+    this->enabled = true;
+    this->compiled_blocks = 0;
+    this->native_runs = 0;
+    this->bailouts = 0;
+    this->region_used = 0;
+    this->find_blocks();
+}
+
+Jit::~Jit() {
+#ifdef EXCELLANG_JIT
+    for (auto& region : this->regions) {
+        munmap(region.first, region.second);
+    }
+#endif
+}
+
+void Jit::find_blocks() {
+    const std::vector<Instruction>& instructions = this->vm->instructions;
+    long long instruction_amount = instructions.size();
+    this->block_at.assign(instruction_amount, -1);
+
+    long long max_depth = 0;
+    long long position = 0;
+    while (position < instruction_amount) {
+        if (!is_jittable(instructions[position])) {
+            position++;
+            continue;
+        }
+
+        // Depths are relative to the block entry, the inputs are only known once the whole block is seen
+        JitBlock block = {position, position, 0, 0, 0, 0, false, nullptr};
+        long long depth = 0;
+        long long peak = 0;
+        while (block.end < instruction_amount && is_jittable(instructions[block.end])) {
+            std::pair<long long, long long> effect = stack_effect(instructions[block.end]);
+            block.inputs = std::max(block.inputs, effect.first - depth);
+            depth += effect.second - effect.first;
+            peak = std::max(peak, depth);
+            block.end++;
+        }
+
+        block.outputs = block.inputs + depth;
+        block.max_depth = block.inputs + peak;
+        position = block.end;
+        if (block.end - block.start < JIT_MIN_BLOCK_SIZE) {
+            continue;
+        }
+
+        this->block_at[block.start] = this->blocks.size();
+        this->blocks.push_back(block);
+        max_depth = std::max(max_depth, block.max_depth);
+    }
+
+    this->native_stack.assign(max_depth + 1, 0);
+}
+
+long long Jit::try_run(const long long position) {
+    if (!this->enabled || this->block_at[position] < 0) {
+        return position;
+    }
+
+    JitBlock& block = this->blocks[this->block_at[position]];
+    if (block.function == nullptr) {
+        if (block.failed) {
+            return position;
+        }
+
+        block.executions++;
+        if (block.executions < JIT_THRESHOLD) {
+            return position;
+        }
+
+        if (!this->compile(block)) {
+            block.failed = true;
+            return position;
+        }
+    }
+
+    // Inputs come from the interpreter and have to be numbers
+    RuntimeValue** base = this->vm->top - block.inputs;
+    for (long long i = 0; i < block.inputs; i++) {
+        if (base[i]->data_type != DataType::NUMBER) {
+            return position;
+        }
+    }
+
+    for (long long i = 0; i < block.inputs; i++) {
+        this->native_stack[i] = static_cast<Number*>(base[i])->value;
+        delete base[i];
+    }
+
+    this->vm->top = base;
+
+    JitContext context = {this->vm->scope, this->native_stack.data(), 0, 0};
+    bool finished = block.function(&context) != 0;
+
+    const Instruction& first = this->vm->instructions[block.start];
+    long long depth = finished ? block.outputs : context.bail_depth;
+    for (long long i = 0; i < depth; i++) {
+        this->vm->push(new Number(first.start_column, first.start_row, this->native_stack[i]));
+    }
+
+    if (finished) {
+        this->native_runs++;
+        return block.end;
+    }
+
+    this->bailouts++;
+    return context.bail_position;
+}
+
+#ifdef EXCELLANG_JIT
+static void emit(std::vector<unsigned char>& code, std::initializer_list<unsigned char> bytes) {
+    code.insert(code.end(), bytes);
+}
+
+static void emit_u32(std::vector<unsigned char>& code, uint32_t value) {
+    for (long long i = 0; i < 4; i++) {
+        code.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void emit_u64(std::vector<unsigned char>& code, uint64_t value) {
+    for (long long i = 0; i < 8; i++) {
+        code.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+// ModRM + SIB + disp32 for [r12 + 8 * slot], the caller emits prefixes, REX and the opcode
+static void emit_slot(std::vector<unsigned char>& code, unsigned char reg, long long slot) {
+    emit(code, {static_cast<unsigned char>(0x84 | (reg << 3)), 0x24});
+    emit_u32(code, static_cast<uint32_t>(slot * 8));
+}
+
+static void emit_mov_rax_imm(std::vector<unsigned char>& code, uint64_t value) {
+    emit(code, {0x48, 0xB8});
+    emit_u64(code, value);
+}
+#endif
+
+bool Jit::compile(JitBlock& block) {
+#ifdef EXCELLANG_JIT
+    const std::vector<Instruction>& instructions = this->vm->instructions;
+
+    // Register use: rbx = context, r12 = native stack, r13 = scope. Three pushes keep calls 16-byte aligned.
+    std::vector<unsigned char> code;
+    emit(code, {0x53, 0x41, 0x54, 0x41, 0x55});
+    emit(code, {0x48, 0x89, 0xFB});
+    emit(code, {0x4C, 0x8B, 0x63, static_cast<unsigned char>(offsetof(JitContext, stack))});
+    emit(code, {0x4C, 0x8B, 0x6B, static_cast<unsigned char>(offsetof(JitContext, scope))});
+
+    std::vector<long long> bail_jumps;
+    long long depth = block.inputs;
+    try {
+        for (long long position = block.start; position < block.end; position++) {
+            const Instruction& instruction = instructions[position];
+            InstructionType type = generic_type(instruction.instruction_type);
+            switch (type) {
+            case InstructionType::PUSH: {
+                double value = static_cast<Number*>(instruction.arguments[0])->value;
+                uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                emit_mov_rax_imm(code, bits);
+                emit(code, {0x49, 0x89});
+                emit_slot(code, 0, depth);
+                depth++;
+                break;
+            }
+            case InstructionType::LODC: {
+                long long key = cell_key(column_to_ord(static_cast<String*>(instruction.arguments[0])->value), static_cast<Number*>(instruction.arguments[1])->value);
+                emit(code, {0x4C, 0x89, 0xEF});
+                emit(code, {0x48, 0xBE});
+                emit_u64(code, key);
+                emit(code, {0x49, 0x8D});
+                emit_slot(code, 2, depth);
+                emit_mov_rax_imm(code, reinterpret_cast<uint64_t>(&jit_load));
+                emit(code, {0xFF, 0xD0});
+
+                // Not a number: record where the interpreter resumes and leave
+                emit(code, {0x48, 0x85, 0xC0, 0x75, 33});
+                emit_mov_rax_imm(code, position);
+                emit(code, {0x48, 0x89, 0x43, static_cast<unsigned char>(offsetof(JitContext, bail_position))});
+                emit_mov_rax_imm(code, depth);
+                emit(code, {0x48, 0x89, 0x43, static_cast<unsigned char>(offsetof(JitContext, bail_depth))});
+                emit(code, {0xE9});
+                bail_jumps.push_back(code.size());
+                emit_u32(code, 0);
+                depth++;
+                break;
+            }
+            case InstructionType::STOC: {
+                long long key = cell_key(column_to_ord(static_cast<String*>(instruction.arguments[0])->value), static_cast<Number*>(instruction.arguments[1])->value);
+                emit(code, {0x4C, 0x89, 0xEF});
+                emit(code, {0x48, 0xBE});
+                emit_u64(code, key);
+                emit(code, {0xF2, 0x41, 0x0F, 0x10});
+                emit_slot(code, 0, depth - 1);
+                emit_mov_rax_imm(code, reinterpret_cast<uint64_t>(&jit_store));
+                emit(code, {0xFF, 0xD0});
+                depth--;
+                break;
+            }
+            case InstructionType::ADD:
+            case InstructionType::SUB:
+            case InstructionType::MUL:
+            case InstructionType::DIV: {
+                unsigned char opcode = type == InstructionType::ADD ? 0x58 : type == InstructionType::SUB ? 0x5C : type == InstructionType::MUL ? 0x59 : 0x5E;
+                emit(code, {0xF2, 0x41, 0x0F, 0x10});
+                emit_slot(code, 0, depth - 2);
+                emit(code, {0xF2, 0x41, 0x0F, opcode});
+                emit_slot(code, 0, depth - 1);
+                emit(code, {0xF2, 0x41, 0x0F, 0x11});
+                emit_slot(code, 0, depth - 2);
+                depth--;
+                break;
+            }
+            case InstructionType::UMINUS:
+                // Flip the sign bit, same as negating the double
+                emit(code, {0x49, 0x8B});
+                emit_slot(code, 0, depth - 1);
+                emit(code, {0x48, 0x0F, 0xBA, 0xF8, 63});
+                emit(code, {0x49, 0x89});
+                emit_slot(code, 0, depth - 1);
+                break;
+            case InstructionType::POP:
+                depth--;
+                break;
+            default:
+                break;
+            }
+        }
+    } catch (const std::runtime_error&) {
+        // A cell outside of the sheet, the interpreter reports it
+        return false;
+    }
+
+    // Finished: return 1
+    emit(code, {0xB8, 0x01, 0x00, 0x00, 0x00, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+
+    // Bailout: return 0
+    long long bail = code.size();
+    emit(code, {0x31, 0xC0, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+    for (long long jump : bail_jumps) {
+        uint32_t offset = static_cast<uint32_t>(bail - (jump + 4));
+        std::memcpy(&code[jump], &offset, sizeof(offset));
+    }
+
+    unsigned char* installed = this->install(code);
+    if (installed == nullptr) {
+        return false;
+    }
+
+    block.function = reinterpret_cast<JitFunction>(installed);
+    this->compiled_blocks++;
+    return true;
+#else
+    (void)block;
+    return false;
+#endif
+}
+
+unsigned char* Jit::install(const std::vector<unsigned char>& code) {
+#ifdef EXCELLANG_JIT
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    if (this->regions.empty() || this->region_used + code.size() > this->regions.back().second) {
+        size_t size = std::max<size_t>(JIT_REGION_SIZE, (code.size() + page_size - 1) / page_size * page_size);
+        void* region = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            return nullptr;
+        }
+
+        this->regions.push_back({static_cast<unsigned char*>(region), size});
+        this->region_used = 0;
+    }
+
+    // The region is only writable while code is copied into it
+    std::pair<unsigned char*, size_t>& region = this->regions.back();
+    if (mprotect(region.first, region.second, PROT_READ | PROT_WRITE) != 0) {
+        return nullptr;
+    }
+
+    unsigned char* installed = region.first + this->region_used;
+    std::memcpy(installed, code.data(), code.size());
+    this->region_used += (code.size() + 15) / 16 * 16;
+
+    if (mprotect(region.first, region.second, PROT_READ | PROT_EXEC) != 0) {
+        return nullptr;
+    }
+
+    return installed;
+#else
+    (void)code;
+    return nullptr;
+#endif
+}
+
+Jit* create_jit(VM* vm) {
+    return new Jit(vm);
+}
\ No newline at end of file
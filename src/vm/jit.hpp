@@ -0,0 +1,63 @@
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "vm.hpp"
+
+#pragma once
+
+const long long JIT_THRESHOLD = 2; // Executions of a block before it gets compiled
+const long long JIT_MIN_BLOCK_SIZE = 3; // Shorter blocks are not worth leaving the interpreter for
+const long long JIT_REGION_SIZE = 64 * 1024;
+
+// Passed to compiled blocks. When a block cannot continue (a cell holds a string) it stores where the
+// interpreter has to pick up and how many values are on the native stack at that point.
+struct JitContext {
+    Scope* scope;
+    double* stack;
+    long long bail_position;
+    long long bail_depth;
+};
+
+typedef long long (*JitFunction)(JitContext* context); // Returns 1 when the block ran to its end, 0 on a bailout
+
+// A straight-line run of PUSH/POP/LODC/STOC/arithmetic instructions. inputs is the number of values the
+// block pops below its own entry depth, they are taken from the VM stack when the block starts.
+struct JitBlock {
+    long long start;
+    long long end;
+    long long inputs;
+    long long outputs;
+    long long max_depth;
+    long long executions;
+    bool failed;
+    JitFunction function;
+};
+
+// Counts how often each block runs and, once a block is hot, compiles it to x86-64 machine code with
+// SSE2 double arithmetic in an mmapped executable region. Anything the compiled code cannot handle is
+// left to the interpreter. On other platforms blocks are never compiled.
+class Jit {
+public:
+    explicit Jit(VM* vm);
+    ~Jit();
+    long long try_run(const long long position); // Returns the position to continue at, position itself if nothing ran
+
+    bool enabled;
+    long long compiled_blocks;
+    long long native_runs;
+    long long bailouts;
+private:
+    VM* vm;
+    std::vector<JitBlock> blocks;
+    std::vector<long long> block_at; // Instruction position -> index of the block starting there or -1
+    std::vector<double> native_stack;
+
+    std::vector<std::pair<unsigned char*, size_t>> regions; // Executable memory, the last region is filled first
+    size_t region_used;
+
+    void find_blocks();
+    bool compile(JitBlock& block);
+    unsigned char* install(const std::vector<unsigned char>& code);
+};
+
+Jit* create_jit(VM* vm);
\ No newline at end of file
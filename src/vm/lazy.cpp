@@ -0,0 +1,268 @@
+#include "lazy.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Instructions a deferred statement may consist of, anything else has effects beyond computing one value
+static bool is_deferrable(const Instruction& instruction) {
+    switch (generic_type(instruction.instruction_type)) {
+    case InstructionType::NOP:
+    case InstructionType::PUSH:
+    case InstructionType::ADD:
+    case InstructionType::SUB:
+    case InstructionType::MUL:
+    case InstructionType::DIV:
+    case InstructionType::UPLUS:
+    case InstructionType::UMINUS:
+    case InstructionType::LODC:
+    case InstructionType::CALL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static long long stored_key(const Instruction& instruction) {
+    return cell_key(column_to_ord(static_cast<String*>(instruction.arguments[0])->value), static_cast<Number*>(instruction.arguments[1])->value);
+}
+
+Lazy::Lazy(VM* vm) {
+    this->vm = vm;
+    this->defined = 0;
+    this->evaluated = 0;
+    this->find_spans();
+}
+
+void Lazy::find_spans() {
+    // A deferred statement reads its cells when the formula is evaluated, not where it stands in the
+    // program. Walking backwards, writes_after holds every cell written after the statement, and a
+    // statement reading any of them (or its own cell) runs in place so it sees the same values it
+    // would without --lazy.
+    const std::vector<Instruction>& instructions = this->vm->instructions;
+    std::vector<long long> starts = find_store_spans(instructions);
+    std::unordered_set<long long> writes_after;
+    std::vector<std::vector<long long>> ranges_after; // Corners of the ranges written after the statement
+    auto written_after = [&](const long long key) {
+        if (writes_after.count(key) != 0) {
+            return true;
+        }
+
+        long long column = key >> 40;
+        long long row = key & MAX_ROW;
+        for (const std::vector<long long>& range : ranges_after) {
+            if (column >= range[0] && column <= range[2] && row >= range[1] && row <= range[3]) {
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    for (long long position = instructions.size() - 1; position >= 0; position--) {
+        const Instruction& instruction = instructions[position];
+        InstructionType type = instruction.instruction_type;
+        if (type == InstructionType::STOR || type == InstructionType::STOA) {
+            long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[0])->value);
+            long long row1 = static_cast<Number*>(instruction.arguments[1])->value;
+            long long column2 = column_to_ord(static_cast<String*>(instruction.arguments[2])->value);
+            long long row2 = static_cast<Number*>(instruction.arguments[3])->value;
+            ranges_after.push_back({std::min(column1, column2), std::min(row1, row2), std::max(column1, column2), std::max(row1, row2)});
+            continue;
+        }
+
+        if (type != InstructionType::STOC) {
+            continue;
+        }
+
+        long long key = stored_key(instruction);
+        bool deferrable = starts[position] >= 0;
+        for (long long i = starts[position]; i < position && deferrable; i++) {
+            deferrable = is_deferrable(instructions[i]);
+            if (deferrable && generic_type(instructions[i].instruction_type) == InstructionType::LODC) {
+                long long read = stored_key(instructions[i]);
+                deferrable = read != key && !written_after(read);
+            }
+        }
+
+        if (deferrable) {
+            this->spans[starts[position]] = position;
+        }
+
+        writes_after.insert(key);
+    }
+}
+
+long long Lazy::try_define(const long long position) {
+    auto span = this->spans.find(position);
+    if (span == this->spans.end()) {
+        return position;
+    }
+
+    long long key = stored_key(this->vm->instructions[span->second]);
+    this->invalidate(key);
+    this->formulas[key] = Formula{span->first, span->second, false, false};
+    this->defined++;
+    return span->second + 1;
+}
+
+void Lazy::read(const long long key) {
+    if (!this->evaluating.empty()) {
+        this->dependents[key].insert(this->evaluating.back());
+    }
+
+    auto formula = this->formulas.find(key);
+    if (formula != this->formulas.end() && !formula->second.cached) {
+        this->evaluate(key, formula->second);
+    }
+}
+
+void Lazy::read_range(const long long column1, const long long row1, const long long column2, const long long row2) {
+    long long first_column = std::min(column1, column2);
+    long long last_column = std::max(column1, column2);
+    long long first_row = std::min(row1, row2);
+    long long last_row = std::max(row1, row2);
+
+    // Look up whichever is smaller, the cells of the range or the formulas
+    std::vector<long long> keys;
+    long long cells = (last_column - first_column + 1) * (last_row - first_row + 1);
+    if (cells <= static_cast<long long>(this->formulas.size())) {
+        for (long long column = first_column; column <= last_column; column++) {
+            for (long long row = first_row; row <= last_row; row++) {
+                auto formula = this->formulas.find(cell_key(column, row));
+                if (formula != this->formulas.end() && !formula->second.cached) {
+                    keys.push_back(formula->first);
+                }
+            }
+        }
+    } else {
+        for (auto& formula : this->formulas) {
+            long long column = formula.first >> 40;
+            long long row = formula.first & MAX_ROW;
+            if (!formula.second.cached && column >= first_column && column <= last_column && row >= first_row && row <= last_row) {
+                keys.push_back(formula.first);
+            }
+        }
+
+        std::sort(keys.begin(), keys.end());
+    }
+
+    for (long long key : keys) {
+        this->read(key);
+    }
+}
+
+void Lazy::written(const long long column1, const long long row1, const long long column2, const long long row2) {
+    long long first_column = std::min(column1, column2);
+    long long last_column = std::max(column1, column2);
+    long long first_row = std::min(row1, row2);
+    long long last_row = std::max(row1, row2);
+    if (first_column == last_column && first_row == last_row) {
+        long long key = cell_key(first_column, first_row);
+        this->formulas.erase(key);
+        this->invalidate(key);
+        return;
+    }
+
+    auto inside = [&](const long long key) {
+        long long column = key >> 40;
+        long long row = key & MAX_ROW;
+        return column >= first_column && column <= last_column && row >= first_row && row <= last_row;
+    };
+
+    std::vector<long long> keys;
+    for (auto& formula : this->formulas) {
+        if (inside(formula.first)) {
+            keys.push_back(formula.first);
+        }
+    }
+
+    for (auto& dependent : this->dependents) {
+        if (inside(dependent.first)) {
+            keys.push_back(dependent.first);
+        }
+    }
+
+    for (long long key : keys) {
+        this->formulas.erase(key);
+        this->invalidate(key);
+    }
+}
+
+void Lazy::evaluate_all() {
+    std::vector<long long> keys;
+    for (auto& formula : this->formulas) {
+        if (!formula.second.cached) {
+            keys.push_back(formula.first);
+        }
+    }
+
+    for (long long key : keys) {
+        this->read(key);
+    }
+}
+
+void Lazy::evaluate(const long long key, Formula& formula) {
+    if (formula.evaluating) {
+        this->throw_circular_reference(key, formula);
+    }
+
+    // Runs on top of the instruction that read the cell
+    this->vm->reserve_stack(this->vm->max_depth);
+    formula.evaluating = true;
+    this->evaluating.push_back(key);
+    try {
+        for (long long position = formula.start; position < formula.end; position++) {
+            this->vm->execute(this->vm->instructions[position]);
+        }
+    } catch (...) {
+        formula.evaluating = false;
+        this->evaluating.pop_back();
+        throw;
+    }
+
+    this->vm->scope->assign_cell(key >> 40, key & MAX_ROW, this->vm->pop());
+    formula.cached = true;
+    formula.evaluating = false;
+    this->evaluating.pop_back();
+    this->evaluated++;
+}
+
+void Lazy::invalidate(const long long key) {
+    // A formula that is not cached has no cached dependents left, so the walk stops there
+    std::vector<long long> pending = {key};
+    while (!pending.empty()) {
+        long long cell = pending.back();
+        pending.pop_back();
+
+        auto readers = this->dependents.find(cell);
+        if (readers == this->dependents.end()) {
+            continue;
+        }
+
+        for (long long reader : readers->second) {
+            auto formula = this->formulas.find(reader);
+            if (formula != this->formulas.end() && formula->second.cached) {
+                formula->second.cached = false;
+                pending.push_back(reader);
+            }
+        }
+
+        this->dependents.erase(readers);
+    }
+}
+
+void Lazy::throw_circular_reference(const long long key, const Formula& formula) {
+    const Instruction& store = this->vm->instructions[formula.end];
+    std::stringstream ss;
+    ss << "Circular reference: the formula of " << ord_to_column(key >> 40) << (key & MAX_ROW) << " at " << store.start_column << ":" << store.start_row << " depends on itself";
+    throw std::runtime_error(ss.str());
+}
+
+Lazy* create_lazy(VM* vm) {
+    return new Lazy(vm);
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "vm.hpp"
+
+#pragma once
+
+// A cell assignment whose value is computed on demand by the instructions in [start, end), end being
+// the STOC that would have stored it
+struct Formula {
+    long long start;
+    long long end;
+    bool cached; // The scope holds the current value of the formula
+    bool evaluating;
+};
+
+// Lazy evaluation for a VM. Instead of running `A1 = B1 * C1` the VM records the instructions as a
+// formula of A1 and only runs them when something reads A1. The result stays in the scope until one
+// of the cells the formula read is written again. Statements that touch other sheets, read ranges or
+// assign ranges are still run eagerly, and so are statements reading a cell the program assigns again
+// later or their own cell, so the sheet ends up the same as without lazy evaluation.
+class Lazy {
+public:
+    explicit Lazy(VM* vm);
+    long long try_define(const long long position); // Returns the position to continue at, position itself if nothing was deferred
+    void read(const long long key); // Brings the cell up to date before the VM reads it
+    void read_range(const long long column1, const long long row1, const long long column2, const long long row2); // Same for every cell of a range
+    void written(const long long column1, const long long row1, const long long column2, const long long row2); // An eager write replaced these cells
+    void evaluate_all();
+
+    long long defined;
+    long long evaluated;
+private:
+    VM* vm;
+    std::unordered_map<long long, long long> spans; // Start position of a deferrable statement -> position of its STOC
+    std::unordered_map<long long, Formula> formulas; // Cell key -> formula
+    std::unordered_map<long long, std::unordered_set<long long>> dependents; // Cell key -> formulas that read it
+    std::vector<long long> evaluating; // Formulas being evaluated, innermost last
+
+    void find_spans();
+    void evaluate(const long long key, Formula& formula);
+    void invalidate(const long long key);
+
+    // Errors
+    void throw_circular_reference(const long long key, const Formula& formula);
+};
+
+Lazy* create_lazy(VM* vm);
\ No newline at end of file
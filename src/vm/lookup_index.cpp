@@ -0,0 +1,176 @@
+#include "lookup_index.hpp"
+#include "scope.hpp"
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+static std::string fold_case(const std::string& text) {
+    std::string folded = text;
+    for (char& character : folded) {
+        character = std::toupper(static_cast<unsigned char>(character));
+    }
+
+    return folded;
+}
+
+static double hash_number(const double value) {
+    return value == 0 ? 0 : value; // -0 and 0 are the same value but hash differently
+}
+
+// Calls visit(position, text, number, folded text) for every non-empty cell of a line
+template <typename Visit>
+static void for_each_value(const Range* line, Visit visit) {
+    bool column = line->first_column == line->last_column;
+    RangeIterator runs(line);
+    while (runs.next()) {
+        for (long long j = 0; j < runs.length; j++) {
+            long long position = column ? runs.row + j - line->first_row : runs.column - line->first_column;
+            if ((runs.number_bits >> j & 1) != 0) {
+                visit(position, false, runs.numbers[j], std::string());
+            } else if ((runs.text_bits >> j & 1) != 0) {
+                visit(position, true, 0.0, fold_case(runs.text(j)));
+            }
+        }
+    }
+}
+
+// The last entry not above value, end if every entry is above it
+template <typename Entries, typename Value>
+static typename Entries::const_iterator not_above(const Entries& entries, const Value& value) {
+    auto it = std::upper_bound(entries.begin(), entries.end(), value, [](const Value& value, const typename Entries::value_type& entry) {
+        return value < entry.first;
+    });
+    return it == entries.begin() ? entries.end() : it - 1;
+}
+
+LookupCache::LookupCache() : amount(0) {
+    this->builds = 0;
+    this->hits = 0;
+    this->invalidations = 0;
+    this->clock = 0;
+}
+
+LookupIndex& LookupCache::index_of(const Range* line) {
+    for (LookupIndex& index : this->indexes) {
+        if (index.first_column == line->first_column && index.first_row == line->first_row && index.last_column == line->last_column && index.last_row == line->last_row) {
+            index.last_used = ++this->clock;
+            return index;
+        }
+    }
+
+    if (static_cast<long long>(this->indexes.size()) >= LOOKUP_CACHE_CAPACITY) {
+        auto oldest = std::min_element(this->indexes.begin(), this->indexes.end(), [](const LookupIndex& a, const LookupIndex& b) {
+            return a.last_used < b.last_used;
+        });
+        this->indexes.erase(oldest);
+    }
+
+    LookupIndex index;
+    index.first_column = line->first_column;
+    index.first_row = line->first_row;
+    index.last_column = line->last_column;
+    index.last_row = line->last_row;
+    index.last_used = ++this->clock;
+    index.hashed = false;
+    index.sorted = false;
+    this->indexes.push_back(std::move(index));
+    this->amount.store(this->indexes.size());
+    return this->indexes.back();
+}
+
+bool LookupCache::find(const Range* line, const RuntimeValue* value, const bool exact, long long& position) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    LookupIndex& index = this->index_of(line);
+    bool text = value->data_type == DataType::STRING;
+    double number = text ? 0 : static_cast<const Number*>(value)->value;
+    std::string folded = text ? fold_case(static_cast<const String*>(value)->value) : std::string();
+
+    if (exact) {
+        if (index.hashed) {
+            this->hits++;
+        } else {
+            for_each_value(line, [&](const long long at, const bool is_text, const double cell, const std::string& cell_text) {
+                if (is_text) {
+                    auto inserted = index.texts.emplace(cell_text, at);
+                    inserted.first->second = std::min(inserted.first->second, at);
+                } else {
+                    auto inserted = index.numbers.emplace(hash_number(cell), at);
+                    inserted.first->second = std::min(inserted.first->second, at);
+                }
+            });
+            index.hashed = true;
+            this->builds++;
+        }
+
+        if (text) {
+            auto it = index.texts.find(folded);
+            position = it == index.texts.end() ? -1 : it->second;
+        } else {
+            auto it = index.numbers.find(hash_number(number));
+            position = it == index.numbers.end() ? -1 : it->second;
+        }
+
+        return position >= 0;
+    }
+
+    if (index.sorted) {
+        this->hits++;
+    } else {
+        for_each_value(line, [&](const long long at, const bool is_text, const double cell, const std::string& cell_text) {
+            if (is_text) {
+                index.sorted_texts.push_back({cell_text, at});
+            } else {
+                index.sorted_numbers.push_back({cell, at});
+            }
+        });
+        std::sort(index.sorted_numbers.begin(), index.sorted_numbers.end());
+        std::sort(index.sorted_texts.begin(), index.sorted_texts.end());
+        index.sorted = true;
+        this->builds++;
+    }
+
+    if (text) {
+        auto it = not_above(index.sorted_texts, folded);
+        position = it == index.sorted_texts.end() ? -1 : it->second;
+    } else {
+        auto it = not_above(index.sorted_numbers, number);
+        position = it == index.sorted_numbers.end() ? -1 : it->second;
+    }
+
+    return position >= 0;
+}
+
+void LookupCache::drop_overlapping(const long long first_column, const long long first_row, const long long last_column, const long long last_row) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto kept = std::remove_if(this->indexes.begin(), this->indexes.end(), [&](const LookupIndex& index) {
+        return index.first_column <= last_column && first_column <= index.last_column && index.first_row <= last_row && first_row <= index.last_row;
+    });
+    this->invalidations += this->indexes.end() - kept;
+    this->indexes.erase(kept, this->indexes.end());
+    this->amount.store(this->indexes.size());
+}
+
+void LookupCache::cell_written(const long long column, const long long row) {
+    if (this->amount.load() != 0) {
+        this->drop_overlapping(column, row, column, row);
+    }
+}
+
+void LookupCache::tile_written(const long long first_column, const long long first_row, const long long last_column, const long long last_row) {
+    if (this->amount.load() != 0) {
+        this->drop_overlapping(first_column, first_row, last_column, last_row);
+    }
+}
+
+void LookupCache::clear() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->indexes.clear();
+    this->amount.store(0);
+}
+
+LookupCache* create_lookup_cache() {
+    return new LookupCache();
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../frontend/interpolation/interpolation.hpp"
+
+#pragma once
+
+const long long LOOKUP_CACHE_CAPACITY = 16; // Indexes kept per sheet before the least recently used one is dropped
+
+class Range;
+
+// The values of one row or column range, indexed for lookups. Positions count from 0 along the line.
+// The hash tables answer exact lookups with the first position holding the value, the sorted arrays
+// answer approximate ones with the largest value not above it, the last position among equal ones.
+// Text is compared case-insensitively, numbers only match numbers and text only text.
+struct LookupIndex {
+    long long first_column;
+    long long first_row;
+    long long last_column;
+    long long last_row;
+    long long last_used;
+    bool hashed;
+    std::unordered_map<double, long long> numbers;
+    std::unordered_map<std::string, long long> texts;
+    bool sorted;
+    std::vector<std::pair<double, long long>> sorted_numbers;
+    std::vector<std::pair<std::string, long long>> sorted_texts;
+};
+
+// The lookup indexes of one sheet. An index is built the first time a line is looked up in, and only
+// the part a lookup needs: the hash tables for exact lookups, the sorted arrays for approximate ones.
+// Writes drop the indexes of the lines they touch, so the sheet can change elsewhere (like the cells
+// the lookups are stored to) without rebuilding anything.
+// Lookups may come from other sheets' threads, every call takes the lock.
+class LookupCache {
+public:
+    LookupCache();
+    bool find(const Range* line, const RuntimeValue* value, const bool exact, long long& position); // false if nothing matches
+    void cell_written(const long long column, const long long row);
+    void tile_written(const long long first_column, const long long first_row, const long long last_column, const long long last_row);
+    void clear();
+
+    long long builds; // Hash tables and sorted arrays built
+    long long hits; // Lookups answered by an index that was already built
+    long long invalidations;
+private:
+    std::mutex mutex;
+    std::vector<LookupIndex> indexes;
+    std::atomic<long long> amount; // Size of indexes, so writes skip the lock while there are none
+    long long clock;
+
+    LookupIndex& index_of(const Range* line);
+    void drop_overlapping(const long long first_column, const long long first_row, const long long last_column, const long long last_row);
+};
+
+LookupCache* create_lookup_cache();
\ No newline at end of file
@@ -1,3 +1,3 @@
-int main() {
-    
+int main() {
+    
 }
\ No newline at end of file
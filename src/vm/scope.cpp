@@ -0,0 +1,1179 @@
+#include "scope.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+long long cell_key(const long long column, const long long row) {
+    if (column < 1 || column > MAX_COLUMN || row < 0 || row > MAX_ROW) {
+        std::stringstream ss;
+        ss << "Cell " << ord_to_column(column) << row << " is outside of the sheet";
+        throw std::runtime_error(ss.str());
+    }
+
+    return (column << 40) | row;
+}
+
+long long tile_key(const long long key) {
+    return ((((key >> 40) - 1) / TILE_COLUMNS) << 40) | ((key & MAX_ROW) / TILE_ROWS);
+}
+
+long long tile_offset(const long long key) {
+    return (((key >> 40) - 1) % TILE_COLUMNS) * TILE_ROWS + (key & MAX_ROW) % TILE_ROWS;
+}
+
+static const Tile* find_tile(const TileDirectory& tiles, const long long key) {
+    auto it = tiles.find(tile_key(key));
+    if (it == tiles.end()) {
+        return nullptr;
+    }
+
+    return it->second.get();
+}
+
+static long long lowest_bit(const unsigned long long word) {
+#ifdef __GNUC__
+    return __builtin_ctzll(word);
+#else
+    long long bit = 0;
+    while ((word >> bit & 1) == 0) {
+        bit++;
+    }
+
+    return bit;
+#endif
+}
+
+// Position of the first cell of a sparse tile at or after offset
+static size_t sparse_index(const Tile* tile, const long long offset) {
+    // Cells are mostly written in order, so appending is checked first
+    if (tile->sparse.empty() || tile->sparse.back().offset < offset) {
+        return tile->sparse.size();
+    }
+
+    auto it = std::lower_bound(tile->sparse.begin(), tile->sparse.end(), offset, [](const SparseCell& cell, const long long offset) {
+        return cell.offset < offset;
+    });
+    return it - tile->sparse.begin();
+}
+
+// The type of a cell, number is set for NUMBER cells
+static CellType cell_type(const Tile* tile, const long long offset, double& number) {
+    if (tile == nullptr) {
+        return CellType::EMPTY;
+    }
+
+    if (tile->dense) {
+        long long column = offset / TILE_ROWS;
+        long long bit = offset % TILE_ROWS;
+        if ((tile->present[column] >> bit & 1) == 0) {
+            return CellType::EMPTY;
+        }
+
+        if ((tile->text[column] >> bit & 1) != 0) {
+            return CellType::STRING;
+        }
+
+        number = tile->numbers[offset];
+        return CellType::NUMBER;
+    }
+
+    size_t index = sparse_index(tile, offset);
+    if (index == tile->sparse.size() || tile->sparse[index].offset != offset) {
+        return CellType::EMPTY;
+    }
+
+    if (tile->sparse[index].text) {
+        return CellType::STRING;
+    }
+
+    number = tile->sparse[index].number;
+    return CellType::NUMBER;
+}
+
+static void make_dense(Tile* tile) {
+    tile->numbers.assign(TILE_CELLS, 0);
+    tile->present.assign(TILE_COLUMNS, 0);
+    tile->text.assign(TILE_COLUMNS, 0);
+    for (const SparseCell& cell : tile->sparse) {
+        unsigned long long bit = 1ULL << (cell.offset % TILE_ROWS);
+        tile->present[cell.offset / TILE_ROWS] |= bit;
+        if (cell.text) {
+            tile->text[cell.offset / TILE_ROWS] |= bit;
+        } else {
+            tile->numbers[cell.offset] = cell.number;
+        }
+    }
+
+    std::vector<SparseCell>().swap(tile->sparse);
+    tile->dense = true;
+}
+
+static void make_sparse(Tile* tile) {
+    std::vector<SparseCell> cells;
+    cells.reserve(tile->count);
+    for (long long column = 0; column < TILE_COLUMNS; column++) {
+        for (unsigned long long word = tile->present[column]; word != 0; word &= word - 1) {
+            long long offset = column * TILE_ROWS + lowest_bit(word);
+            bool text = (tile->text[column] >> (offset % TILE_ROWS) & 1) != 0;
+            cells.push_back({static_cast<unsigned short>(offset), text, text ? 0 : tile->numbers[offset]});
+        }
+    }
+
+    tile->sparse.swap(cells);
+    std::vector<double>().swap(tile->numbers);
+    std::vector<unsigned long long>().swap(tile->present);
+    std::vector<unsigned long long>().swap(tile->text);
+    tile->dense = false;
+}
+
+// Sets the type and number of a cell, the text of STRING cells is kept in strings by the caller
+static void write_value(Tile* tile, const long long offset, const bool text, const double number) {
+    if (!tile->dense) {
+        size_t index = sparse_index(tile, offset);
+        if (index < tile->sparse.size() && tile->sparse[index].offset == offset) {
+            tile->sparse[index].text = text;
+            tile->sparse[index].number = number;
+            return;
+        }
+
+        if (tile->count + 1 < TILE_DENSE_AT) {
+            tile->sparse.insert(tile->sparse.begin() + index, SparseCell{static_cast<unsigned short>(offset), text, number});
+            tile->count++;
+            return;
+        }
+
+        make_dense(tile);
+    }
+
+    unsigned long long bit = 1ULL << (offset % TILE_ROWS);
+    unsigned long long& present = tile->present[offset / TILE_ROWS];
+    if ((present & bit) == 0) {
+        present |= bit;
+        tile->count++;
+    }
+
+    unsigned long long& words = tile->text[offset / TILE_ROWS];
+    words = text ? words | bit : words & ~bit;
+    tile->numbers[offset] = number;
+}
+
+static void erase_value(Tile* tile, const long long offset) {
+    if (!tile->strings.empty()) {
+        tile->strings.erase(offset);
+    }
+
+    if (!tile->dense) {
+        size_t index = sparse_index(tile, offset);
+        if (index < tile->sparse.size() && tile->sparse[index].offset == offset) {
+            tile->sparse.erase(tile->sparse.begin() + index);
+            tile->count--;
+        }
+
+        return;
+    }
+
+    unsigned long long bit = 1ULL << (offset % TILE_ROWS);
+    if ((tile->present[offset / TILE_ROWS] & bit) == 0) {
+        return;
+    }
+
+    tile->present[offset / TILE_ROWS] &= ~bit;
+    tile->text[offset / TILE_ROWS] &= ~bit;
+    tile->count--;
+    if (tile->count <= TILE_SPARSE_AT) {
+        make_sparse(tile);
+    }
+}
+
+// Calls visit with the offset of every non-empty cell of a tile in ascending order
+template <typename Visit>
+static void for_each_cell(const Tile* tile, Visit visit) {
+    if (!tile->dense) {
+        for (const SparseCell& cell : tile->sparse) {
+            visit(static_cast<long long>(cell.offset));
+        }
+
+        return;
+    }
+
+    for (long long column = 0; column < TILE_COLUMNS; column++) {
+        for (unsigned long long word = tile->present[column]; word != 0; word &= word - 1) {
+            visit(column * TILE_ROWS + lowest_bit(word));
+        }
+    }
+}
+
+static RuntimeValue* read_cell(const Tile* tile, const long long start_column, const long long start_row, const long long key) {
+    long long offset = tile_offset(key);
+    double number = 0;
+    switch (cell_type(tile, offset, number)) {
+    case CellType::STRING:
+        return new String(start_column, start_row, tile->strings.at(offset));
+    default:
+        return new Number(start_column, start_row, number);
+    }
+}
+
+static bool read_number(const Tile* tile, const long long key, double& value) {
+    value = 0;
+    return cell_type(tile, tile_offset(key), value) != CellType::STRING;
+}
+
+static void write_cell(Tile* tile, const long long offset, const RuntimeValue* value) {
+    if (value->data_type == DataType::STRING) {
+        tile->strings[offset] = static_cast<const String*>(value)->value;
+        write_value(tile, offset, true, 0);
+        return;
+    }
+
+    if (!tile->strings.empty()) {
+        tile->strings.erase(offset);
+    }
+
+    write_value(tile, offset, false, static_cast<const Number*>(value)->value);
+}
+
+// Memory a tile takes, for the stats and the budget of disk-backed scopes
+static long long tile_bytes(const Tile* tile) {
+    long long bytes = sizeof(Tile) + tile->sparse.capacity() * sizeof(SparseCell) + tile->numbers.capacity() * sizeof(double);
+    bytes += (tile->present.capacity() + tile->text.capacity() + tile->flags.capacity()) * sizeof(unsigned long long);
+    for (auto& text : tile->strings) {
+        bytes += sizeof(text) + text.second.capacity();
+    }
+
+    return bytes;
+}
+
+static long long count_cells(const TileDirectory& tiles) {
+    long long count = 0;
+    for (auto& tile : tiles) {
+        count += tile.second->count;
+    }
+
+    return count;
+}
+
+static long long popcount(const unsigned long long word) {
+#ifdef __GNUC__
+    return __builtin_popcountll(word);
+#else
+    return std::bitset<64>(word).count();
+#endif
+}
+
+// The bits of rows first_row..last_row (tile-relative, inclusive) of a flag word
+static unsigned long long row_mask(const long long first_row, const long long last_row) {
+    unsigned long long high = last_row == TILE_ROWS - 1 ? ~0ULL : (1ULL << (last_row + 1)) - 1;
+    return high & ~((1ULL << first_row) - 1);
+}
+
+static const char* flag_name(const long long flag) {
+    static const char* names[FLAG_COUNT] = {"bold", "italiac", "underline"};
+    return names[flag];
+}
+
+// Prints the cells of the tiles with the given keys in column-major order, then the flags. tile(key)
+// returns the tile with that key, or nullptr if it is gone. Cells are sorted one column of tiles at a time, and consecutive cells
+// mostly share a tile, so it is only looked up again when the tile changes.
+template <typename GetTile>
+static void dump_tiles(std::vector<long long> keys, GetTile tile, std::ostream& out) {
+    std::sort(keys.begin(), keys.end());
+    for (size_t first = 0; first < keys.size();) {
+        size_t last = first;
+        while (last < keys.size() && keys[last] >> 40 == keys[first] >> 40) {
+            last++;
+        }
+
+        std::vector<long long> cells;
+        for (size_t i = first; i < last; i++) {
+            std::shared_ptr<const Tile> cells_of = tile(keys[i]);
+            if (cells_of == nullptr) {
+                continue;
+            }
+
+            long long first_column = (keys[i] >> 40) * TILE_COLUMNS + 1;
+            long long first_row = (keys[i] & MAX_ROW) * TILE_ROWS;
+            for_each_cell(cells_of.get(), [&](const long long offset) {
+                cells.push_back(((first_column + offset / TILE_ROWS) << 40) | (first_row + offset % TILE_ROWS));
+            });
+        }
+
+        std::sort(cells.begin(), cells.end());
+        std::shared_ptr<const Tile> current;
+        long long current_key = -1;
+        for (long long key : cells) {
+            if (tile_key(key) != current_key) {
+                current_key = tile_key(key);
+                current = tile(current_key);
+            }
+
+            long long offset = tile_offset(key);
+            out << ord_to_column(key >> 40) << (key & MAX_ROW) << " = ";
+            double number;
+            if (cell_type(current.get(), offset, number) == CellType::NUMBER) {
+                out << std::setprecision(15) << number << "\n";
+            } else {
+                out << std::quoted(current->strings.at(offset)) << "\n";
+            }
+        }
+
+        first = last;
+    }
+
+    std::vector<long long> flagged[FLAG_COUNT];
+    for (long long key : keys) {
+        std::shared_ptr<const Tile> flags = tile(key);
+        if (flags == nullptr || flags->flags.empty()) {
+            continue;
+        }
+
+        long long first_column = (key >> 40) * TILE_COLUMNS + 1;
+        long long first_row = (key & MAX_ROW) * TILE_ROWS;
+        for (long long flag = 0; flag < FLAG_COUNT; flag++) {
+            for (long long column = 0; column < TILE_COLUMNS; column++) {
+                unsigned long long word = flags->flags[flag * TILE_COLUMNS + column];
+                for (long long row = 0; word != 0; row++, word >>= 1) {
+                    if ((word & 1) != 0) {
+                        flagged[flag].push_back(((first_column + column) << 40) | (first_row + row));
+                    }
+                }
+            }
+        }
+    }
+
+    for (long long flag = 0; flag < FLAG_COUNT; flag++) {
+        std::sort(flagged[flag].begin(), flagged[flag].end());
+        for (long long key : flagged[flag]) {
+            out << "flag " << flag_name(flag) << " " << ord_to_column(key >> 40) << (key & MAX_ROW) << "\n";
+        }
+    }
+}
+
+Snapshot::Snapshot(std::shared_ptr<const TileDirectory> tiles, const long long version) : version(version) {
+    this->tiles = std::move(tiles);
+}
+
+RuntimeValue* Snapshot::retrieve(const long long start_column, const long long start_row, const long long column, const long long row) const {
+    long long key = cell_key(column, row);
+    return read_cell(find_tile(*this->tiles, key), start_column, start_row, key);
+}
+
+bool Snapshot::retrieve_number(const long long key, double& value) const {
+    return read_number(find_tile(*this->tiles, key), key, value);
+}
+
+long long Snapshot::cell_count() const {
+    return count_cells(*this->tiles);
+}
+
+void Snapshot::dump(std::ostream& out) const {
+    std::vector<long long> keys;
+    for (auto& entry : *this->tiles) {
+        keys.push_back(entry.first);
+    }
+
+    const TileDirectory& directory = *this->tiles;
+    dump_tiles(std::move(keys), [&](const long long key) {
+        return std::shared_ptr<const Tile>(directory.at(key));
+    }, out);
+}
+
+static std::atomic<long long> next_scope_id(0);
+
+// Growth the budget of a disk-backed scope assumes per cell write. A tile turning dense after
+// TILE_DENSE_AT writes grows by about that much on average, so the estimate does not fall behind.
+static const long long BYTES_PER_WRITE = (TILE_CELLS * sizeof(double) + 2 * TILE_COLUMNS * sizeof(unsigned long long)) / TILE_DENSE_AT;
+
+Scope::Scope() : id(next_scope_id++) {
+    this->tiles = std::make_shared<TileDirectory>();
+    this->epoch = 0;
+    this->directory_epoch = 0;
+    this->writes = 0;
+    this->store_version = 0;
+    this->publish_interval = 0;
+    this->last_snapshot = nullptr;
+    this->published = nullptr;
+    this->spill = nullptr;
+    this->memory_budget = 0;
+    this->resident_bytes = 0;
+    this->clock = 0;
+    this->page_ins = 0;
+    this->page_outs = 0;
+    this->sum_index = nullptr;
+    this->lookup_cache = create_lookup_cache();
+}
+
+Scope::~Scope() {
+    delete this->spill;
+    delete this->sum_index;
+    delete this->lookup_cache;
+}
+
+const Tile* Scope::find_tile(const long long key) const {
+    auto it = this->tiles->find(tile_key(key));
+    if (it == this->tiles->end()) {
+        return this->spill == nullptr ? nullptr : this->page_in(tile_key(key), false).get();
+    }
+
+    if (this->spill != nullptr) {
+        it->second->last_used = ++this->clock;
+    }
+
+    return it->second.get();
+}
+
+std::shared_ptr<const Tile> Scope::shared_tile(const long long tile_key) const {
+    auto it = this->tiles->find(tile_key);
+    if (it == this->tiles->end()) {
+        return this->spill == nullptr ? nullptr : this->page_in(tile_key, false);
+    }
+
+    if (this->spill != nullptr) {
+        it->second->last_used = ++this->clock;
+    }
+
+    return it->second;
+}
+
+std::vector<long long> Scope::tile_keys() const {
+    std::vector<long long> keys;
+    keys.reserve(this->tiles->size() + this->spilled.size());
+    for (auto& entry : *this->tiles) {
+        keys.push_back(entry.first);
+    }
+
+    for (auto& entry : this->spilled) {
+        keys.push_back(entry.first);
+    }
+
+    return keys;
+}
+
+bool Scope::has_tile(const long long tile_key) const {
+    return this->tiles->count(tile_key) != 0 || this->spilled.count(tile_key) != 0;
+}
+
+std::vector<long long> Scope::overlapping_tiles(const long long first_column, const long long first_row, const long long last_column, const long long last_row) const {
+    // Walk whichever is smaller, the tiles the rectangle covers or the tiles that exist
+    std::vector<long long> keys;
+    long long first_tile_column = (first_column - 1) / TILE_COLUMNS;
+    long long last_tile_column = (last_column - 1) / TILE_COLUMNS;
+    long long first_tile_row = first_row / TILE_ROWS;
+    long long last_tile_row = last_row / TILE_ROWS;
+    long long covered = (last_tile_column - first_tile_column + 1) * (last_tile_row - first_tile_row + 1);
+    if (covered > static_cast<long long>(this->tiles->size() + this->spilled.size())) {
+        for (long long key : this->tile_keys()) {
+            long long tile_column = key >> 40;
+            long long tile_row = key & MAX_ROW;
+            if (tile_column >= first_tile_column && tile_column <= last_tile_column && tile_row >= first_tile_row && tile_row <= last_tile_row) {
+                keys.push_back(key);
+            }
+        }
+
+        std::sort(keys.begin(), keys.end());
+        return keys;
+    }
+
+    for (long long tile_column = first_tile_column; tile_column <= last_tile_column; tile_column++) {
+        for (long long tile_row = first_tile_row; tile_row <= last_tile_row; tile_row++) {
+            if (this->has_tile((tile_column << 40) | tile_row)) {
+                keys.push_back((tile_column << 40) | tile_row);
+            }
+        }
+    }
+
+    return keys;
+}
+
+template <typename Visit>
+void Scope::for_each_tile(Visit visit) const {
+    if (this->spill == nullptr) {
+        for (auto& entry : *this->tiles) {
+            visit(entry.first, entry.second.get());
+        }
+
+        return;
+    }
+
+    // Paging a tile in may page out others, so the keys are taken first and every tile is held while
+    // visited. Empty tiles are dropped instead of paged out, those are gone by the time they come up.
+    for (long long key : this->tile_keys()) {
+        std::shared_ptr<const Tile> tile = this->shared_tile(key);
+        if (tile != nullptr) {
+            visit(key, tile.get());
+        }
+    }
+}
+
+std::shared_ptr<Tile> Scope::page_in(const long long tile_key, const bool writing) const {
+    auto extent = this->spilled.find(tile_key);
+    if (extent == this->spilled.end()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Tile> tile(this->spill->read(extent->second));
+    tile->epoch = this->epoch;
+    tile->last_used = ++this->clock;
+    this->page_ins++;
+
+    // A tile that is only read keeps its copy on disk, paging it out again costs nothing then
+    if (writing) {
+        this->spill->release(extent->second);
+    } else {
+        this->clean[tile_key] = extent->second;
+    }
+
+    this->spilled.erase(extent);
+    (*this->tiles)[tile_key] = tile;
+    this->resident_bytes += tile_bytes(tile.get());
+    if (this->resident_bytes > this->memory_budget) {
+        this->page_out();
+    }
+
+    return tile;
+}
+
+void Scope::page_out() const {
+    std::vector<std::pair<long long, long long>> tiles; // Last use, key
+    long long bytes = 0;
+    for (auto& entry : *this->tiles) {
+        bytes += tile_bytes(entry.second.get());
+        tiles.push_back({entry.second->last_used, entry.first});
+    }
+
+    // Going down to three quarters of the budget leaves room before the next recount. The tile used
+    // last may be in use by the caller and always stays.
+    long long target = this->memory_budget / 4 * 3;
+    if (bytes > target) {
+        std::sort(tiles.begin(), tiles.end());
+        for (auto& entry : tiles) {
+            if (bytes <= target || entry.first == this->clock) {
+                break;
+            }
+
+            auto it = this->tiles->find(entry.second);
+            const Tile* tile = it->second.get();
+            bytes -= tile_bytes(tile);
+
+            auto copy = this->clean.find(entry.second);
+            if (copy != this->clean.end()) {
+                this->spilled[entry.second] = copy->second;
+                this->clean.erase(copy);
+            } else if (tile->count != 0 || !tile->flags.empty()) {
+                this->spilled[entry.second] = this->spill->write(tile);
+            }
+
+            this->tiles->erase(it);
+            this->page_outs++;
+            if (this->sum_index != nullptr) {
+                this->sum_index->drop(entry.second);
+            }
+        }
+    }
+
+    this->resident_bytes = bytes;
+}
+
+Tile* Scope::writable_tile(const long long key, const long long cells) {
+    // Anything from an older epoch may be visible through a snapshot and is copied before writing
+    if (this->directory_epoch != this->epoch) {
+        this->tiles = std::make_shared<TileDirectory>(*this->tiles);
+        this->directory_epoch = this->epoch;
+    }
+
+    std::shared_ptr<Tile>& tile = (*this->tiles)[tile_key(key)];
+    if (tile == nullptr && this->spill != nullptr) {
+        // The entry is filled in before paging in, page_in then only replaces it
+        tile = std::make_shared<Tile>();
+        std::shared_ptr<Tile> paged = this->page_in(tile_key(key), true);
+        if (paged != nullptr) {
+            this->charge_writes(cells);
+            return paged.get();
+        }
+
+        tile->epoch = this->epoch;
+        this->resident_bytes += sizeof(Tile);
+    } else if (tile == nullptr) {
+        tile = std::make_shared<Tile>();
+        tile->epoch = this->epoch;
+    } else if (tile->epoch != this->epoch) {
+        tile = std::make_shared<Tile>(*tile);
+        tile->epoch = this->epoch;
+    }
+
+    if (this->spill != nullptr) {
+        tile->last_used = ++this->clock;
+        auto copy = this->clean.find(tile_key(key));
+        if (copy != this->clean.end()) {
+            this->spill->release(copy->second);
+            this->clean.erase(copy);
+        }
+
+        this->charge_writes(cells);
+    }
+
+    return tile.get();
+}
+
+void Scope::index_cell(const long long key, const Tile* tile, const CellType before, const double before_number) {
+    this->lookup_cache->cell_written(key >> 40, key & MAX_ROW);
+    if (this->sum_index == nullptr) {
+        return;
+    }
+
+    double after = 0;
+    CellType type = cell_type(tile, tile_offset(key), after);
+    this->sum_index->cell_written(tile_key(key), tile_offset(key), before == CellType::NUMBER, before_number, type == CellType::NUMBER, after);
+}
+
+void Scope::index_tile(const long long key) {
+    long long first_column = ((key >> 40) - 1) / TILE_COLUMNS * TILE_COLUMNS + 1;
+    long long first_row = (key & MAX_ROW) / TILE_ROWS * TILE_ROWS;
+    this->lookup_cache->tile_written(first_column, first_row, first_column + TILE_COLUMNS - 1, first_row + TILE_ROWS - 1);
+    if (this->sum_index != nullptr) {
+        this->sum_index->tile_written(tile_key(key));
+    }
+}
+
+void Scope::charge_writes(const long long cells) {
+    // Paging out before the writes happen, the tile about to be written is the newest and stays
+    this->resident_bytes += cells * BYTES_PER_WRITE;
+    if (this->resident_bytes > this->memory_budget) {
+        this->page_out();
+    }
+}
+
+long long Scope::version() const {
+    return this->store_version;
+}
+
+void Scope::count_writes(const long long amount) {
+    this->store_version++;
+    this->writes += amount;
+    if (this->publish_interval != 0 && this->writes >= this->publish_interval) {
+        this->publish();
+    }
+}
+
+void Scope::assign_cell(const long long column, const long long row, RuntimeValue* value) {
+    long long key = cell_key(column, row);
+    Tile* tile = this->writable_tile(key, 1);
+    double before = 0;
+    CellType type = this->sum_index == nullptr ? CellType::EMPTY : cell_type(tile, tile_offset(key), before);
+    write_cell(tile, tile_offset(key), value);
+    this->index_cell(key, tile, type, before);
+    delete value;
+    this->count_writes(1);
+}
+
+void Scope::assign_range(const long long column1, const long long row1, const long long column2, const long long row2, const RuntimeValue* value) {
+    long long first_column = std::min(column1, column2);
+    long long last_column = std::max(column1, column2);
+    long long first_row = std::min(row1, row2);
+    long long last_row = std::max(row1, row2);
+    cell_key(first_column, first_row);
+    cell_key(last_column, last_row);
+
+    // Tile by tile, so every tile is written once and a disk-backed scope can page it out right after
+    for (long long from_column = first_column; from_column <= last_column;) {
+        long long to_column = std::min(last_column, (from_column - 1) / TILE_COLUMNS * TILE_COLUMNS + TILE_COLUMNS);
+        long long row = first_row;
+        while (row <= last_row) {
+            long long tile_end = std::min(last_row, row | (TILE_ROWS - 1));
+            Tile* tile = this->writable_tile((from_column << 40) | row, (to_column - from_column + 1) * (tile_end - row + 1));
+            this->index_tile((from_column << 40) | row);
+            for (long long column = from_column; column <= to_column; column++) {
+                long long offset = tile_offset((column << 40) | row);
+                for (long long cell = row; cell <= tile_end; cell++, offset++) {
+                    write_cell(tile, offset, value);
+                }
+            }
+
+            row = tile_end + 1;
+        }
+
+        from_column = to_column + 1;
+    }
+
+    this->count_writes((last_column - first_column + 1) * (last_row - first_row + 1));
+}
+
+RuntimeValue* Scope::retrieve(const long long start_column, const long long start_row, const long long column, const long long row) const {
+    long long key = cell_key(column, row);
+    return read_cell(this->find_tile(key), start_column, start_row, key);
+}
+
+bool Scope::retrieve_number(const long long key, double& value) const {
+    return read_number(this->find_tile(key), key, value);
+}
+
+CellType Scope::retrieve_type(const long long key) const {
+    double number;
+    return cell_type(this->find_tile(key), tile_offset(key), number);
+}
+
+void Scope::assign_number(const long long key, const double value) {
+    Tile* tile = this->writable_tile(key, 1);
+    long long offset = tile_offset(key);
+    double before = 0;
+    CellType type = this->sum_index == nullptr ? CellType::EMPTY : cell_type(tile, offset, before);
+    if (!tile->strings.empty()) {
+        tile->strings.erase(offset);
+    }
+
+    write_value(tile, offset, false, value);
+    this->index_cell(key, tile, type, before);
+    this->count_writes(1);
+}
+
+void Scope::assign_numbers(const long long column, const long long row, const double* values, const long long length) {
+    cell_key(column, row);
+    cell_key(column, row + length - 1);
+    for (long long from = row; from < row + length;) {
+        long long tile_end = std::min(row + length - 1, from | (TILE_ROWS - 1));
+        Tile* tile = this->writable_tile((column << 40) | from, tile_end - from + 1);
+        this->index_tile((column << 40) | from);
+        long long offset = tile_offset((column << 40) | from);
+        for (long long cell = from; cell <= tile_end; cell++, offset++) {
+            if (!tile->strings.empty()) {
+                tile->strings.erase(offset);
+            }
+
+            write_value(tile, offset, false, values[cell - row]);
+        }
+
+        from = tile_end + 1;
+    }
+}
+
+void Scope::assign_text(const long long key, const std::string& text) {
+    Tile* tile = this->writable_tile(key, 1);
+    long long offset = tile_offset(key);
+    double before = 0;
+    CellType type = this->sum_index == nullptr ? CellType::EMPTY : cell_type(tile, offset, before);
+    tile->strings[offset] = text;
+    write_value(tile, offset, true, 0);
+    this->index_cell(key, tile, type, before);
+}
+
+void Scope::erase_cell(const long long column, const long long row) {
+    long long key = cell_key(column, row);
+    double before = 0;
+    CellType type = cell_type(this->find_tile(key), tile_offset(key), before);
+    if (type == CellType::EMPTY) {
+        return;
+    }
+
+    Tile* tile = this->writable_tile(key, 0);
+    erase_value(tile, tile_offset(key));
+    this->index_cell(key, tile, type, before);
+    this->count_writes(1);
+}
+
+void Scope::assign_flag(const long long flag, const long long column1, const long long row1, const long long column2, const long long row2, const bool value) {
+    long long first_column = std::min(column1, column2);
+    long long last_column = std::max(column1, column2);
+    long long first_row = std::min(row1, row2);
+    long long last_row = std::max(row1, row2);
+    cell_key(first_column, first_row);
+    cell_key(last_column, last_row);
+
+    for (long long column = first_column; column <= last_column; column++) {
+        long long row = first_row;
+        while (row <= last_row) {
+            long long key = (column << 40) | row;
+            long long tile_end = std::min(last_row, row | (TILE_ROWS - 1));
+            unsigned long long mask = row_mask(row % TILE_ROWS, tile_end % TILE_ROWS);
+            row = tile_end + 1;
+
+            // Clearing a flag never needs a tile or flag words that do not exist yet
+            const Tile* existing = this->find_tile(key);
+            if (!value && (existing == nullptr || existing->flags.empty())) {
+                continue;
+            }
+
+            Tile* tile = this->writable_tile(key, 0);
+            if (tile->flags.empty()) {
+                tile->flags.assign(FLAG_COUNT * TILE_COLUMNS, 0);
+            }
+
+            unsigned long long& word = tile->flags[flag * TILE_COLUMNS + (column - 1) % TILE_COLUMNS];
+            word = value ? word | mask : word & ~mask;
+        }
+    }
+
+    this->count_writes(1);
+}
+
+bool Scope::retrieve_flag(const long long flag, const long long column, const long long row) const {
+    long long key = cell_key(column, row);
+    const Tile* tile = this->find_tile(key);
+    return tile != nullptr && !tile->flags.empty() && (tile->flags[flag * TILE_COLUMNS + (column - 1) % TILE_COLUMNS] >> (row % TILE_ROWS) & 1) != 0;
+}
+
+long long Scope::count_flags(const long long flag, const long long column1, const long long row1, const long long column2, const long long row2) const {
+    long long first_column = std::min(column1, column2);
+    long long last_column = std::max(column1, column2);
+    long long first_row = std::min(row1, row2);
+    long long last_row = std::max(row1, row2);
+    cell_key(first_column, first_row);
+    cell_key(last_column, last_row);
+
+    // Walk whichever is smaller, the tiles the range covers or the tiles that exist
+    long long covered = (last_column - first_column + 1) * (last_row / TILE_ROWS - first_row / TILE_ROWS + 1);
+    long long count = 0;
+    if (covered > static_cast<long long>(this->tiles->size() + this->spilled.size())) {
+        this->for_each_tile([&](const long long key, const Tile* tile) {
+            if (tile->flags.empty()) {
+                return;
+            }
+
+            long long tile_first_column = (key >> 40) * TILE_COLUMNS + 1;
+            long long tile_first_row = (key & MAX_ROW) * TILE_ROWS;
+            long long from_column = std::max(first_column, tile_first_column);
+            long long to_column = std::min(last_column, tile_first_column + TILE_COLUMNS - 1);
+            long long from_row = std::max(first_row, tile_first_row);
+            long long to_row = std::min(last_row, tile_first_row + TILE_ROWS - 1);
+            if (from_column > to_column || from_row > to_row) {
+                return;
+            }
+
+            unsigned long long mask = row_mask(from_row % TILE_ROWS, to_row % TILE_ROWS);
+            for (long long column = from_column; column <= to_column; column++) {
+                count += popcount(tile->flags[flag * TILE_COLUMNS + (column - 1) % TILE_COLUMNS] & mask);
+            }
+        });
+
+        return count;
+    }
+
+    for (long long column = first_column; column <= last_column; column++) {
+        long long row = first_row;
+        while (row <= last_row) {
+            long long key = (column << 40) | row;
+            long long tile_end = std::min(last_row, row | (TILE_ROWS - 1));
+            const Tile* tile = this->find_tile(key);
+            if (tile != nullptr && !tile->flags.empty()) {
+                count += popcount(tile->flags[flag * TILE_COLUMNS + (column - 1) % TILE_COLUMNS] & row_mask(row % TILE_ROWS, tile_end % TILE_ROWS));
+            }
+
+            row = tile_end + 1;
+        }
+    }
+
+    return count;
+}
+
+void Scope::dump(std::ostream& out) const {
+    dump_tiles(this->tile_keys(), [this](const long long key) {
+        return this->shared_tile(key);
+    }, out);
+}
+
+std::vector<long long> Scope::assigned_cells() const {
+    std::vector<long long> keys;
+    this->for_each_tile([&](const long long key, const Tile* tile) {
+        long long first_column = (key >> 40) * TILE_COLUMNS + 1;
+        long long first_row = (key & MAX_ROW) * TILE_ROWS;
+        for_each_cell(tile, [&](const long long offset) {
+            keys.push_back(((first_column + offset / TILE_ROWS) << 40) | (first_row + offset % TILE_ROWS));
+        });
+    });
+
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+void Scope::print_stats(std::ostream& out) const {
+    // Taken first, visiting the tiles below pages in every spilled one
+    long long page_ins = this->page_ins;
+    long long page_outs = this->page_outs;
+
+    long long tiles = 0;
+    long long dense = 0;
+    long long bytes = 0;
+    long long cells = 0;
+    this->for_each_tile([&](const long long, const Tile* tile) {
+        tiles++;
+        dense += tile->dense ? 1 : 0;
+        bytes += tile_bytes(tile);
+        cells += tile->count;
+    });
+
+    out << "store tiles dense: " << dense << "\n";
+    out << "store tiles sparse: " << tiles - dense << "\n";
+    out << "store bytes per cell: " << (cells == 0 ? 0 : bytes / cells) << "\n";
+    if (this->spill != nullptr) {
+        out << "store page ins: " << page_ins << "\n";
+        out << "store page outs: " << page_outs << "\n";
+        out << "store spill file bytes: " << this->spill->bytes << "\n";
+    }
+
+    if (this->lookup_cache->builds != 0) {
+        out << "lookup indexes built: " << this->lookup_cache->builds << "\n";
+        out << "lookup index hits: " << this->lookup_cache->hits << "\n";
+        out << "lookup indexes invalidated: " << this->lookup_cache->invalidations << "\n";
+    }
+
+    if (this->sum_index != nullptr) {
+        // Maintenance counts the cells rebuilds read and the entries single writes updated, savings the
+        // cells queries did not visit
+        out << "sum index tiles queried: " << this->sum_index->queries << "\n";
+        out << "sum index lookups: " << this->sum_index->lookups << "\n";
+        out << "sum index cells skipped: " << this->sum_index->skipped << "\n";
+        out << "sum index cells scanned: " << this->sum_index->scanned << "\n";
+        out << "sum index rebuilds: " << this->sum_index->rebuilds << "\n";
+        out << "sum index maintenance entries: " << this->sum_index->rebuilt + this->sum_index->updated << "\n";
+    }
+}
+
+void Scope::clear() {
+    this->tiles = std::make_shared<TileDirectory>();
+    if (this->sum_index != nullptr) {
+        this->sum_index->clear();
+    }
+
+    this->lookup_cache->clear();
+
+    this->directory_epoch = this->epoch;
+    if (this->spill != nullptr) {
+        for (auto& entry : this->spilled) {
+            this->spill->release(entry.second);
+        }
+
+        for (auto& entry : this->clean) {
+            this->spill->release(entry.second);
+        }
+
+        this->spilled.clear();
+        this->clean.clear();
+        this->resident_bytes = 0;
+    }
+
+    this->count_writes(1);
+}
+
+void Scope::set_memory_budget(const std::string& path, const long long bytes) {
+    if (this->spill == nullptr) {
+        this->spill = create_spill_file(path);
+    }
+
+    // The directory may still be shared with a snapshot, from now on it is never shared again
+    if (this->directory_epoch != this->epoch) {
+        this->tiles = std::make_shared<TileDirectory>(*this->tiles);
+        this->directory_epoch = this->epoch;
+    }
+
+    this->memory_budget = bytes;
+    this->clock++;
+    this->page_out();
+}
+
+void Scope::set_sum_index(const bool enabled) {
+    if (!enabled) {
+        delete this->sum_index;
+        this->sum_index = nullptr;
+    } else if (this->sum_index == nullptr) {
+        this->sum_index = create_sum_index();
+    }
+}
+
+bool Scope::aggregate(const long long column1, const long long row1, const long long column2, const long long row2, double& sum, long long& count) const {
+    if (this->sum_index == nullptr) {
+        return false;
+    }
+
+    long long first_column = std::min(column1, column2);
+    long long last_column = std::max(column1, column2);
+    long long first_row = std::min(row1, row2);
+    long long last_row = std::max(row1, row2);
+    long long cells = (last_column - first_column + 1) * (last_row - first_row + 1);
+
+    // The tiles' sums only match adding the cells one by one when every partial sum is an integer
+    // doubles hold exactly, that includes what the caller summed before
+    double indexed = 0;
+    long long counted = 0;
+    double bound = std::fabs(sum);
+    bool exact = std::trunc(sum) == sum;
+    for (long long key : this->overlapping_tiles(first_column, first_row, last_column, last_row)) {
+        if (!exact) {
+            break;
+        }
+
+        std::shared_ptr<const Tile> tile = this->shared_tile(key);
+        if (tile == nullptr || tile->count == 0) {
+            continue;
+        }
+
+        long long tile_first_column = (key >> 40) * TILE_COLUMNS + 1;
+        long long tile_first_row = (key & MAX_ROW) * TILE_ROWS;
+        long long from_column = std::max(first_column, tile_first_column) - tile_first_column;
+        long long to_column = std::min(last_column, tile_first_column + TILE_COLUMNS - 1) - tile_first_column;
+        long long from_row = std::max(first_row, tile_first_row) - tile_first_row;
+        long long to_row = std::min(last_row, tile_first_row + TILE_ROWS - 1) - tile_first_row;
+        exact = this->sum_index->aggregate(key, tile.get(), from_column, from_row, to_column, to_row, indexed, counted, bound);
+    }
+
+    exact = exact && bound <= SUM_INDEX_TOTAL_LIMIT;
+    this->sum_index->answered(cells, exact);
+    if (!exact) {
+        return false;
+    }
+
+    sum += indexed;
+    count += counted;
+    return true;
+}
+
+bool Scope::lookup(const Range* line, const RuntimeValue* value, const bool exact, long long& position) const {
+    return this->lookup_cache->find(line, value, exact, position);
+}
+
+std::shared_ptr<const Snapshot> Scope::snapshot() {
+    if (this->spill != nullptr) {
+        this->throw_disk_backed_snapshot();
+    }
+
+    if (this->last_snapshot != nullptr && this->writes == 0) {
+        return this->last_snapshot;
+    }
+
+    this->last_snapshot = std::make_shared<const Snapshot>(this->tiles, this->epoch);
+    this->epoch++;
+    this->writes = 0;
+    return this->last_snapshot;
+}
+
+void Scope::publish() {
+    std::atomic_store(&this->published, this->snapshot());
+}
+
+std::shared_ptr<const Snapshot> Scope::latest() const {
+    return std::atomic_load(&this->published);
+}
+
+void Scope::set_publish_interval(const long long writes) {
+    this->publish_interval = writes;
+}
+
+void Scope::throw_disk_backed_snapshot() const {
+    std::stringstream ss;
+    ss << "Cannot take a snapshot of a disk-backed sheet, its tiles are paged in and out by the thread writing it";
+    throw std::runtime_error(ss.str());
+}
+
+Range::Range(const long long start_column, const long long start_line, const Scope* sheet, const long long column1, const long long row1, const long long column2, const long long row2) {
+    this->data_type = DataType::RANGE;
+    this->start_column = start_column;
+    this->start_line = start_line;
+
+    this->sheet = sheet;
+    this->first_column = std::min(column1, column2);
+    this->last_column = std::max(column1, column2);
+    this->first_row = std::min(row1, row2);
+    this->last_row = std::max(row1, row2);
+    cell_key(this->first_column, this->first_row);
+    cell_key(this->last_column, this->last_row);
+    this->version = sheet->version();
+}
+
+RuntimeValue* Range::top_left() const {
+    return this->sheet->retrieve(this->start_column, this->start_line, this->first_column, this->first_row);
+}
+
+RangeIterator::RangeIterator(const Range* range) {
+    this->range = range;
+    this->column = 0;
+    this->row = 0;
+    this->length = 0;
+    this->numbers = nullptr;
+    this->number_bits = 0;
+    this->text_bits = 0;
+    this->run_tile = nullptr;
+
+    this->tiles = range->sheet->overlapping_tiles(range->first_column, range->first_row, range->last_column, range->last_row);
+    this->tile = 0;
+    this->enter_tile();
+}
+
+void RangeIterator::enter_tile() {
+    // Tiles without any cells have nothing to visit, an empty tile may even be gone once it was paged out
+    this->current = nullptr;
+    for (; this->tile < static_cast<long long>(this->tiles.size()); this->tile++) {
+        this->current = this->range->sheet->shared_tile(this->tiles[this->tile]);
+        if (this->current != nullptr && this->current->count != 0) {
+            break;
+        }
+    }
+
+    if (this->tile >= static_cast<long long>(this->tiles.size())) {
+        this->current = nullptr;
+        return;
+    }
+
+    long long key = this->tiles[this->tile];
+    long long tile_first_column = (key >> 40) * TILE_COLUMNS + 1;
+    long long tile_first_row = (key & MAX_ROW) * TILE_ROWS;
+    this->from_column = std::max(this->range->first_column, tile_first_column);
+    this->to_column = std::min(this->range->last_column, tile_first_column + TILE_COLUMNS - 1);
+    this->from_row = std::max(this->range->first_row, tile_first_row);
+    this->to_row = std::min(this->range->last_row, tile_first_row + TILE_ROWS - 1);
+    this->cursor_column = this->from_column;
+}
+
+bool RangeIterator::next() {
+    if (this->tile >= static_cast<long long>(this->tiles.size())) {
+        return false;
+    }
+
+    const Tile* tile = this->current.get();
+    long long tile_column = (this->cursor_column - 1) % TILE_COLUMNS;
+    long long first = this->from_row % TILE_ROWS;
+    this->column = this->cursor_column;
+    this->row = this->from_row;
+    this->length = this->to_row - this->from_row + 1;
+    this->run_tile = this->current;
+
+    unsigned long long mask = this->length == TILE_ROWS ? ~0ULL : (1ULL << this->length) - 1;
+    if (tile->dense) {
+        unsigned long long text = tile->text[tile_column] >> first & mask;
+        this->numbers = tile->numbers.data() + tile_column * TILE_ROWS + first;
+        this->number_bits = (tile->present[tile_column] >> first & mask) & ~text;
+        this->text_bits = text;
+    } else {
+        // The cells of one column are next to each other in a sparse tile
+        this->numbers = this->buffer;
+        this->number_bits = 0;
+        this->text_bits = 0;
+        long long offset = tile_column * TILE_ROWS + first;
+        for (size_t i = sparse_index(tile, offset); i < tile->sparse.size() && tile->sparse[i].offset < offset + this->length; i++) {
+            long long index = tile->sparse[i].offset - offset;
+            if (tile->sparse[i].text) {
+                this->text_bits |= 1ULL << index;
+            } else {
+                this->buffer[index] = tile->sparse[i].number;
+                this->number_bits |= 1ULL << index;
+            }
+        }
+    }
+
+    this->cursor_column++;
+    if (this->cursor_column > this->to_column) {
+        this->tile++;
+        this->enter_tile();
+    }
+
+    return true;
+}
+
+const std::string& RangeIterator::text(const long long index) const {
+    return this->run_tile->strings.at(tile_offset(cell_key(this->column, this->row + index)));
+}
\ No newline at end of file
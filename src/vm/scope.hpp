@@ -0,0 +1,230 @@
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "../frontend/interpolation/interpolation.hpp"
+#include "lookup_index.hpp"
+#include "spill.hpp"
+#include "sum_index.hpp"
+
+#pragma once
+
+// Cells are addressed by (column, row) packed into one key, see column_to_ord for column numbers
+const long long MAX_ROW = (1LL << 40) - 1;
+const long long MAX_COLUMN = (1LL << 22) - 1;
+
+long long cell_key(const long long column, const long long row);
+
+// Cells live in fixed-size tiles. Inside a tile cells are stored column-major so consecutive rows of
+// one column are next to each other
+const long long TILE_COLUMNS = 64;
+const long long TILE_ROWS = 64;
+const long long TILE_CELLS = TILE_COLUMNS * TILE_ROWS;
+
+// Flags (bold, italiac, underline, see flag_index) are bit planes: a tile that had a flag set keeps one
+// 64-bit word per column and flag, bit n of the word is row n of the tile
+const long long FLAG_COUNT = 3;
+static_assert(TILE_ROWS == 64, "A tile column of flags has to fit one word");
+
+long long tile_key(const long long key); // The tile a cell key belongs to
+long long tile_offset(const long long key); // The cell's index inside its tile
+
+enum class CellType : unsigned char {
+    EMPTY,
+    NUMBER,
+    STRING,
+};
+
+// Tiles start out sparse and switch to dense arrays once they fill up. The thresholds are far apart so
+// a tile whose cell count hovers around one of them does not keep converting back and forth.
+const long long TILE_DENSE_AT = TILE_CELLS / 16; // A sparse tile reaching this many cells turns dense
+const long long TILE_SPARSE_AT = TILE_CELLS / 64; // A dense tile dropping to this many cells turns sparse
+
+struct SparseCell {
+    unsigned short offset;
+    bool text; // The value is in Tile::strings
+    double number;
+};
+
+struct Tile {
+    long long epoch; // Snapshot epoch the tile was last copied in, tiles from older epochs may be shared
+    long long count; // Non-empty cells
+    bool dense;
+    std::vector<SparseCell> sparse; // Sorted by offset, only used while the tile is sparse
+    std::vector<double> numbers; // Dense only: TILE_CELLS entries
+    std::vector<unsigned long long> present; // Dense only: one word per column, bit n is set if row n holds a value
+    std::vector<unsigned long long> text; // Dense only: same, for the values that are strings
+    std::unordered_map<long long, std::string> strings; // Offset to text for STRING cells
+    std::vector<unsigned long long> flags; // Empty until a flag is set, then word flag * TILE_COLUMNS + column
+    long long last_used; // Disk-backed scopes only: access tick, the oldest tiles are paged out first
+};
+
+typedef std::unordered_map<long long, std::shared_ptr<Tile>> TileDirectory;
+
+// An immutable view of a scope at one point in time. Reading it needs no locks, so it can be handed
+// to any thread while the scope keeps changing
+class Snapshot {
+public:
+    Snapshot(std::shared_ptr<const TileDirectory> tiles, const long long version);
+    RuntimeValue* retrieve(const long long start_column, const long long start_row, const long long column, const long long row) const; // Returns a copy owned by the caller
+    bool retrieve_number(const long long key, double& value) const;
+    long long cell_count() const;
+    void dump(std::ostream& out) const;
+
+    const long long version;
+private:
+    std::shared_ptr<const TileDirectory> tiles;
+};
+
+// The cell store of one sheet. Tiles are persistent: once a snapshot has been taken every tile it
+// can see is frozen, and the next write to such a tile copies it first. Taking a snapshot therefore
+// only bumps the epoch, and writers only pay for the tiles they actually touch.
+//
+// A disk-backed scope keeps only a memory budget worth of tiles resident. When the budget is exceeded
+// the least recently used tiles are paged out to a spill file and paged back in when a cell of theirs
+// is accessed, so the sheet can grow as large as the disk allows.
+class Scope {
+public:
+    Scope();
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    long long version() const; // Changes with every write, together with id it names one state of one scope
+    void assign_cell(const long long column, const long long row, RuntimeValue* value); // Takes ownership of value
+    void assign_range(const long long column1, const long long row1, const long long column2, const long long row2, const RuntimeValue* value);
+    RuntimeValue* retrieve(const long long start_column, const long long start_row, const long long column, const long long row) const; // Returns a copy owned by the caller
+
+    // Number fast paths, retrieve_number returns false if the cell holds something that is not a number
+    bool retrieve_number(const long long key, double& value) const;
+    void assign_number(const long long key, const double value);
+    CellType retrieve_type(const long long key) const; // Tells empty cells apart from ones holding 0
+    void erase_cell(const long long column, const long long row); // Makes the cell empty again
+
+    // Bulk writes: length numbers down one column starting at row, and single strings. They are not
+    // counted, the writer calls count_writes once it is done so no snapshot sees half of a statement
+    void assign_numbers(const long long column, const long long row, const double* values, const long long length);
+    void assign_text(const long long key, const std::string& text);
+    void count_writes(const long long amount);
+
+    // Flags are set and counted a word at a time
+    void assign_flag(const long long flag, const long long column1, const long long row1, const long long column2, const long long row2, const bool value);
+    bool retrieve_flag(const long long flag, const long long column, const long long row) const;
+    long long count_flags(const long long flag, const long long column1, const long long row1, const long long column2, const long long row2) const;
+
+    void dump(std::ostream& out) const; // Prints every assigned cell in column-major order, then the flags
+    std::vector<long long> assigned_cells() const; // Keys of every non-empty cell in column-major order
+    void print_stats(std::ostream& out) const; // Tile representations and the memory they take
+    void clear(); // Empties the sheet, snapshots taken before keep their cells
+
+    // Makes the scope disk-backed with the spill file at path. The budget is enforced approximately,
+    // writes are charged an estimate and the resident tiles are recounted once that goes over it.
+    // Disk-backed scopes cannot take snapshots.
+    void set_memory_budget(const std::string& path, const long long bytes);
+
+    // Keeps a summed-area table per tile, see SumIndex. aggregate adds up the numbers of a rectangle
+    // with it and returns false if the scope has no index or the tables cannot give the exact result.
+    void set_sum_index(const bool enabled);
+    bool aggregate(const long long column1, const long long row1, const long long column2, const long long row2, double& sum, long long& count) const;
+
+    // Finds value in a one-row or one-column range of this scope through the lookup indexes, see LookupCache.
+    // position counts from 0 along the range, returns false if nothing matches
+    bool lookup(const Range* line, const RuntimeValue* value, const bool exact, long long& position) const;
+
+    // Snapshots have to be taken by the thread that writes the scope. Other threads pick up the
+    // most recently published one through latest()
+    std::shared_ptr<const Snapshot> snapshot();
+    void publish();
+    std::shared_ptr<const Snapshot> latest() const;
+    void set_publish_interval(const long long writes); // Publish after that many cell writes, 0 only publishes on request
+
+    const long long id; // Unique among the scopes of the process
+private:
+    std::shared_ptr<TileDirectory> tiles;
+    long long epoch;
+    long long directory_epoch; // Epoch the directory itself was copied in
+    long long writes; // Cell writes since the last snapshot
+    long long store_version;
+    long long publish_interval;
+    std::shared_ptr<const Snapshot> last_snapshot;
+    std::shared_ptr<const Snapshot> published; // Only accessed through std::atomic_load/atomic_store
+
+    // Disk-backed scopes only, reads page tiles in and out so this state changes even for them
+    SpillFile* spill;
+    long long memory_budget;
+    mutable long long resident_bytes; // Estimate, recounted whenever it goes over the budget
+    mutable long long clock; // Ticks with every tile access
+    mutable long long page_ins;
+    mutable long long page_outs;
+    mutable std::unordered_map<long long, SpillExtent> spilled; // Tile key -> extent, for tiles only on disk
+    mutable std::unordered_map<long long, SpillExtent> clean; // Tile key -> extent still matching the resident tile
+    SumIndex* sum_index; // nullptr unless enabled
+    LookupCache* lookup_cache;
+
+    const Tile* find_tile(const long long key) const; // The tile holding a cell key, nullptr if there is none
+    std::shared_ptr<const Tile> shared_tile(const long long tile_key) const; // Stays valid while other tiles are paged in
+    std::vector<long long> tile_keys() const; // Resident and spilled
+    bool has_tile(const long long tile_key) const;
+    std::vector<long long> overlapping_tiles(const long long first_column, const long long first_row, const long long last_column, const long long last_row) const; // Keys of the tiles a rectangle overlaps, sorted
+    template <typename Visit>
+    void for_each_tile(Visit visit) const; // visit(tile key, tile) for every tile, resident or not
+    std::shared_ptr<Tile> page_in(const long long tile_key, const bool writing) const;
+    void page_out() const; // Recounts the resident bytes and pages out the oldest tiles while over the budget
+    Tile* writable_tile(const long long key, const long long cells); // cells is how many cells are about to be written
+    void charge_writes(const long long cells); // Disk-backed scopes: counts the growth of those writes against the budget
+    void index_cell(const long long key, const Tile* tile, const CellType before, const double before_number); // After a single cell write
+    void index_tile(const long long key); // After a bulk write to the tile of key
+
+    // Errors
+    void throw_disk_backed_snapshot() const;
+
+    friend class RangeIterator;
+};
+
+// What LODR pushes: a reference to a rectangle of a sheet instead of its cells, so passing a range
+// costs the same however many cells it covers. Builtins walk the cells with a RangeIterator, anything
+// else only sees the top-left corner.
+class Range : public RuntimeValue {
+public:
+    Range(const long long start_column, const long long start_line, const Scope* sheet, const long long column1, const long long row1, const long long column2, const long long row2);
+    RuntimeValue* top_left() const; // Returns a copy owned by the caller
+
+    const Scope* sheet;
+    long long first_column;
+    long long first_row;
+    long long last_column;
+    long long last_row;
+    long long version; // The sheet's version when the reference was taken
+};
+
+// Walks a range one tile at a time. Every step yields a run of consecutive rows of one column inside
+// one tile, straight out of the tile's arrays, so callers loop over plain memory. Tiles of the range
+// that were never written are skipped as a whole. The sheet must not change while the iterator is in use.
+class RangeIterator {
+public:
+    explicit RangeIterator(const Range* range);
+    bool next(); // Moves to the next run, false once the range is done
+    const std::string& text(const long long index) const; // For the STRING cells of the run
+
+    long long column;
+    long long row; // First row of the run
+    long long length;
+    const double* numbers; // length entries, only meaningful where number_bits is set
+    unsigned long long number_bits; // Bit j is set if row + j holds a number
+    unsigned long long text_bits; // Same for strings
+private:
+    const Range* range;
+    std::vector<long long> tiles; // Keys of the tiles overlapping the range, sorted
+    long long tile; // Index into tiles
+    std::shared_ptr<const Tile> current; // Tile at index tile
+    long long from_column; // Part of the range inside the current tile
+    long long to_column;
+    long long from_row;
+    long long to_row;
+    long long cursor_column; // Next column of the current tile
+    std::shared_ptr<const Tile> run_tile; // Tile of the run next() returned last, kept even if it is paged out
+    double buffer[TILE_ROWS]; // Numbers of a run of a sparse tile
+
+    void enter_tile();
+};
\ No newline at end of file
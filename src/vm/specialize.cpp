@@ -0,0 +1,188 @@
+#include "specialize.hpp"
+#include "builtins.hpp"
+#include "scope.hpp"
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+struct NonNumericRange {
+    long long column1;
+    long long row1;
+    long long column2;
+    long long row2;
+};
+
+// Cells the program may store something other than a number to
+struct CellTypes {
+    std::unordered_set<long long> cells;
+    std::vector<NonNumericRange> ranges;
+};
+
+static bool is_numeric(const CellTypes& types, const long long column, const long long row) {
+    if (types.cells.count(cell_key(column, row)) != 0) {
+        return false;
+    }
+
+    for (const NonNumericRange& range : types.ranges) {
+        if (column >= range.column1 && column <= range.column2 && row >= range.row1 && row <= range.row2) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static long long argument_column(const Instruction& instruction, const long long index) {
+    return column_to_ord(static_cast<String*>(instruction.arguments[index])->value);
+}
+
+static long long argument_row(const Instruction& instruction, const long long index) {
+    return static_cast<Number*>(instruction.arguments[index])->value;
+}
+
+// Walks the program once with a stack of "known to be a number" flags. Returns whether a store marked
+// new cells as non-numeric, with specialize set it rewrites the instructions instead.
+static bool infer(std::vector<Instruction>& instructions, CellTypes& types, const bool specialize) {
+    std::vector<bool> stack;
+    auto pop = [&stack]() {
+        if (stack.empty()) {
+            return false;
+        }
+
+        bool number = stack.back();
+        stack.pop_back();
+        return number;
+    };
+
+    bool changed = false;
+    for (Instruction& instruction : instructions) {
+        switch (instruction.instruction_type) {
+        case InstructionType::PUSH:
+            stack.push_back(instruction.arguments[0]->data_type == DataType::NUMBER);
+            break;
+        case InstructionType::LODC: {
+            bool number = is_numeric(types, argument_column(instruction, 0), argument_row(instruction, 1));
+            if (specialize && number) {
+                instruction.instruction_type = InstructionType::LODC_N;
+            }
+
+            stack.push_back(number);
+            break;
+        }
+        case InstructionType::LODR:
+        case InstructionType::LODCS:
+        case InstructionType::LODRS:
+            stack.push_back(false);
+            break;
+        case InstructionType::LODF:
+        case InstructionType::CNTF:
+            stack.push_back(true);
+            break;
+        case InstructionType::ADD:
+        case InstructionType::SUB:
+        case InstructionType::MUL:
+        case InstructionType::DIV: {
+            // A missing operand is left to the VM to report
+            bool rhs = pop();
+            bool lhs = pop();
+            if (specialize && lhs && rhs) {
+                InstructionType type = instruction.instruction_type;
+                instruction.instruction_type = type == InstructionType::ADD ? InstructionType::ADD_NN : type == InstructionType::SUB ? InstructionType::SUB_NN : type == InstructionType::MUL ? InstructionType::MUL_NN : InstructionType::DIV_NN;
+            }
+
+            stack.push_back(true);
+            break;
+        }
+        case InstructionType::UPLUS:
+        case InstructionType::UMINUS:
+            pop();
+            stack.push_back(true);
+            break;
+        case InstructionType::CALL: {
+            for (long long i = 0; i < argument_row(instruction, 1); i++) {
+                pop();
+            }
+
+            const BuiltinFunction* builtin = find_builtin(static_cast<String*>(instruction.arguments[0])->value);
+            stack.push_back(builtin != nullptr && builtin->numeric);
+            break;
+        }
+        case InstructionType::STOC:
+            if (!pop() && types.cells.insert(cell_key(argument_column(instruction, 0), argument_row(instruction, 1))).second) {
+                changed = true;
+            }
+
+            break;
+        case InstructionType::STOR:
+            if (!pop()) {
+                long long column1 = argument_column(instruction, 0);
+                long long row1 = argument_row(instruction, 1);
+                long long column2 = argument_column(instruction, 2);
+                long long row2 = argument_row(instruction, 3);
+                NonNumericRange range{std::min(column1, column2), std::min(row1, row2), std::max(column1, column2), std::max(row1, row2)};
+                bool known = false;
+                for (const NonNumericRange& other : types.ranges) {
+                    known = known || (other.column1 == range.column1 && other.row1 == range.row1 && other.column2 == range.column2 && other.row2 == range.row2);
+                }
+
+                if (!known) {
+                    types.ranges.push_back(range);
+                    changed = true;
+                }
+            }
+
+            break;
+        case InstructionType::POP:
+        case InstructionType::STOCS:
+        case InstructionType::STORS:
+            pop();
+            break;
+        case InstructionType::STOA:
+        case InstructionType::STOAS: {
+            // Anything but a plain copy computes numbers
+            long long operand_amount = argument_row(instruction, instruction.instruction_type == InstructionType::STOAS ? 5 : 4);
+            for (long long i = 0; i < operand_amount; i++) {
+                pop();
+            }
+
+            if (instruction.instruction_type == InstructionType::STOA && instruction.arguments.size() == 6) {
+                long long column1 = argument_column(instruction, 0);
+                long long row1 = argument_row(instruction, 1);
+                long long column2 = argument_column(instruction, 2);
+                long long row2 = argument_row(instruction, 3);
+                NonNumericRange range{std::min(column1, column2), std::min(row1, row2), std::max(column1, column2), std::max(row1, row2)};
+                bool known = false;
+                for (const NonNumericRange& other : types.ranges) {
+                    known = known || (other.column1 == range.column1 && other.row1 == range.row1 && other.column2 == range.column2 && other.row2 == range.row2);
+                }
+
+                if (!known) {
+                    types.ranges.push_back(range);
+                    changed = true;
+                }
+            }
+
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    return changed;
+}
+
+void specialize_numbers(std::vector<Instruction>& instructions) {
+    for (Instruction& instruction : instructions) {
+        instruction.instruction_type = generic_type(instruction.instruction_type);
+    }
+
+    CellTypes types;
+    long long passes = 0;
+    while (passes < SPECIALIZE_MAX_PASSES && infer(instructions, types, false)) {
+        passes++;
+    }
+
+    infer(instructions, types, true);
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#include <vector>
+#include "../frontend/interpolation/interpolation.hpp"
+
+#pragma once
+
+const long long SPECIALIZE_MAX_PASSES = 8; // Inference passes before the cell types found so far are used as they are
+
+// Rewrites ADD/SUB/MUL/DIV whose operands are both known to be numbers into their _NN forms, and LODC
+// of cells the program only ever stores numbers to into LODC_N. Cell types are inferred from the
+// values stored: every cell counts as numeric until the program stores something to it that is not
+// known to be a number, and since that can make other stores non-numeric the walk is repeated until
+// nothing changes. Cells can still get other values from outside the program (other sheets, the
+// embedding API, a repeated run), which is what the guard of LODC_N is for. Running the pass twice
+// gives the same result.
+void specialize_numbers(std::vector<Instruction>& instructions);
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "spill.hpp"
+#include "scope.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static void append_words(std::string& buffer, const void* data, const size_t bytes) {
+    buffer.append(static_cast<const char*>(data), bytes);
+}
+
+static void read_words(const char*& cursor, void* data, const size_t bytes) {
+    std::memcpy(data, cursor, bytes);
+    cursor += bytes;
+}
+
+// A tile is written as a header of counts followed by whichever arrays it uses and then its strings
+static void serialize_tile(const Tile* tile, std::string& buffer) {
+    long long header[5] = {tile->count, tile->dense ? 1 : 0, static_cast<long long>(tile->sparse.size()), static_cast<long long>(tile->strings.size()), tile->flags.empty() ? 0 : 1};
+    buffer.clear();
+    append_words(buffer, header, sizeof(header));
+    if (tile->dense) {
+        append_words(buffer, tile->numbers.data(), TILE_CELLS * sizeof(double));
+        append_words(buffer, tile->present.data(), TILE_COLUMNS * sizeof(unsigned long long));
+        append_words(buffer, tile->text.data(), TILE_COLUMNS * sizeof(unsigned long long));
+    } else {
+        append_words(buffer, tile->sparse.data(), tile->sparse.size() * sizeof(SparseCell));
+    }
+
+    if (!tile->flags.empty()) {
+        append_words(buffer, tile->flags.data(), FLAG_COUNT * TILE_COLUMNS * sizeof(unsigned long long));
+    }
+
+    for (auto& text : tile->strings) {
+        long long fields[2] = {text.first, static_cast<long long>(text.second.size())};
+        append_words(buffer, fields, sizeof(fields));
+        buffer += text.second;
+    }
+}
+
+static Tile* deserialize_tile(const char* cursor) {
+    long long header[5];
+    read_words(cursor, header, sizeof(header));
+
+    Tile* tile = new Tile();
+    tile->count = header[0];
+    tile->dense = header[1] != 0;
+    if (tile->dense) {
+        tile->numbers.resize(TILE_CELLS);
+        tile->present.resize(TILE_COLUMNS);
+        tile->text.resize(TILE_COLUMNS);
+        read_words(cursor, tile->numbers.data(), TILE_CELLS * sizeof(double));
+        read_words(cursor, tile->present.data(), TILE_COLUMNS * sizeof(unsigned long long));
+        read_words(cursor, tile->text.data(), TILE_COLUMNS * sizeof(unsigned long long));
+    } else {
+        tile->sparse.resize(header[2]);
+        read_words(cursor, tile->sparse.data(), header[2] * sizeof(SparseCell));
+    }
+
+    if (header[4] != 0) {
+        tile->flags.resize(FLAG_COUNT * TILE_COLUMNS);
+        read_words(cursor, tile->flags.data(), FLAG_COUNT * TILE_COLUMNS * sizeof(unsigned long long));
+    }
+
+    for (long long i = 0; i < header[3]; i++) {
+        long long fields[2];
+        read_words(cursor, fields, sizeof(fields));
+        tile->strings[fields[0]].assign(cursor, fields[1]);
+        cursor += fields[1];
+    }
+
+    return tile;
+}
+
+SpillFile::SpillFile(const std::string& path) {
+    this->path = path;
+    this->fd = -1;
+    this->bytes = 0;
+    this->chunk_used = 0;
+#ifndef _WIN32
+    this->fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (this->fd < 0) {
+        this->throw_io_error("create");
+    }
+
+    unlink(path.c_str());
+#else
+    this->throw_io_error("create");
+#endif
+}
+
+SpillFile::~SpillFile() {
+#ifndef _WIN32
+    for (SpillChunk& chunk : this->chunks) {
+        munmap(chunk.data, chunk.size);
+    }
+
+    if (this->fd >= 0) {
+        close(this->fd);
+    }
+#endif
+}
+
+void SpillFile::add_chunk(const long long size) {
+#ifndef _WIN32
+    if (ftruncate(this->fd, this->bytes + size) != 0) {
+        this->throw_io_error("grow");
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, this->bytes);
+    if (data == MAP_FAILED) {
+        this->throw_io_error("map");
+    }
+
+    this->chunks.push_back(SpillChunk{static_cast<char*>(data), size});
+    this->bytes += size;
+    this->chunk_used = 0;
+#else
+    (void)size;
+    this->throw_io_error("grow");
+#endif
+}
+
+SpillExtent SpillFile::allocate(const long long pages) {
+    std::vector<SpillExtent>& reusable = this->free_extents[pages];
+    if (!reusable.empty()) {
+        SpillExtent extent = reusable.back();
+        reusable.pop_back();
+        return extent;
+    }
+
+    long long size = pages * SPILL_PAGE_BYTES;
+    if (this->chunks.empty() || this->chunk_used + size > this->chunks.back().size) {
+        // The rest of the old chunk stays usable for smaller tiles
+        if (!this->chunks.empty() && this->chunk_used < this->chunks.back().size) {
+            long long rest = (this->chunks.back().size - this->chunk_used) / SPILL_PAGE_BYTES;
+            this->free_extents[rest].push_back(SpillExtent{static_cast<long long>(this->chunks.size()) - 1, this->chunk_used, rest});
+        }
+
+        this->add_chunk(std::max(SPILL_CHUNK_BYTES, size));
+    }
+
+    SpillExtent extent = {static_cast<long long>(this->chunks.size()) - 1, this->chunk_used, pages};
+    this->chunk_used += size;
+    return extent;
+}
+
+SpillExtent SpillFile::write(const Tile* tile) {
+    serialize_tile(tile, this->buffer);
+    long long pages = (static_cast<long long>(this->buffer.size()) + SPILL_PAGE_BYTES - 1) / SPILL_PAGE_BYTES;
+    SpillExtent extent = this->allocate(pages);
+    std::memcpy(this->chunks[extent.chunk].data + extent.offset, this->buffer.data(), this->buffer.size());
+    this->unmap_pages(extent);
+    return extent;
+}
+
+Tile* SpillFile::read(const SpillExtent& extent) const {
+    Tile* tile = deserialize_tile(this->chunks[extent.chunk].data + extent.offset);
+    this->unmap_pages(extent);
+    return tile;
+}
+
+void SpillFile::unmap_pages(const SpillExtent& extent) const {
+#ifndef _WIN32
+    // The pages stay in the file and the page cache, the process just stops holding on to them
+    madvise(this->chunks[extent.chunk].data + extent.offset, extent.pages * SPILL_PAGE_BYTES, MADV_DONTNEED);
+#else
+    (void)extent;
+#endif
+}
+
+void SpillFile::release(const SpillExtent& extent) {
+    this->free_extents[extent.pages].push_back(extent);
+}
+
+void SpillFile::throw_io_error(const std::string& operation) const {
+    std::stringstream ss;
+#ifndef _WIN32
+    ss << "Cannot " << operation << " the spill file " << this->path << ": " << std::strerror(errno);
+#else
+    ss << "Disk-backed sheets are not supported on this platform, cannot " << operation << " " << this->path;
+#endif
+    throw std::runtime_error(ss.str());
+}
+
+SpillFile* create_spill_file(const std::string& path) {
+    return new SpillFile(path);
+}
\ No newline at end of file
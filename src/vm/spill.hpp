@@ -0,0 +1,54 @@
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#pragma once
+
+// The spill file grows and is mapped a chunk at a time, tiles are stored in whole pages
+const long long SPILL_CHUNK_BYTES = 64LL << 20;
+const long long SPILL_PAGE_BYTES = 4096;
+
+struct Tile;
+
+// Where a tile that left memory lives in the spill file
+struct SpillExtent {
+    long long chunk;
+    long long offset; // Inside the chunk
+    long long pages;
+};
+
+struct SpillChunk {
+    char* data;
+    long long size;
+};
+
+// The backing file of a disk-backed scope. Tiles are serialized into extents of a memory-mapped file,
+// so the kernel decides when the bytes actually reach the disk. Freed extents are reused by later tiles
+// needing the same number of pages. The file is unlinked as soon as it is created, nothing is left
+// behind once the process exits.
+class SpillFile {
+public:
+    explicit SpillFile(const std::string& path); // Fails if something already exists at path
+    ~SpillFile();
+    SpillExtent write(const Tile* tile);
+    Tile* read(const SpillExtent& extent) const; // Returns a new tile owned by the caller
+    void release(const SpillExtent& extent); // The extent may be handed out again
+
+    long long bytes; // Size of the file
+private:
+    std::string path;
+    int fd;
+    std::vector<SpillChunk> chunks;
+    long long chunk_used; // Bytes of the last chunk handed out
+    std::unordered_map<long long, std::vector<SpillExtent>> free_extents; // Page count -> extents
+    std::string buffer; // Serialized tile being written
+
+    SpillExtent allocate(const long long pages);
+    void add_chunk(const long long size);
+    void unmap_pages(const SpillExtent& extent) const; // Keeps the resident memory of the process within the budget
+
+    // Errors
+    void throw_io_error(const std::string& operation) const;
+};
+
+SpillFile* create_spill_file(const std::string& path);
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "sum_index.hpp"
+#include "scope.hpp"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+static bool exact_value(const double value) {
+    return std::trunc(value) == value && std::fabs(value) <= SUM_INDEX_EXACT_LIMIT;
+}
+
+// Entry of a table, cells left of or above the tile count as 0
+template <typename Value>
+static Value table_at(const std::vector<Value>& table, const long long column, const long long row) {
+    return column < 0 || row < 0 ? 0 : table[column * TILE_ROWS + row];
+}
+
+template <typename Value>
+static Value rectangle(const std::vector<Value>& table, const long long from_column, const long long from_row, const long long to_column, const long long to_row) {
+    return table_at(table, to_column, to_row) - table_at(table, from_column - 1, to_row) - table_at(table, to_column, from_row - 1) + table_at(table, from_column - 1, from_row - 1);
+}
+
+SumIndex::SumIndex() {
+    this->queries = 0;
+    this->lookups = 0;
+    this->scanned = 0;
+    this->skipped = 0;
+    this->rebuilds = 0;
+    this->rebuilt = 0;
+    this->updated = 0;
+}
+
+void SumIndex::cell_written(const long long tile_key, const long long offset, const bool was_number, const double before, const bool is_number, const double after) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->tiles.find(tile_key);
+    if (it == this->tiles.end() || it->second.stale) {
+        return;
+    }
+
+    // Every entry right of and below the cell changes. Once that adds up to more than a rebuild since
+    // the last query, the tile is left to be rebuilt instead.
+    TileSums& sums = it->second;
+    long long column = offset / TILE_ROWS;
+    long long row = offset % TILE_ROWS;
+    long long cost = (TILE_COLUMNS - column) * (TILE_ROWS - row);
+    if ((is_number && sums.exact && !exact_value(after)) || sums.updates + cost > TILE_CELLS) {
+        sums.stale = true;
+        return;
+    }
+
+    if (is_number && sums.exact) {
+        sums.largest = std::max(sums.largest, std::fabs(after));
+    }
+
+    double delta = (is_number ? after : 0) - (was_number ? before : 0);
+    long long count = (is_number ? 1 : 0) - (was_number ? 1 : 0);
+    for (long long i = column; i < TILE_COLUMNS; i++) {
+        for (long long j = i * TILE_ROWS + row; j < (i + 1) * TILE_ROWS; j++) {
+            sums.counts[j] += count;
+            if (sums.exact) {
+                sums.sums[j] += delta;
+            }
+        }
+    }
+
+    sums.updates += cost;
+    this->updated += cost;
+}
+
+void SumIndex::tile_written(const long long tile_key) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->tiles.find(tile_key);
+    if (it != this->tiles.end()) {
+        it->second.stale = true;
+    }
+}
+
+void SumIndex::drop(const long long tile_key) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->tiles.erase(tile_key);
+}
+
+void SumIndex::clear() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->tiles.clear();
+}
+
+void SumIndex::rebuild(TileSums& sums, const Tile* tile) {
+    sums.sums.assign(TILE_CELLS, 0);
+    sums.counts.assign(TILE_CELLS, 0);
+    sums.exact = true;
+    sums.largest = 0;
+    if (tile->dense) {
+        for (long long offset = 0; offset < TILE_CELLS; offset++) {
+            unsigned long long bit = 1ULL << (offset % TILE_ROWS);
+            if ((tile->present[offset / TILE_ROWS] & ~tile->text[offset / TILE_ROWS] & bit) != 0) {
+                sums.sums[offset] = tile->numbers[offset];
+                sums.counts[offset] = 1;
+                sums.exact = sums.exact && exact_value(tile->numbers[offset]);
+                sums.largest = std::max(sums.largest, std::fabs(tile->numbers[offset]));
+                this->rebuilt++;
+            }
+        }
+    } else {
+        this->rebuilt += tile->sparse.size();
+        for (const SparseCell& cell : tile->sparse) {
+            if (!cell.text) {
+                sums.sums[cell.offset] = cell.number;
+                sums.counts[cell.offset] = 1;
+                sums.exact = sums.exact && exact_value(cell.number);
+                sums.largest = std::max(sums.largest, std::fabs(cell.number));
+            }
+        }
+    }
+
+    for (long long column = 0; column < TILE_COLUMNS; column++) {
+        for (long long row = 0; row < TILE_ROWS; row++) {
+            long long index = column * TILE_ROWS + row;
+            sums.counts[index] += table_at(sums.counts, column, row - 1) + table_at(sums.counts, column - 1, row) - table_at(sums.counts, column - 1, row - 1);
+            if (sums.exact) {
+                sums.sums[index] += table_at(sums.sums, column, row - 1) + table_at(sums.sums, column - 1, row) - table_at(sums.sums, column - 1, row - 1);
+            }
+        }
+    }
+
+    if (!sums.exact) {
+        std::vector<double>().swap(sums.sums);
+    }
+
+    sums.stale = false;
+    this->rebuilds++;
+}
+
+bool SumIndex::aggregate(const long long tile_key, const Tile* tile, const long long from_column, const long long from_row, const long long to_column, const long long to_row, double& sum, long long& count, double& bound) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->tiles.find(tile_key);
+    if (it == this->tiles.end()) {
+        it = this->tiles.emplace(tile_key, TileSums{true, false, 0, 0, {}, {}}).first;
+    }
+
+    TileSums& sums = it->second;
+    if (sums.stale) {
+        this->rebuild(sums, tile);
+    }
+
+    sums.updates = 0;
+    this->queries++;
+    if (!sums.exact) {
+        return false;
+    }
+
+    long long numbers = rectangle(sums.counts, from_column, from_row, to_column, to_row);
+    count += numbers;
+    sum += rectangle(sums.sums, from_column, from_row, to_column, to_row);
+    bound += numbers * sums.largest;
+    this->lookups += 8;
+    return true;
+}
+
+void SumIndex::answered(const long long cells, const bool indexed) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    (indexed ? this->skipped : this->scanned) += cells;
+}
+
+SumIndex* create_sum_index() {
+    return new SumIndex();
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#pragma once
+
+// Integers up to this size sum up exactly inside a tile, a whole tile of them stays below 2^53
+const double SUM_INDEX_EXACT_LIMIT = 1LL << 40;
+const double SUM_INDEX_TOTAL_LIMIT = 1LL << 53; // Doubles hold every integer up to this
+
+struct Tile;
+
+// The summed-area table of one tile: entry column * TILE_ROWS + row holds the sum and the count of the
+// numbers at or above and left of that cell, so any rectangle of the tile takes four lookups.
+struct TileSums {
+    bool stale; // The tile changed since the tables were built
+    bool exact; // Every number is an integer below SUM_INDEX_EXACT_LIMIT, sums is only kept then
+    double largest; // No number of the tile has a larger magnitude, while it is exact
+    long long updates; // Entries updated in place since the tile was last queried
+    std::vector<double> sums;
+    std::vector<unsigned short> counts;
+};
+
+// An optional index of a scope that answers SUM, COUNT and AVERAGE over rectangles without visiting the
+// cells. A single cell write updates the tables of its tile in place, as long as that stays cheaper
+// than rebuilding them, bulk writes only mark the tiles stale and they are rebuilt on the next query.
+// A sum is only answered from the tables when every tile it overlaps holds nothing but integers and
+// no partial sum can pass 2^53. Then every order of adding the cells gives the same result, otherwise
+// the caller adds them up cell by cell, in the order the unindexed evaluation uses.
+// Queries may come from other sheets' threads, every call takes the lock.
+class SumIndex {
+public:
+    SumIndex();
+    void cell_written(const long long tile_key, const long long offset, const bool was_number, const double before, const bool is_number, const double after);
+    void tile_written(const long long tile_key);
+    void drop(const long long tile_key); // The tile left memory or was emptied
+    void clear();
+
+    // Adds the numbers of the rectangle (tile-relative, inclusive) of a tile to sum and count, and the
+    // largest magnitude their partial sums can reach to bound. Returns false if the tile is not exact.
+    bool aggregate(const long long tile_key, const Tile* tile, const long long from_column, const long long from_row, const long long to_column, const long long to_row, double& sum, long long& count, double& bound);
+    void answered(const long long cells, const bool indexed); // Records how a query of that many cells was answered
+
+    long long queries; // Tiles queried
+    long long lookups;
+    long long scanned; // Cells of queries left to the caller, as they overlapped a tile that is not exact
+    long long skipped; // Cells of queries answered by lookups
+    long long rebuilds;
+    long long rebuilt; // Cells read by rebuilds
+    long long updated; // Entries updated by single cell writes
+private:
+    std::mutex mutex;
+    std::unordered_map<long long, TileSums> tiles;
+
+    void rebuild(TileSums& sums, const Tile* tile);
+};
+
+SumIndex* create_sum_index();
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "tables.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+static std::vector<std::unique_ptr<TableEntry>> tables;
+
+Table::~Table() {
+    for (std::vector<RuntimeValue*>& row : this->rows) {
+        for (RuntimeValue* value : row) {
+            delete value;
+        }
+    }
+}
+
+TableEntry::TableEntry(const std::string& path) {
+    this->path = path;
+    this->table = nullptr;
+}
+
+TableEntry::~TableEntry() {
+    delete this->table.load();
+}
+
+static RuntimeValue* parse_field(const char* begin, const char* end, const long long column, const long long row) {
+    // strtod stops at the comma or newline that ends the field, a number has to use all of it
+    char* parsed = nullptr;
+    double number = std::strtod(begin, &parsed);
+    if (begin != end && parsed == end) {
+        return new Number(column, row, number);
+    }
+
+    return new String(column, row, std::string(begin, end));
+}
+
+static Table* read_table(const std::string& path, const Instruction& instruction) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::stringstream ss;
+        ss << "Could not open table " << path << " used at " << instruction.start_column << ":" << instruction.start_row;
+        throw std::runtime_error(ss.str());
+    }
+
+    std::stringstream ss;
+    ss << file.rdbuf();
+    std::string text = ss.str();
+
+    Table* table = new Table();
+    const char* position = text.c_str();
+    const char* text_end = position + text.size();
+    while (position < text_end) {
+        const char* line_end = std::find(position, text_end, '\n');
+        const char* fields_end = line_end > position && line_end[-1] == '\r' ? line_end - 1 : line_end;
+        std::vector<RuntimeValue*> row;
+        while (position < fields_end) {
+            const char* field_end = std::find(position, fields_end, ',');
+            row.push_back(parse_field(position, field_end, row.size() + 1, table->rows.size() + 1));
+            position = field_end + 1;
+        }
+
+        table->rows.push_back(std::move(row));
+        position = line_end + 1;
+    }
+
+    return table;
+}
+
+long long register_table(const std::string& path) {
+    tables.emplace_back(new TableEntry(path));
+    return tables.size();
+}
+
+const Table* find_loaded_table(const long long number) {
+    if (number < 1 || number > static_cast<long long>(tables.size())) {
+        return nullptr;
+    }
+
+    return tables[number - 1]->table.load(std::memory_order_acquire);
+}
+
+const Table* load_table(const long long number, const Instruction& instruction) {
+    if (number < 1 || number > static_cast<long long>(tables.size())) {
+        std::stringstream ss;
+        ss << "Table " << number << " used at " << instruction.start_column << ":" << instruction.start_row << " does not exist, " << tables.size() << " table" << (tables.size() == 1 ? " is" : "s are") << " registered";
+        throw std::runtime_error(ss.str());
+    }
+
+    TableEntry& entry = *tables[number - 1];
+    std::lock_guard<std::mutex> lock(entry.loading);
+    Table* table = entry.table.load(std::memory_order_acquire);
+    if (table == nullptr) {
+        table = read_table(entry.path, instruction);
+        entry.table.store(table, std::memory_order_release);
+    }
+
+    return table;
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../frontend/interpolation/interpolation.hpp"
+
+#pragma once
+
+// A CSV file read into memory. Fields that parse as numbers become numbers, the rest strings.
+struct Table {
+    ~Table();
+    std::vector<std::vector<RuntimeValue*>> rows;
+};
+
+struct TableEntry {
+    explicit TableEntry(const std::string& path);
+    ~TableEntry();
+
+    std::string path;
+    std::mutex loading; // Held while the file is read, so concurrent first uses read it once
+    std::atomic<Table*> table; // nullptr until the file has been read
+};
+
+// Lookup tables programs read through TABLE(number, row, column). Files are registered up front and
+// only read the first time a program uses them, which is what makes TABLE an I/O builtin.
+// Registration is not synchronized with lookups, register every table before running programs.
+long long register_table(const std::string& path); // Returns the number programs refer to the table by, starting at 1
+const Table* find_loaded_table(const long long number); // nullptr if the table is unknown or not read yet, never blocks
+const Table* load_table(const long long number, const Instruction& instruction); // Reads the file if needed, blocks
\ No newline at end of file
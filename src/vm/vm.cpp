@@ -1,130 +1,657 @@
-#include <string>
-#include <unordered_map>
-#include <utility>
-#include "vm.hpp"
-#include <sstream>
-
-long long column_to_ord(const std::string column) {
-    long long ord = 0;
-    for (long long i = 0; i < column.size(); i++) {
-        ord *= 26;
-        ord += std::tolower(column[i]) - 'a';
-    }
-
-    return ord;
-}
-
-Number::Number(const long long start_column, const long long start_line, const double value) {
-    this->data_type = DataType::NUMBER;
-    this->value = value;
-
-    this->start_column = start_column;
-    this->start_line = start_line;
-}
-
-String::String(const long long start_column, const long long start_line, const std::string value) {
-    this->data_type = DataType::STRING;
-    this->value = value;
-
-    this->start_column = start_column;
-    this->start_line = start_line;
-}
-
-Scope::Scope() {
-    this->assignments.clear();
-}
-
-void Scope::assign_cell(const std::string column, const long long row, const RuntimeValue value) {
-    std::stringstream ss;
-    ss << "c"; // c stands for cell assignment
-    for (long long i = 0; i < column.size(); i++) {
-        ss << std::tolower(column[i]);
-    }
-
-    ss << row;
-    this->assignments[ss.str()] = value;
-}
-
-void Scope::assign_range(const std::string column1, const long long row1, const std::string column2, const long long row2, const RuntimeValue value) {
-    std::stringstream ss;
-    ss << "r"; // r stands for range assignment
-    for (long long i = 0; i < column1.size(); i++) {
-        ss << std::tolower(column1[i]);
-    }
-
-    for (long long i = 0; i < column2.size(); i++) {
-        ss << std::tolower(column2[i]);
-    }
-
-    ss << row2;
-    this->assignments[ss.str()] = value;
-}
-
-RuntimeValue Scope::retrieve(const long long start_column, const long long start_row, const std::string column, const long long row) const {
-    for (auto it = this->assignments.begin(); it != this->assignments.end(); it++) {
-        if (it->first[0] == 'c') {
-            // Cell assignment
-            std::string column_scope = "";
-            long long row_scope = 0;
-            for (long long i = 1; i < it->first.size(); i++) {
-                if ('0' <= it->first[i] && it->first[i] <= '9') {
-                    row_scope *= 10;
-                    row_scope += it->first[i] - '0';
-                } else {
-                    column_scope += it->first[i];
-                }
-            }
-
-            if (column.size() != column_scope.size()) {
-                continue;
-            }
-
-            bool flag = true;
-            for (long long i = 0; i < column.size(); i++) {
-                if (std::tolower(column[i]) != column_scope[i]) {
-                    flag = false;
-                }
-            }
-
-            if (!flag || row != row_scope) {
-                continue;
-            }
-
-            return it->second;
-        }
-
-        // Range assignment
-        long long column1 = 0;
-        long long row1 = 0;
-        
-        long long column2 = 0;
-        long long row2 = 0;
-
-        for (long long i = 1; i < it->first.size(); i++) {
-            if ('0' <= it->first[i] && it->first[i] <= '9') {
-                if (column2 == 0) {
-                    row1 *= 10;
-                    row1 += it->first[i] - '0';
-                } else {
-                    row2 *= 10;
-                    row2 += it->first[i] - '0';
-                }
-            } else if (row1 == 0) {
-                column1 *= 26;
-                column1 += it->first[i] - 'a';
-            } else {
-                column2 *= 26;
-                column2 += it->first[i] - 'a';
-            }
-        }
-
-        long long column_idx = column_to_ord(column);
-        long long row_idx = row;
-
-        if (column1 <= column_idx && column_idx <= column2 && row1 <= row_idx && row_idx <= row2) {
-            return it->second;
-        }
-    }
-
-    return Number(start_column, start_row, 0);
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <vector>
+#include "vm.hpp"
+#include "array.hpp"
+#include "async.hpp"
+#include "builtins.hpp"
+#include "call_cache.hpp"
+#include "jit.hpp"
+#include "lazy.hpp"
+#include "workbook.hpp"
+#include <sstream>
+#include <stdexcept>
+
+std::pair<long long, long long> stack_effect(const Instruction& instruction) {
+    switch (generic_type(instruction.instruction_type)) {
+    case InstructionType::PUSH:
+    case InstructionType::LODC:
+    case InstructionType::LODR:
+    case InstructionType::LODCS:
+    case InstructionType::LODRS:
+    case InstructionType::LODF:
+    case InstructionType::CNTF:
+        return {0, 1};
+    case InstructionType::POP:
+    case InstructionType::STOC:
+    case InstructionType::STOR:
+    case InstructionType::STOCS:
+    case InstructionType::STORS:
+        return {1, 0};
+    case InstructionType::ADD:
+    case InstructionType::SUB:
+    case InstructionType::MUL:
+    case InstructionType::DIV:
+        return {2, 1};
+    case InstructionType::UPLUS:
+    case InstructionType::UMINUS:
+        return {1, 1};
+    case InstructionType::CALL:
+        return {static_cast<long long>(static_cast<Number*>(instruction.arguments[1])->value), 1};
+    case InstructionType::STOA:
+        return {static_cast<long long>(static_cast<Number*>(instruction.arguments[4])->value), 0};
+    case InstructionType::STOAS:
+        return {static_cast<long long>(static_cast<Number*>(instruction.arguments[5])->value), 0};
+    default:
+        return {0, 0};
+    }
+}
+
+std::vector<long long> find_store_spans(const std::vector<Instruction>& instructions) {
+    // The values a store pops are computed by the shortest run of instructions before it that starts as
+    // many values below the store's depth and never drops under that
+    long long instruction_amount = instructions.size();
+    std::vector<long long> depth_before(instruction_amount);
+    long long depth = 0;
+    for (long long position = 0; position < instruction_amount; position++) {
+        depth_before[position] = depth;
+        std::pair<long long, long long> effect = stack_effect(instructions[position]);
+        depth = std::max(0LL, depth - effect.first) + effect.second;
+    }
+
+    std::vector<long long> starts(instruction_amount, -1);
+    for (long long position = 0; position < instruction_amount; position++) {
+        InstructionType type = instructions[position].instruction_type;
+        bool store = type == InstructionType::STOC || type == InstructionType::STOR || type == InstructionType::STOCS || type == InstructionType::STORS || type == InstructionType::STOA || type == InstructionType::STOAS;
+        long long pops = store ? stack_effect(instructions[position]).first : 0;
+        if (!store || pops < 1 || depth_before[position] < pops) {
+            continue;
+        }
+
+        long long start = position - 1;
+        while (start >= 0 && depth_before[start] > depth_before[position] - pops) {
+            start--;
+        }
+
+        if (start >= 0 && depth_before[start] == depth_before[position] - pops) {
+            starts[position] = start;
+        }
+    }
+
+    return starts;
+}
+
+VM::VM(const std::vector<Instruction>& instructions, Scope* scope) : instructions(instructions) {
+    this->stack = nullptr;
+    this->top = nullptr;
+    this->stack_capacity = 0;
+    this->verify_stack();
+    this->allocate_stack(this->max_depth + 1);
+
+    this->scope = scope;
+    this->workbook = nullptr;
+    this->jit = create_jit(this);
+    this->lazy = nullptr;
+    this->call_cache = create_call_cache(CALL_CACHE_CAPACITY);
+    this->async = nullptr;
+    this->executing = -1;
+    this->jump = -1;
+    this->deoptimized = false;
+}
+
+VM::~VM() {
+    delete this->async;
+    this->clear_stack();
+    operator delete[](this->stack, std::align_val_t(STACK_ALIGNMENT));
+    delete this->jit;
+    delete this->lazy;
+    delete this->call_cache;
+}
+
+void VM::set_jit_enabled(const bool enabled) {
+    this->jit->enabled = enabled;
+}
+
+void VM::set_call_cache_enabled(const bool enabled) {
+    if (enabled && this->call_cache == nullptr) {
+        this->call_cache = create_call_cache(CALL_CACHE_CAPACITY);
+    } else if (!enabled) {
+        delete this->call_cache;
+        this->call_cache = nullptr;
+    }
+}
+
+void VM::set_scope(Scope* scope) {
+    // Deferred formulas and parked statements belong to the old sheet
+    this->scope = scope;
+    if (this->async != nullptr) {
+        this->async->clear();
+    }
+
+    if (this->lazy != nullptr) {
+        this->set_lazy(true);
+    }
+}
+
+void VM::set_workbook(Workbook* workbook) {
+    this->workbook = workbook;
+}
+
+void VM::set_lazy(const bool enabled) {
+    delete this->lazy;
+    this->lazy = enabled ? create_lazy(this) : nullptr;
+}
+
+void VM::evaluate_formulas() {
+    if (this->lazy != nullptr) {
+        this->lazy->evaluate_all();
+    }
+}
+
+RuntimeValue* VM::retrieve(const long long column, const long long row) {
+    if (this->lazy != nullptr) {
+        this->lazy->read(cell_key(column, row));
+    }
+
+    return this->scope->retrieve(0, 0, column, row);
+}
+
+void VM::print_stats(std::ostream& out) const {
+    this->scope->print_stats(out);
+    out << "jit compiled blocks: " << this->jit->compiled_blocks << "\n";
+    out << "jit native runs: " << this->jit->native_runs << "\n";
+    out << "jit bailouts: " << this->jit->bailouts << "\n";
+    if (this->call_cache != nullptr) {
+        out << "call cache hits: " << this->call_cache->hits << "\n";
+        out << "call cache misses: " << this->call_cache->misses << "\n";
+        out << "call cache bypassed: " << this->call_cache->bypassed << "\n";
+    }
+
+    if (this->lazy != nullptr) {
+        out << "lazy formulas defined: " << this->lazy->defined << "\n";
+        out << "lazy formulas evaluated: " << this->lazy->evaluated << "\n";
+    }
+
+    if (this->async != nullptr) {
+        out << "async statements parked: " << this->async->parked_statements << "\n";
+        out << "async waits: " << this->async->waits << "\n";
+    }
+}
+
+void VM::run() {
+    this->clear_stack();
+    this->deoptimized = false;
+    if (this->async != nullptr) {
+        this->async->clear();
+    }
+
+    long long instruction_amount = this->instructions.size();
+    long long position = 0;
+    while (position < instruction_amount) {
+        if (this->async != nullptr && this->async->has_parked()) {
+            // Compiled blocks do not check what they touch against the parked statements
+            this->async->before(position);
+        } else {
+            // Compiled blocks store eagerly, so the JIT sits out while assignments are deferred
+            long long next = this->lazy != nullptr ? this->lazy->try_define(position) : this->jit->try_run(position);
+            if (next != position) {
+                position = next;
+                continue;
+            }
+        }
+
+        this->executing = position;
+        this->execute(this->instructions[position]);
+        if (this->jump >= 0) {
+            position = this->jump;
+            this->jump = -1;
+            continue;
+        }
+
+        position++;
+    }
+
+    this->executing = -1;
+    if (this->async != nullptr) {
+        this->async->finish();
+    }
+}
+
+void VM::execute(const Instruction& instruction) {
+    switch (instruction.instruction_type) {
+    case InstructionType::NOP:
+        break;
+    case InstructionType::PUSH:
+        this->push(copy_value(instruction.arguments[0]));
+        break;
+    case InstructionType::POP:
+        delete this->pop();
+        break;
+    case InstructionType::ADD: {
+        double rhs = this->pop_number(instruction);
+        double lhs = this->pop_number(instruction);
+        this->push(new Number(instruction.start_column, instruction.start_row, lhs + rhs));
+        break;
+    }
+    case InstructionType::SUB: {
+        double rhs = this->pop_number(instruction);
+        double lhs = this->pop_number(instruction);
+        this->push(new Number(instruction.start_column, instruction.start_row, lhs - rhs));
+        break;
+    }
+    case InstructionType::MUL: {
+        double rhs = this->pop_number(instruction);
+        double lhs = this->pop_number(instruction);
+        this->push(new Number(instruction.start_column, instruction.start_row, lhs * rhs));
+        break;
+    }
+    case InstructionType::DIV: {
+        double rhs = this->pop_number(instruction);
+        double lhs = this->pop_number(instruction);
+        this->push(new Number(instruction.start_column, instruction.start_row, lhs / rhs));
+        break;
+    }
+    case InstructionType::ADD_NN: {
+        Number* rhs;
+        Number* lhs = this->numeric_operands(instruction, rhs);
+        lhs->value += rhs->value;
+        delete rhs;
+        break;
+    }
+    case InstructionType::SUB_NN: {
+        Number* rhs;
+        Number* lhs = this->numeric_operands(instruction, rhs);
+        lhs->value -= rhs->value;
+        delete rhs;
+        break;
+    }
+    case InstructionType::MUL_NN: {
+        Number* rhs;
+        Number* lhs = this->numeric_operands(instruction, rhs);
+        lhs->value *= rhs->value;
+        delete rhs;
+        break;
+    }
+    case InstructionType::DIV_NN: {
+        Number* rhs;
+        Number* lhs = this->numeric_operands(instruction, rhs);
+        lhs->value /= rhs->value;
+        delete rhs;
+        break;
+    }
+    case InstructionType::UPLUS:
+        this->push(new Number(instruction.start_column, instruction.start_row, this->pop_number(instruction)));
+        break;
+    case InstructionType::UMINUS:
+        this->push(new Number(instruction.start_column, instruction.start_row, -this->pop_number(instruction)));
+        break;
+    case InstructionType::STOC:
+    case InstructionType::STOCS: {
+        long long offset = instruction.instruction_type == InstructionType::STOCS ? 1 : 0;
+        Scope* scope = this->sheet_of(instruction);
+        long long column = column_to_ord(static_cast<String*>(instruction.arguments[offset])->value);
+        long long row = static_cast<Number*>(instruction.arguments[offset + 1])->value;
+        scope->assign_cell(column, row, this->pop());
+        this->deoptimized = false;
+        if (this->lazy != nullptr && scope == this->scope) {
+            this->lazy->written(column, row, column, row);
+        }
+
+        break;
+    }
+    case InstructionType::STOR:
+    case InstructionType::STORS: {
+        long long offset = instruction.instruction_type == InstructionType::STORS ? 1 : 0;
+        Scope* scope = this->sheet_of(instruction);
+        RuntimeValue* value = this->pop();
+        long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[offset])->value);
+        long long row1 = static_cast<Number*>(instruction.arguments[offset + 1])->value;
+        long long column2 = column_to_ord(static_cast<String*>(instruction.arguments[offset + 2])->value);
+        long long row2 = static_cast<Number*>(instruction.arguments[offset + 3])->value;
+        scope->assign_range(column1, row1, column2, row2, value);
+        delete value;
+        this->deoptimized = false;
+        if (this->lazy != nullptr && scope == this->scope) {
+            this->lazy->written(column1, row1, column2, row2);
+        }
+
+        break;
+    }
+    case InstructionType::STOA:
+    case InstructionType::STOAS: {
+        long long offset = instruction.instruction_type == InstructionType::STOAS ? 1 : 0;
+        Scope* scope = this->sheet_of(instruction);
+        long long operand_amount = static_cast<Number*>(instruction.arguments[offset + 4])->value;
+        std::vector<RuntimeValue*> operands(this->top - operand_amount, this->top);
+        this->top -= operand_amount;
+        try {
+            assign_array(scope, instruction, operands);
+        } catch (...) {
+            for (RuntimeValue* operand : operands) {
+                delete operand;
+            }
+
+            throw;
+        }
+
+        for (RuntimeValue* operand : operands) {
+            delete operand;
+        }
+
+        this->deoptimized = false;
+        if (this->lazy != nullptr && scope == this->scope) {
+            long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[offset])->value);
+            long long row1 = static_cast<Number*>(instruction.arguments[offset + 1])->value;
+            long long column2 = column_to_ord(static_cast<String*>(instruction.arguments[offset + 2])->value);
+            long long row2 = static_cast<Number*>(instruction.arguments[offset + 3])->value;
+            this->lazy->written(column1, row1, column2, row2);
+        }
+
+        break;
+    }
+    case InstructionType::LODC:
+    case InstructionType::LODCS: {
+        long long offset = instruction.instruction_type == InstructionType::LODCS ? 1 : 0;
+        long long column = column_to_ord(static_cast<String*>(instruction.arguments[offset])->value);
+        long long row = static_cast<Number*>(instruction.arguments[offset + 1])->value;
+        if (this->lazy != nullptr && offset == 0) {
+            this->lazy->read(cell_key(column, row));
+        }
+
+        this->push(this->sheet_of(instruction)->retrieve(instruction.start_column, instruction.start_row, column, row));
+        break;
+    }
+    case InstructionType::LODR:
+    case InstructionType::LODRS: {
+        long long offset = instruction.instruction_type == InstructionType::LODRS ? 1 : 0;
+        long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[offset])->value);
+        long long row1 = static_cast<Number*>(instruction.arguments[offset + 1])->value;
+        long long column2 = column_to_ord(static_cast<String*>(instruction.arguments[offset + 2])->value);
+        long long row2 = static_cast<Number*>(instruction.arguments[offset + 3])->value;
+        if (this->lazy != nullptr && offset == 0) {
+            this->lazy->read_range(column1, row1, column2, row2);
+        }
+
+        this->push(new Range(instruction.start_column, instruction.start_row, this->sheet_of(instruction), column1, row1, column2, row2));
+        break;
+    }
+    case InstructionType::LODC_N: {
+        long long column = column_to_ord(static_cast<String*>(instruction.arguments[0])->value);
+        long long row = static_cast<Number*>(instruction.arguments[1])->value;
+        long long key = cell_key(column, row);
+        if (this->lazy != nullptr) {
+            this->lazy->read(key);
+        }
+
+        double value;
+        if (this->scope->retrieve_number(key, value)) {
+            this->push(new Number(instruction.start_column, instruction.start_row, value));
+        } else {
+            // Something outside the program put a non-number here, the rest of the statement runs unspecialized
+            this->deoptimized = true;
+            this->push(this->scope->retrieve(instruction.start_column, instruction.start_row, column, row));
+        }
+
+        break;
+    }
+    case InstructionType::STOF:
+    case InstructionType::STFR:
+    case InstructionType::LODF:
+    case InstructionType::CNTF: {
+        // Flag number first, then the cell or both corners of the range, STOF/STFR end with the value
+        long long flag = static_cast<Number*>(instruction.arguments[0])->value;
+        long long column1 = column_to_ord(static_cast<String*>(instruction.arguments[1])->value);
+        long long row1 = static_cast<Number*>(instruction.arguments[2])->value;
+        long long column2 = column1;
+        long long row2 = row1;
+        if (instruction.instruction_type == InstructionType::STFR || instruction.instruction_type == InstructionType::CNTF) {
+            column2 = column_to_ord(static_cast<String*>(instruction.arguments[3])->value);
+            row2 = static_cast<Number*>(instruction.arguments[4])->value;
+        }
+
+        if (instruction.instruction_type == InstructionType::STOF || instruction.instruction_type == InstructionType::STFR) {
+            this->scope->assign_flag(flag, column1, row1, column2, row2, static_cast<Number*>(instruction.arguments.back())->value != 0);
+        } else if (instruction.instruction_type == InstructionType::LODF) {
+            this->push(new Number(instruction.start_column, instruction.start_row, this->scope->retrieve_flag(flag, column1, row1) ? 1 : 0));
+        } else {
+            this->push(new Number(instruction.start_column, instruction.start_row, this->scope->count_flags(flag, column1, row1, column2, row2)));
+        }
+
+        break;
+    }
+    case InstructionType::CALL: {
+        const BuiltinFunction* builtin = find_builtin(static_cast<String*>(instruction.arguments[0])->value);
+        if (builtin == nullptr) {
+            this->throw_instruction_not_supported(instruction);
+        }
+
+        long long argument_amount = static_cast<Number*>(instruction.arguments[1])->value;
+        std::vector<RuntimeValue*> arguments(this->top - argument_amount, this->top);
+        this->top -= argument_amount;
+        if (builtin->nonblocking != nullptr) {
+            // I/O builtins may finish on another thread, which must not read the sheet
+            for (RuntimeValue*& argument : arguments) {
+                if (argument->data_type == DataType::RANGE) {
+                    RuntimeValue* corner = static_cast<Range*>(argument)->top_left();
+                    delete argument;
+                    argument = corner;
+                }
+            }
+        }
+
+        bool cached = builtin->pure && this->call_cache != nullptr;
+        RuntimeValue* result = cached ? this->call_cache->find(builtin, arguments, instruction) : nullptr;
+        try {
+            if (result == nullptr && builtin->nonblocking != nullptr) {
+                // An I/O call that would block parks its statement, run() carries on without it
+                result = builtin->nonblocking(arguments, instruction);
+                if (result == nullptr && this->suspend(builtin, arguments, instruction)) {
+                    break;
+                }
+            }
+
+            if (result == nullptr) {
+                result = builtin->function(arguments, instruction);
+                if (cached) {
+                    this->call_cache->insert(result);
+                }
+            }
+        } catch (...) {
+            for (RuntimeValue* argument : arguments) {
+                delete argument;
+            }
+
+            throw;
+        }
+
+        for (RuntimeValue* argument : arguments) {
+            delete argument;
+        }
+
+        this->push(result);
+        break;
+    }
+    default:
+        this->throw_instruction_not_supported(instruction);
+    }
+}
+
+bool VM::suspend(const BuiltinFunction* builtin, std::vector<RuntimeValue*>& arguments, const Instruction& instruction) {
+    // Deferred formulas are evaluated from inside other instructions, where there is nothing to continue with
+    if (this->executing < 0 || this->lazy != nullptr) {
+        return false;
+    }
+
+    if (this->async == nullptr) {
+        this->async = create_async(this);
+    }
+
+    return this->async->suspend(builtin, arguments, instruction, this->executing);
+}
+
+Scope* VM::sheet_of(const Instruction& instruction) {
+    switch (instruction.instruction_type) {
+    case InstructionType::STOCS:
+    case InstructionType::LODCS:
+    case InstructionType::STORS:
+    case InstructionType::LODRS:
+    case InstructionType::STOAS:
+        if (this->workbook == nullptr) {
+            std::stringstream ss;
+            ss << "Sheet '" << static_cast<String*>(instruction.arguments[0])->value << "' at " << instruction.start_column << ":" << instruction.start_row << " can only be used when running a workbook";
+            throw std::runtime_error(ss.str());
+        }
+
+        return this->workbook->sheet(static_cast<String*>(instruction.arguments[0])->value);
+    default:
+        return this->scope;
+    }
+}
+
+void VM::verify_stack() {
+    // The program has no jumps, so one walk sees every depth it can run at
+    long long depth = 0;
+    this->max_depth = 0;
+    for (const Instruction& instruction : this->instructions) {
+        // stack_effect trusts the count of values CALL, STOA and STOAS pop, so it is checked first
+        InstructionType type = instruction.instruction_type;
+        long long count = type == InstructionType::CALL ? 1 : type == InstructionType::STOA ? 4 : type == InstructionType::STOAS ? 5 : -1;
+        if (count >= 0) {
+            if (static_cast<long long>(instruction.arguments.size()) <= count || instruction.arguments[count]->data_type != DataType::NUMBER) {
+                this->throw_malformed_count(instruction);
+            }
+
+            double value = static_cast<Number*>(instruction.arguments[count])->value;
+            if (!(value >= 0) || std::trunc(value) != value) {
+                this->throw_malformed_count(instruction);
+            }
+
+            if (value > depth) {
+                this->throw_stack_underflow(instruction);
+            }
+        }
+
+        std::pair<long long, long long> effect = stack_effect(instruction);
+        if (depth < effect.first) {
+            this->throw_stack_underflow(instruction);
+        }
+
+        depth += effect.second - effect.first;
+        this->max_depth = std::max(this->max_depth, depth);
+    }
+}
+
+void VM::allocate_stack(const long long capacity) {
+    RuntimeValue** block = static_cast<RuntimeValue**>(operator new[](capacity * sizeof(RuntimeValue*), std::align_val_t(STACK_ALIGNMENT)));
+    long long depth = this->stack_depth();
+    if (this->stack != nullptr) {
+        std::copy(this->stack, this->top, block);
+        operator delete[](this->stack, std::align_val_t(STACK_ALIGNMENT));
+    }
+
+    this->stack = block;
+    this->top = block + depth;
+    this->stack_capacity = capacity;
+}
+
+void VM::reserve_stack(const long long values) {
+    long long depth = this->stack_depth();
+    if (depth + values > this->stack_capacity) {
+        this->allocate_stack(std::max(this->stack_capacity * 2, depth + values));
+    }
+}
+
+void VM::push(RuntimeValue* value) {
+    *this->top++ = value;
+}
+
+long long VM::stack_depth() const {
+    return this->top - this->stack;
+}
+
+void VM::clear_stack() {
+    for (RuntimeValue** value = this->stack; value != this->top; value++) {
+        delete *value;
+    }
+
+    this->top = this->stack;
+}
+
+RuntimeValue* VM::pop() {
+    RuntimeValue* value = *--this->top;
+    if (value->data_type == DataType::RANGE) {
+        // Only builtins take whole ranges, everything else gets the top-left corner
+        RuntimeValue* corner = static_cast<Range*>(value)->top_left();
+        delete value;
+        return corner;
+    }
+
+    return value;
+}
+
+double VM::pop_number(const Instruction& instruction) {
+    RuntimeValue* value = this->pop();
+    if (value->data_type != DataType::NUMBER) {
+        this->push(value);
+        this->throw_not_a_number(instruction, value);
+    }
+
+    double number = static_cast<Number*>(value)->value;
+    delete value;
+    return number;
+}
+
+Number* VM::numeric_operands(const Instruction& instruction, Number*& rhs) {
+    if (this->deoptimized) {
+        // Checked like the generic instruction
+        double right = this->pop_number(instruction);
+        double left = this->pop_number(instruction);
+        rhs = new Number(instruction.start_column, instruction.start_row, right);
+        this->push(new Number(instruction.start_column, instruction.start_row, left));
+        return static_cast<Number*>(this->top[-1]);
+    }
+
+    rhs = static_cast<Number*>(*--this->top);
+    Number* lhs = static_cast<Number*>(this->top[-1]);
+    lhs->start_column = instruction.start_column;
+    lhs->start_line = instruction.start_row;
+    return lhs;
+}
+
+// Errors
+void VM::throw_stack_underflow(const Instruction& instruction) {
+    std::stringstream ss;
+    ss << "Instruction at " << instruction.start_column << ":" << instruction.start_row << " pops more values than the stack holds";
+    throw std::runtime_error(ss.str());
+}
+
+void VM::throw_malformed_count(const Instruction& instruction) {
+    std::stringstream ss;
+    ss << "Instruction at " << instruction.start_column << ":" << instruction.start_row << " has no whole, non-negative count of the values it pops";
+    throw std::runtime_error(ss.str());
+}
+
+void VM::throw_not_a_number(const Instruction& instruction, const RuntimeValue* value) {
+    std::stringstream ss;
+    ss << "Value from " << value->start_column << ":" << value->start_line << " used by the instruction at " << instruction.start_column << ":" << instruction.start_row << " is not a number";
+    throw std::runtime_error(ss.str());
+}
+
+void VM::throw_instruction_not_supported(const Instruction& instruction) {
+    std::stringstream ss;
+    if (instruction.instruction_type == InstructionType::CALL) {
+        ss << "Function '" << static_cast<String*>(instruction.arguments[0])->value << "' at " << instruction.start_column << ":" << instruction.start_row << " does not exist";
+    } else {
+        ss << "Instruction type " << static_cast<int>(instruction.instruction_type) << " at " << instruction.start_column << ":" << instruction.start_row << " is not supported by the VM";
+    }
+
+    throw std::runtime_error(ss.str());
+}
+
+VM* create_vm(const std::vector<Instruction>& instructions, Scope* scope) {
+    return new VM(instructions, scope);
 }
\ No newline at end of file
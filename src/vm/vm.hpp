@@ -1,39 +1,83 @@
-#include <string>
-#include <unordered_map>
-#include <utility>
-
-#pragma once
-
-enum class DataType {
-    NUMBER,
-    STRING
-};
-
-class RuntimeValue {
-public:
-    DataType data_type;
-    long long start_column;
-    long long start_line;
-};
-
-class Number : public RuntimeValue {
-public:
-    Number(const long long start_column, const long long start_line, const double value);
-    double value;
-};
-
-class String : public RuntimeValue {
-public:
-    String(const long long start_column, const long long start_line, const std::string value);
-    std::string value;
-};
-
-class Scope {
-public:
-    Scope();
-    void assign_cell(const std::string column, const long long row, const RuntimeValue value);
-    void assign_range(const std::string column1, const long long row1, const std::string column2, const long long row2, const RuntimeValue value);
-    RuntimeValue retrieve(const long long start_column, const long long start_row, const std::string column, const long long row) const;
-private:
-    std::unordered_map<std::string, RuntimeValue> assignments;
-};
\ No newline at end of file
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <ostream>
+#include "../frontend/interpolation/interpolation.hpp"
+#include "scope.hpp"
+
+#pragma once
+
+std::pair<long long, long long> stack_effect(const Instruction& instruction); // Values the instruction pops and pushes
+
+const long long STACK_ALIGNMENT = 64; // The operand stack starts on a cache line
+
+// For every cell or range store, the start of the shortest run of instructions before it that computes
+// the value it stores, -1 for other instructions and stores whose value cannot be attributed that way
+std::vector<long long> find_store_spans(const std::vector<Instruction>& instructions);
+
+class Async;
+class CallCache;
+class Jit;
+class Lazy;
+class Workbook;
+struct BuiltinFunction;
+
+class VM {
+public:
+    VM(const std::vector<Instruction>& instructions, Scope* scope);
+    ~VM();
+    void run();
+    void set_jit_enabled(const bool enabled);
+    void set_call_cache_enabled(const bool enabled); // Memoize pure builtin calls across cells and runs, on by default
+    void set_scope(Scope* scope); // Later runs read and write this sheet instead
+    void set_workbook(Workbook* workbook); // Needed to run instructions that reach into other sheets
+    void set_lazy(const bool enabled); // Defer cell assignments until the cell is read, see Lazy
+    void evaluate_formulas(); // Computes every deferred cell that is not up to date
+    RuntimeValue* retrieve(const long long column, const long long row); // Reads a cell like the program would, computing it first if it is deferred
+    void print_stats(std::ostream& out) const;
+private:
+    const std::vector<Instruction>& instructions;
+    Scope* scope;
+    Workbook* workbook;
+    Jit* jit;
+    Lazy* lazy;
+    CallCache* call_cache;
+    Async* async; // Created by the first I/O call that would block
+    long long executing; // Position of the instruction run() is executing, -1 outside of run()
+    long long jump; // Set when an instruction moves run() elsewhere, -1 otherwise
+    bool deoptimized; // A LODC_N found a non-number, _NN instructions check their operands until the next store
+
+    // The operand stack is one block allocated up front, verify_stack proves the program never takes it
+    // past max_depth or below empty, so pushes and pops do not check anything. Only evaluations nested
+    // inside an instruction (deferred formulas, resumed statements) go deeper, they reserve room first.
+    RuntimeValue** stack;
+    RuntimeValue** top; // One past the topmost value
+    long long stack_capacity;
+    long long max_depth;
+
+    void execute(const Instruction& instruction);
+    bool suspend(const BuiltinFunction* builtin, std::vector<RuntimeValue*>& arguments, const Instruction& instruction);
+    Scope* sheet_of(const Instruction& instruction); // The scope an instruction works on, for the *S variants the named sheet
+    void verify_stack(); // Sets max_depth
+    void allocate_stack(const long long capacity); // Keeps the values
+    void reserve_stack(const long long values); // Makes room for that many more values
+    void push(RuntimeValue* value);
+    long long stack_depth() const;
+    void clear_stack();
+    RuntimeValue* pop();
+    double pop_number(const Instruction& instruction);
+    Number* numeric_operands(const Instruction& instruction, Number*& rhs); // For _NN instructions, the left operand stays on the stack
+
+    // Errors
+    void throw_stack_underflow(const Instruction& instruction);
+    void throw_malformed_count(const Instruction& instruction);
+    void throw_not_a_number(const Instruction& instruction, const RuntimeValue* value);
+    void throw_instruction_not_supported(const Instruction& instruction);
+
+    friend class Async;
+    friend class Jit;
+    friend class Lazy;
+};
+
+VM* create_vm(const std::vector<Instruction>& instructions, Scope* scope);
\ No newline at end of file
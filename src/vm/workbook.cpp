@@ -0,0 +1,247 @@
+#include "workbook.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::string lower(std::string name) {
+    for (char& character : name) {
+        character = std::tolower(character);
+    }
+
+    return name;
+}
+
+static bool intersects(const std::set<long long>& lhs, const std::set<long long>& rhs) {
+    for (long long value : lhs) {
+        if (rhs.count(value) != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+Workbook::Workbook() {
+    this->sheets.clear();
+}
+
+Workbook::~Workbook() {
+    for (Sheet& sheet : this->sheets) {
+        delete sheet.scope;
+    }
+}
+
+void Workbook::add_sheet(const std::string& name, const std::vector<Instruction>* program) {
+    if (this->indexes.count(lower(name)) != 0) {
+        std::stringstream ss;
+        ss << "Sheet '" << name << "' already exists";
+        throw std::runtime_error(ss.str());
+    }
+
+    this->indexes[lower(name)] = this->sheets.size();
+    this->sheets.push_back(Sheet{name, new Scope(), program});
+}
+
+Scope* Workbook::sheet(const std::string& name) const {
+    return this->sheets[this->index_of(name)].scope;
+}
+
+long long Workbook::index_of(const std::string& name) const {
+    auto it = this->indexes.find(lower(name));
+    if (it == this->indexes.end()) {
+        this->throw_unknown_sheet(name);
+    }
+
+    return it->second;
+}
+
+std::vector<std::vector<long long>> Workbook::dependents() {
+    long long sheet_amount = this->sheets.size();
+    std::vector<std::set<long long>> reads(sheet_amount);
+    std::vector<std::set<long long>> writes(sheet_amount);
+    for (long long i = 0; i < sheet_amount; i++) {
+        reads[i].insert(i);
+        writes[i].insert(i);
+        for (const Instruction& instruction : *this->sheets[i].program) {
+            switch (instruction.instruction_type) {
+            case InstructionType::LODCS:
+            case InstructionType::LODRS:
+                reads[i].insert(this->index_of(static_cast<String*>(instruction.arguments[0])->value));
+                break;
+            case InstructionType::STOCS:
+            case InstructionType::STORS:
+            case InstructionType::STOAS:
+                writes[i].insert(this->index_of(static_cast<String*>(instruction.arguments[0])->value));
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    std::vector<std::vector<long long>> dependents(sheet_amount);
+    for (long long i = 0; i < sheet_amount; i++) {
+        for (long long j = i + 1; j < sheet_amount; j++) {
+            bool i_first = intersects(writes[i], reads[j]);
+            bool j_first = intersects(writes[j], reads[i]);
+            if (i_first && j_first) {
+                this->throw_circular_reference(i, j);
+            }
+
+            if (j_first) {
+                dependents[j].push_back(i);
+            } else if (i_first || intersects(writes[i], writes[j])) {
+                dependents[i].push_back(j);
+            }
+        }
+    }
+
+    return dependents;
+}
+
+void Workbook::evaluate(long long threads) {
+    long long sheet_amount = this->sheets.size();
+    std::vector<std::vector<long long>> dependents = this->dependents();
+    std::vector<long long> waiting_for(sheet_amount, 0);
+    for (long long i = 0; i < sheet_amount; i++) {
+        for (long long dependent : dependents[i]) {
+            waiting_for[dependent]++;
+        }
+    }
+
+    // Make sure every sheet can be scheduled before running anything
+    std::vector<long long> remaining_inputs = waiting_for;
+    std::deque<long long> ready;
+    for (long long i = 0; i < sheet_amount; i++) {
+        if (remaining_inputs[i] == 0) {
+            ready.push_back(i);
+        }
+    }
+
+    long long scheduled = 0;
+    while (!ready.empty()) {
+        long long sheet = ready.front();
+        ready.pop_front();
+        scheduled++;
+        for (long long dependent : dependents[sheet]) {
+            remaining_inputs[dependent]--;
+            if (remaining_inputs[dependent] == 0) {
+                ready.push_back(dependent);
+            }
+        }
+    }
+
+    if (scheduled != sheet_amount) {
+        for (long long i = 0; i < sheet_amount; i++) {
+            if (remaining_inputs[i] != 0) {
+                this->throw_circular_reference(i, i);
+            }
+        }
+    }
+
+    for (long long i = 0; i < sheet_amount; i++) {
+        if (waiting_for[i] == 0) {
+            ready.push_back(i);
+        }
+    }
+
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    long long unfinished = sheet_amount;
+    std::exception_ptr error = nullptr;
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [&]() { return !ready.empty() || unfinished == 0 || error != nullptr; });
+            if (unfinished == 0 || error != nullptr) {
+                return;
+            }
+
+            long long sheet = ready.front();
+            ready.pop_front();
+            lock.unlock();
+
+            try {
+                VM vm(*this->sheets[sheet].program, this->sheets[sheet].scope);
+                vm.set_workbook(this);
+                vm.run();
+            } catch (...) {
+                lock.lock();
+                if (error == nullptr) {
+                    error = std::current_exception();
+                }
+
+                changed.notify_all();
+                return;
+            }
+
+            lock.lock();
+            unfinished--;
+            for (long long dependent : dependents[sheet]) {
+                waiting_for[dependent]--;
+                if (waiting_for[dependent] == 0) {
+                    ready.push_back(dependent);
+                }
+            }
+
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (long long i = 0; i < std::min<long long>(threads, sheet_amount); i++) {
+        workers.emplace_back(worker);
+    }
+
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
+
+void Workbook::dump(std::ostream& out) const {
+    for (const Sheet& sheet : this->sheets) {
+        out << "[" << sheet.name << "]\n";
+        sheet.scope->dump(out);
+    }
+}
+
+// Errors
+void Workbook::throw_unknown_sheet(const std::string& name) const {
+    std::stringstream ss;
+    ss << "Sheet '" << name << "' does not exist";
+    throw std::runtime_error(ss.str());
+}
+
+void Workbook::throw_circular_reference(const long long sheet1, const long long sheet2) const {
+    std::stringstream ss;
+    if (sheet1 == sheet2) {
+        ss << "Sheet '" << this->sheets[sheet1].name << "' is part of a circular reference between sheets";
+    } else {
+        ss << "Sheets '" << this->sheets[sheet1].name << "' and '" << this->sheets[sheet2].name << "' read each other's cells";
+    }
+
+    throw std::runtime_error(ss.str());
+}
+
+Workbook* create_workbook() {
+    return new Workbook();
+}
\ No newline at end of file
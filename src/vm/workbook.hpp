@@ -0,0 +1,39 @@
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "vm.hpp"
+
+#pragma once
+
+struct Sheet {
+    std::string name;
+    Scope* scope;
+    const std::vector<Instruction>* program; // Runs against scope, may read and write other sheets
+};
+
+// A set of named sheets, each with its own program. Programs reach other sheets through the
+// LODCS/STOCS/LODRS/STORS instructions. Programs that do not share a sheet one of them writes are
+// evaluated in parallel, the rest run in dependency order (writers before readers, otherwise in the
+// order the sheets were added).
+class Workbook {
+public:
+    Workbook();
+    ~Workbook();
+    void add_sheet(const std::string& name, const std::vector<Instruction>* program); // The program has to outlive the workbook
+    Scope* sheet(const std::string& name) const; // Sheet names are case-insensitive
+    void evaluate(long long threads); // threads = 0 uses one thread per hardware thread
+    void dump(std::ostream& out) const;
+private:
+    std::vector<Sheet> sheets;
+    std::unordered_map<std::string, long long> indexes;
+
+    long long index_of(const std::string& name) const;
+    std::vector<std::vector<long long>> dependents();
+
+    // Errors
+    void throw_unknown_sheet(const std::string& name) const;
+    void throw_circular_reference(const long long sheet1, const long long sheet2) const;
+};
+
+Workbook* create_workbook();
\ No newline at end of file